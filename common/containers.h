@@ -0,0 +1,336 @@
+/** @file containers.h
+ *
+ * Type-specialized containers generated by macros.  Each macro defines a
+ * struct and a set of static inline functions for one element type, so
+ * elements are stored by value in one array and comparisons are compiled
+ * in place rather than called through a function pointer.
+ *
+ *   CONTAINER_VECTOR(name, type)           growable array
+ *   CONTAINER_RING(name, type)             growable first-in first-out ring
+ *   CONTAINER_HEAP(name, type, before)     min-heap; before(a, b) is non-zero
+ *                                          if *a must come out before *b
+ *
+ * container_hash() is the hash for the open-addressed tables built on
+ * these arrays.
+ *
+ * Each defines name_t and functions named name_init(), name_push(), ...
+ * A zeroed struct is an empty container; name_destroy() frees the array.
+ * Running out of memory ends the program, as elsewhere in these programs.
+ *
+ * Example:
+ *
+ *     #define EVENT_BEFORE(a, b) ((a)->time < (b)->time)
+ *     CONTAINER_HEAP(event_heap, event_t, EVENT_BEFORE)
+ *
+ *     event_heap_t events;
+ *     event_heap_init(&events);
+ *     event_heap_push(&events, e);
+ *     e = event_heap_pop(&events);
+ */
+#ifndef __CONTAINERS_H__
+#define __CONTAINERS_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONTAINER_MIN_CAPACITY 16
+
+/** Children per heap node, as in mp4's libpriqueue. */
+#define CONTAINER_HEAP_ARITY 4
+
+static inline void *container_alloc(void *ptr, size_t bytes)
+{
+	if ((ptr = realloc(ptr, bytes)) == NULL)
+	{
+		fprintf(stderr, "Out of memory.\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+#define CONTAINER_HASH_INIT 14695981039346656037ull
+
+/**
+ * 64-bit FNV-1a of len bytes at data, continuing from h; a hash starts at
+ * CONTAINER_HASH_INIT.  A table of a power-of-two capacity looks a key up
+ * from slot hash & (capacity - 1), probing linearly.
+ */
+static inline unsigned long long container_hash(unsigned long long h, const void *data, size_t len)
+{
+	const unsigned char *p = (const unsigned char *)data;
+	while (len-- > 0)
+	{
+		h ^= *p++;
+		h *= 1099511628211ull;
+	}
+	return h;
+}
+
+static inline unsigned long long container_hash_string(const char *s)
+{
+	return container_hash(CONTAINER_HASH_INIT, s, strlen(s));
+}
+
+
+/**
+ * name_t: a growable array of type.
+ *
+ *   name_push(v, x)     append x, amortized O(1)
+ *   name_pop(v)         remove and return the last element (v must not be empty)
+ *   name_at(v, i)       pointer to element i, valid until the next push
+ *   name_size(v), name_clear(v), name_reserve(v, n)
+ */
+#define CONTAINER_VECTOR(name, type)                                           \
+typedef struct                                                                 \
+{                                                                              \
+	type *data;                                                                \
+	int size, capacity;                                                        \
+} name##_t;                                                                    \
+                                                                               \
+static inline void name##_init(name##_t *v)                                    \
+{                                                                              \
+	v->data = NULL;                                                            \
+	v->size = v->capacity = 0;                                                 \
+}                                                                              \
+                                                                               \
+static inline void name##_destroy(name##_t *v)                                 \
+{                                                                              \
+	free(v->data);                                                             \
+	name##_init(v);                                                            \
+}                                                                              \
+                                                                               \
+static inline int name##_size(const name##_t *v)                               \
+{                                                                              \
+	return v->size;                                                            \
+}                                                                              \
+                                                                               \
+static inline void name##_reserve(name##_t *v, int n)                          \
+{                                                                              \
+	int capacity = v->capacity ? v->capacity : CONTAINER_MIN_CAPACITY;         \
+	if (n <= v->capacity)                                                      \
+		return;                                                                \
+	while (capacity < n)                                                       \
+		capacity *= 2;                                                         \
+	v->data = (type *)container_alloc(v->data, capacity * sizeof(type));       \
+	v->capacity = capacity;                                                    \
+}                                                                              \
+                                                                               \
+static inline void name##_push(name##_t *v, type value)                        \
+{                                                                              \
+	if (v->size == v->capacity)                                                \
+		name##_reserve(v, v->size + 1);                                        \
+	v->data[v->size++] = value;                                                \
+}                                                                              \
+                                                                               \
+static inline type name##_pop(name##_t *v)                                     \
+{                                                                              \
+	return v->data[--v->size];                                                 \
+}                                                                              \
+                                                                               \
+static inline type *name##_at(name##_t *v, int i)                              \
+{                                                                              \
+	return &v->data[i];                                                        \
+}                                                                              \
+                                                                               \
+static inline void name##_clear(name##_t *v)                                   \
+{                                                                              \
+	v->size = 0;                                                               \
+}
+
+
+/**
+ * name_t: a first-in first-out queue of type in a circular array whose
+ * capacity is a power of two.
+ *
+ *   name_push(r, x)     add x at the back, amortized O(1)
+ *   name_pop(r)         remove and return the front (r must not be empty)
+ *   name_at(r, i)       pointer to the i'th element from the front, O(1)
+ *   name_remove_at(r, i)  remove and return the i'th element, moving
+ *                       whichever side of it is shorter
+ *   name_size(r), name_clear(r)
+ */
+#define CONTAINER_RING(name, type)                                             \
+typedef struct                                                                 \
+{                                                                              \
+	type *data;                                                                \
+	int head, size, capacity;                                                  \
+} name##_t;                                                                    \
+                                                                               \
+static inline void name##_init(name##_t *r)                                    \
+{                                                                              \
+	r->data = NULL;                                                            \
+	r->head = r->size = r->capacity = 0;                                       \
+}                                                                              \
+                                                                               \
+static inline void name##_destroy(name##_t *r)                                 \
+{                                                                              \
+	free(r->data);                                                             \
+	name##_init(r);                                                            \
+}                                                                              \
+                                                                               \
+static inline int name##_size(const name##_t *r)                               \
+{                                                                              \
+	return r->size;                                                            \
+}                                                                              \
+                                                                               \
+/* Doubles the array, unwrapping the elements to start at index 0. */          \
+static inline void name##_grow(name##_t *r)                                    \
+{                                                                              \
+	int capacity = r->capacity ? r->capacity * 2 : CONTAINER_MIN_CAPACITY;     \
+	int first = r->capacity - r->head;                                         \
+	r->data = (type *)container_alloc(r->data, capacity * sizeof(type));       \
+	if (r->size > first)                                                       \
+		memcpy(r->data + r->capacity, r->data, (r->size - first) * sizeof(type)); \
+	if (r->head > 0 && r->size > 0)                                            \
+		memmove(r->data, r->data + r->head, r->size * sizeof(type));           \
+	r->head = 0;                                                               \
+	r->capacity = capacity;                                                    \
+}                                                                              \
+                                                                               \
+static inline type *name##_at(name##_t *r, int i)                              \
+{                                                                              \
+	return &r->data[(r->head + i) & (r->capacity - 1)];                        \
+}                                                                              \
+                                                                               \
+static inline void name##_push(name##_t *r, type value)                        \
+{                                                                              \
+	if (r->size == r->capacity)                                                \
+		name##_grow(r);                                                        \
+	r->data[(r->head + r->size++) & (r->capacity - 1)] = value;                \
+}                                                                              \
+                                                                               \
+static inline type name##_pop(name##_t *r)                                     \
+{                                                                              \
+	type value = r->data[r->head];                                             \
+	r->head = (r->head + 1) & (r->capacity - 1);                               \
+	r->size--;                                                                 \
+	return value;                                                              \
+}                                                                              \
+                                                                               \
+/* Moves the shorter side of element i over it, at most two memmove()s.  */   \
+static inline type name##_remove_at(name##_t *r, int i)                        \
+{                                                                              \
+	int mask = r->capacity - 1, at = (r->head + i) & mask;                     \
+	type value = r->data[at];                                                  \
+	if (i < r->size / 2)                                                       \
+	{                                                                          \
+		if (r->head <= at)                                                     \
+			memmove(r->data + r->head + 1, r->data + r->head, (at - r->head) * sizeof(type)); \
+		else                                                                   \
+		{                                                                      \
+			memmove(r->data + 1, r->data, at * sizeof(type));                  \
+			r->data[0] = r->data[mask];                                        \
+			memmove(r->data + r->head + 1, r->data + r->head, (mask - r->head) * sizeof(type)); \
+		}                                                                      \
+		r->head = (r->head + 1) & mask;                                        \
+	}                                                                          \
+	else                                                                       \
+	{                                                                          \
+		int last = (r->head + r->size - 1) & mask;                             \
+		if (at <= last)                                                        \
+			memmove(r->data + at, r->data + at + 1, (last - at) * sizeof(type)); \
+		else                                                                   \
+		{                                                                      \
+			memmove(r->data + at, r->data + at + 1, (mask - at) * sizeof(type)); \
+			r->data[mask] = r->data[0];                                        \
+			memmove(r->data, r->data + 1, last * sizeof(type));                \
+		}                                                                      \
+	}                                                                          \
+	r->size--;                                                                 \
+	return value;                                                              \
+}                                                                              \
+                                                                               \
+static inline void name##_clear(name##_t *r)                                   \
+{                                                                              \
+	r->head = r->size = 0;                                                     \
+}
+
+
+/**
+ * name_t: a CONTAINER_HEAP_ARITY-ary min-heap of type ordered by
+ * before(const type *a, const type *b).  Elements that tie come out in no
+ * particular order, so before should be a total order where that matters.
+ *
+ *   name_push(h, x)     add x, O(log n)
+ *   name_pop(h)         remove and return the first element (h must not be empty)
+ *   name_peek(h)        pointer to the first element, NULL if h is empty
+ *   name_size(h), name_clear(h)
+ */
+#define CONTAINER_HEAP(name, type, before)                                     \
+typedef struct                                                                 \
+{                                                                              \
+	type *data;                                                                \
+	int size, capacity;                                                        \
+} name##_t;                                                                    \
+                                                                               \
+static inline void name##_init(name##_t *h)                                    \
+{                                                                              \
+	h->data = NULL;                                                            \
+	h->size = h->capacity = 0;                                                 \
+}                                                                              \
+                                                                               \
+static inline void name##_destroy(name##_t *h)                                 \
+{                                                                              \
+	free(h->data);                                                             \
+	name##_init(h);                                                            \
+}                                                                              \
+                                                                               \
+static inline int name##_size(const name##_t *h)                               \
+{                                                                              \
+	return h->size;                                                            \
+}                                                                              \
+                                                                               \
+static inline type *name##_peek(name##_t *h)                                   \
+{                                                                              \
+	return (h->size > 0) ? &h->data[0] : NULL;                                 \
+}                                                                              \
+                                                                               \
+static inline void name##_push(name##_t *h, type value)                        \
+{                                                                              \
+	int i;                                                                     \
+	if (h->size == h->capacity)                                                \
+	{                                                                          \
+		h->capacity = h->capacity ? h->capacity * 2 : CONTAINER_MIN_CAPACITY;  \
+		h->data = (type *)container_alloc(h->data, h->capacity * sizeof(type)); \
+	}                                                                          \
+	for (i = h->size++; i > 0; )                                               \
+	{                                                                          \
+		int parent = (i - 1) / CONTAINER_HEAP_ARITY;                           \
+		if (!before(&value, &h->data[parent]))                                 \
+			break;                                                             \
+		h->data[i] = h->data[parent];                                          \
+		i = parent;                                                            \
+	}                                                                          \
+	h->data[i] = value;                                                        \
+}                                                                              \
+                                                                               \
+static inline type name##_pop(name##_t *h)                                     \
+{                                                                              \
+	type top = h->data[0];                                                     \
+	type last = h->data[--h->size];                                            \
+	int i = 0;                                                                 \
+	while (1)                                                                  \
+	{                                                                          \
+		int first = i * CONTAINER_HEAP_ARITY + 1, best = first, c;             \
+		if (first >= h->size)                                                  \
+			break;                                                             \
+		for (c = first + 1; c < first + CONTAINER_HEAP_ARITY && c < h->size; c++) \
+			if (before(&h->data[c], &h->data[best]))                           \
+				best = c;                                                      \
+		if (!before(&h->data[best], &last))                                    \
+			break;                                                             \
+		h->data[i] = h->data[best];                                            \
+		i = best;                                                              \
+	}                                                                          \
+	if (h->size > 0)                                                           \
+		h->data[i] = last;                                                     \
+	return top;                                                                \
+}                                                                              \
+                                                                               \
+static inline void name##_clear(name##_t *h)                                   \
+{                                                                              \
+	h->size = 0;                                                               \
+}
+
+#endif
@@ -4,15 +4,6 @@
 #include <stdlib.h>
 
 #include "queue.h"
-/**
- * Private.  Linked-list node
- *
- */
-struct queue_node {
-	void *item; ///<Stored value
-	struct queue_node *next; ///<Link to next node
-};
- 
 /**
  * Initializes queue structure.
  * Should always be called first.
@@ -21,23 +12,19 @@ struct queue_node {
  * @return void
  */
 void queue_init(queue_t *q) {
-
-	q->head = NULL;
-	q->tail = NULL;
-	q->size = 0;
+	queue_ring_init(&q->ring);
 }
 
 /**
  * Frees all associated memory.
- * Should always be called last.
+ * Should always be called last; the queue is left empty, as after
+ * queue_init(), so it may also be used to clear the queue.
  *
  * @param q A pointer to the queue data structure.
  * @return void
  */
 void queue_destroy(queue_t *q) {
-	while(queue_size(q) > 0) {
-		queue_dequeue(q);
-	}
+	queue_ring_destroy(&q->ring);
 }
 
 /**
@@ -48,32 +35,17 @@ void queue_destroy(queue_t *q) {
  * @return NULL if the queue is empty.
  */
 void *queue_dequeue(queue_t *q) {
-	struct queue_node *front;
-	void *item;
-
 	if(queue_size(q) == 0) {
 		return NULL;
 	}
 
-	front = q->head;
-	q->head = q->head->next;
-	q->size--;
-
-	item = front->item;
-	free(front);
-
-	if(queue_size(q) == 0) {
-		// just cleaning up
-		q->head = NULL;
-		q->tail = NULL;
-	}
-
-	return item;
+	return queue_ring_pop(&q->ring);
 }
 
 
 /**
- * Removes and returns element at position pos.
+ * Removes and returns element at position pos, moving the items on
+ * whichever side of it is shorter.
  *
  * @param q A pointer to the queue data structure.
  * @param pos Position to be removed.
@@ -81,35 +53,9 @@ void *queue_dequeue(queue_t *q) {
  * @return NULL if the position is invalid.
  */
 void *queue_remove_at(queue_t *q, int pos){
-	if( pos < 0 || q->size-1 < pos)
+	if( pos < 0 || queue_size(q) <= (unsigned int)pos)
 		return NULL;
-	q->size--;
-	struct queue_node *cur = q->head;
-	struct queue_node *prev = NULL;
-	while(pos--){
-		prev = cur;
-		cur = cur->next;
-	}
-
-	if(cur == q->head){
-		q->head = cur->next;
-		if(q->head == NULL)
-			q->tail = NULL;
-		void *item = cur->item;
-		free(cur);
-		return item;
-	}else if(cur == q->tail){
-		q->tail = prev;
-		prev->next = NULL;
-		void *item = cur->item;
-		free(cur);
-		return item;
-	}else{
-		prev->next = cur->next;
-		void *item = cur->item;
-		free(cur);
-		return item;
-	}
+	return queue_ring_remove_at(&q->ring, pos);
 }
 
 /**
@@ -121,18 +67,9 @@ void *queue_remove_at(queue_t *q, int pos){
  * @return NULL if position out of bounds.
  */
 void *queue_at(queue_t *q, int pos){
-	int i;
-	struct queue_node *node;
-	if(q == NULL)
+	if(q == NULL || pos < 0 || queue_size(q) <= (unsigned int)pos)
 		return NULL;
-		
-
-	for(i=0, node=q->head; i<pos && node != NULL; i++) node=node->next;
-	if(i != pos)
-		return 0;
-	else
-		return node->item;
-
+	return *queue_ring_at(&q->ring, pos);
 }
 
 /**
@@ -143,17 +80,7 @@ void *queue_at(queue_t *q, int pos){
  * @return void
  */
 void queue_enqueue(queue_t *q, void *item) {
-	struct queue_node *back = malloc(sizeof(struct queue_node));
-
-	back->item = item;
-	back->next = NULL;
-	if(queue_size(q) == 0) {
-		q->head = back;
-	} else {
-		q->tail->next = back;
-	}
-	q->tail = back;
-	q->size++;
+	queue_ring_push(&q->ring, item);
 }
 
 /**
@@ -163,7 +90,7 @@ void queue_enqueue(queue_t *q, void *item) {
  * @return The number of items in the queue.
  */
 unsigned int queue_size(queue_t *q) {
-	return q->size;
+	return queue_ring_size(&q->ring);
 }
 
 /**
@@ -175,14 +102,8 @@ unsigned int queue_size(queue_t *q) {
  * @return void
  */
 void queue_iterate(queue_t *q, void (*iter_func)(void *, void *), void *arg) {
-	struct queue_node *node;
-	if(queue_size(q) == 0) {
-		return;
-	}
-
-	node = q->head;
-	while(node != NULL) {
-		iter_func(node->item, arg);
-		node = node->next;
+	int i;
+	for(i = 0; i < queue_ring_size(&q->ring); i++) {
+		iter_func(*queue_ring_at(&q->ring, i), arg);
 	}
 }
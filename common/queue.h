@@ -2,22 +2,23 @@
 #ifndef __QUEUE_H__
 #define __QUEUE_H__
 
-typedef enum{True=1,False=0} bool;
+#include "containers.h"
+
+CONTAINER_RING(queue_ring, void *)
 
 /**
  * Queue Data Structure
+ *
+ * Items live in one circular array, so queue_at() is O(1) and enqueueing
+ * does not allocate once the array has grown to the queue's peak size.
  */
 typedef struct {
-	struct queue_node *head; ///<Head of linked-list
-	struct queue_node *tail; ///<Tail of linked-list
-	unsigned int size; ///<Number of nodes in linked-list
+	queue_ring_t ring; ///<Items, front first
 } queue_t;
 
 void queue_init(queue_t *q);
 void queue_destroy(queue_t *q);
 
-int queue_have(queue_t *q, void* item);
-
 void *queue_dequeue(queue_t *q);
 void *queue_at(queue_t *q, int pos);
 void *queue_remove_at(queue_t *q, int pos);
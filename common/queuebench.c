@@ -0,0 +1,185 @@
+/** @file queuebench.c
+ *
+ * Times queue_t on the FIFO and indexed patterns of its users: parmake and
+ * libwfg append, then walk the queue with for (i...) queue_at(q, i) loops,
+ * take items out of the middle with queue_remove_at(), and drain from the
+ * front.  An indexed walk is quadratic on a list and linear on the ring.
+ * Usage: ./queuebench [items]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "queue.h"
+
+/*
+  queue_t as it was before the ring buffer: a singly linked list with head
+  and tail pointers and a node allocated for every item, where reaching
+  position i means following i links.
+*/
+typedef struct _list_node_t
+{
+	void *item;
+	struct _list_node_t *next;
+} list_node_t;
+
+typedef struct _list_queue_t
+{
+	list_node_t *head, *tail;
+	unsigned int size;
+} list_queue_t;
+
+static void list_init(list_queue_t *q)
+{
+	q->head = q->tail = NULL;
+	q->size = 0;
+}
+
+static void list_enqueue(list_queue_t *q, void *item)
+{
+	list_node_t *back = malloc(sizeof(list_node_t));
+	back->item = item;
+	back->next = NULL;
+	if (q->size == 0)
+		q->head = back;
+	else
+		q->tail->next = back;
+	q->tail = back;
+	q->size++;
+}
+
+static void *list_dequeue(list_queue_t *q)
+{
+	list_node_t *front = q->head;
+	void *item;
+	if (q->size == 0)
+		return NULL;
+	q->head = front->next;
+	if (--q->size == 0)
+		q->tail = NULL;
+	item = front->item;
+	free(front);
+	return item;
+}
+
+static void *list_at(list_queue_t *q, int pos)
+{
+	list_node_t *node = q->head;
+	while (pos-- > 0 && node != NULL)
+		node = node->next;
+	return (node != NULL) ? node->item : NULL;
+}
+
+static void *list_remove_at(list_queue_t *q, int pos)
+{
+	list_node_t **link = &q->head, *prev = NULL, *node;
+	void *item;
+	while (pos-- > 0)
+	{
+		prev = *link;
+		link = &(*link)->next;
+	}
+	node = *link;
+	*link = node->next;
+	if (q->tail == node)
+		q->tail = prev;
+	q->size--;
+	item = node->item;
+	free(node);
+	return item;
+}
+
+
+static double seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, double t_list, double t_ring)
+{
+	printf("%-16s%10.4fs %10.4fs %10.1fx\n", name, t_list, t_ring, t_list / t_ring);
+}
+
+int main(int argc, char **argv)
+{
+	int n = (argc > 1) ? atoi(argv[1]) : 20000;
+	int i;
+	long checksum_list = 0, checksum_ring = 0;
+	int *values;
+	list_queue_t lq;
+	queue_t rq;
+	double t, t_list[4], t_ring[4];
+
+	if (n <= 0)
+	{
+		fprintf(stderr, "Usage: %s [items]\n", argv[0]);
+		return 1;
+	}
+
+	values = malloc(n * sizeof(int));
+	for (i = 0; i < n; i++)
+		values[i] = i;
+
+	list_init(&lq);
+	queue_init(&rq);
+
+	/* enqueue n */
+	t = seconds();
+	for (i = 0; i < n; i++)
+		list_enqueue(&lq, &values[i]);
+	t_list[0] = seconds() - t;
+	t = seconds();
+	for (i = 0; i < n; i++)
+		queue_enqueue(&rq, &values[i]);
+	t_ring[0] = seconds() - t;
+
+	/* visit every item by index, as the for (i...) queue_at() loops do */
+	t = seconds();
+	for (i = 0; i < n; i++)
+		checksum_list += *(int *)list_at(&lq, i);
+	t_list[1] = seconds() - t;
+	t = seconds();
+	for (i = 0; i < n; i++)
+		checksum_ring += *(int *)queue_at(&rq, i);
+	t_ring[1] = seconds() - t;
+
+	/* remove half the items from a quarter of the way in */
+	t = seconds();
+	for (i = 0; i < n / 2; i++)
+		checksum_list += *(int *)list_remove_at(&lq, lq.size / 4);
+	t_list[2] = seconds() - t;
+	t = seconds();
+	for (i = 0; i < n / 2; i++)
+		checksum_ring += *(int *)queue_remove_at(&rq, queue_size(&rq) / 4);
+	t_ring[2] = seconds() - t;
+
+	/* dequeue the rest */
+	t = seconds();
+	while (lq.size > 0)
+		checksum_list = checksum_list * 31 + *(int *)list_dequeue(&lq);
+	t_list[3] = seconds() - t;
+	t = seconds();
+	while (queue_size(&rq) > 0)
+		checksum_ring = checksum_ring * 31 + *(int *)queue_dequeue(&rq);
+	t_ring[3] = seconds() - t;
+
+	if (checksum_list != checksum_ring)
+	{
+		fprintf(stderr, "Order mismatch between the list and the ring.\n");
+		return 2;
+	}
+
+	printf("%d items               list       ring     speedup\n", n);
+	report("enqueue all", t_list[0], t_ring[0]);
+	report("queue_at each", t_list[1], t_ring[1]);
+	report("remove_at half", t_list[2], t_ring[2]);
+	report("dequeue rest", t_list[3], t_ring[3]);
+
+	queue_destroy(&rq);
+	free(values);
+
+	return 0;
+}
@@ -0,0 +1,311 @@
+/** @file batch.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "exec.h"
+#include "batch.h"
+
+#define _BATCH_PENDING_ 0
+#define _BATCH_RUNNING_ 1
+#define _BATCH_DONE_    2
+
+static double now_seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
+}
+
+static char* trim(char* s)
+{
+	char* end;
+	while(isspace((unsigned char)*s)) s++;
+	end = s + strlen(s);
+	while(end > s && isspace((unsigned char)end[-1])) end--;
+	*end = '\0';
+	return s;
+}
+
+/**
+ * Cuts the next command off a line at an unquoted "&&" or ";".
+ *
+ * @param text
+ *    In: the rest of the line.  Out: what follows the separator, or NULL
+ *    if this was the last command.
+ * @param and_next
+ *    Set to 1 if the separator was "&&".
+ *
+ * @returns
+ *    The command, trimmed.
+ */
+static char* next_command(char** text, int* and_next)
+{
+	char* s = *text;
+	char* start = s;
+	char quote = 0;
+
+	*and_next = 0;
+	for(;*s;s++){
+		if(quote){
+			if(*s == '\\' && quote == '"' && s[1] != '\0') s++;
+			else if(*s == quote) quote = 0;
+		}
+		else if(*s == '\\' && s[1] != '\0'){
+			s++;
+		}
+		else if(*s == '\'' || *s == '"'){
+			quote = *s;
+		}
+		else if(*s == ';' || (s[0] == '&' && s[1] == '&')){
+			*and_next = (*s == '&');
+			*s = '\0';
+			*text = s + (*and_next ? 2 : 1);
+			return trim(start);
+		}
+	}
+	*text = NULL;
+	return trim(start);
+}
+
+/**
+ * Runs the commands of one line in order.  Executed in the worker process.
+ *
+ * A command after "&&" only runs if the previous one succeeded; a command
+ * after ";" always runs.  "cd" and "exit" behave like in the shell, but only
+ * affect this line.
+ *
+ * @returns
+ *    The exit status of the last command that ran.
+ */
+static int run_line(batch_line_t* line)
+{
+	char* rest = line->text;
+	char* cmd;
+	int and_next = 0, status = 0;
+	double start;
+	struct rusage ru;
+
+	while(rest != NULL){
+		int and_this = and_next;
+		cmd = next_command(&rest,&and_next);
+		// a failed "&&" chain skips everything up to the next ";"
+		if(and_this && status != 0) continue;
+		if(*cmd == '\0') continue;
+
+		start = now_seconds();
+		memset(&ru,0,sizeof(ru));
+		if(strcmp(cmd,"exit") == 0) break;
+		if(strncmp(cmd,"cd ",3) == 0){
+			status = (chdir(trim(cmd+3)) == -1);
+			if(status) printf("%s: No such file or directory\n",trim(cmd+3));
+			exec_path_cache_flush();
+		}
+		else{
+			status = exec_command(cmd,&ru);
+			if(status == -1){
+				printf("Error: %s\n",strerror(errno));
+				status = 127;
+			}
+		}
+		fflush(stdout);
+		fprintf(line->timing,"[line %d] %.3fs (%.3fs user, %.3fs sys, %ldKB) exit %d: %s\n",
+			line->lineno,now_seconds()-start,
+			ru.ru_utime.tv_sec + ru.ru_utime.tv_usec/1e6,
+			ru.ru_stime.tv_sec + ru.ru_stime.tv_usec/1e6,
+			ru.ru_maxrss,status,cmd);
+	}
+	return status;
+}
+
+/**
+ * Closes the capture files of a line and frees its text.
+ */
+static void release_line(batch_line_t* line)
+{
+	if(line->out != NULL) fclose(line->out);
+	if(line->timing != NULL) fclose(line->timing);
+	line->out = NULL;
+	line->timing = NULL;
+	free(line->text);
+	line->text = NULL;
+}
+
+static int start_line(batch_line_t* line)
+{
+	int saved;
+
+	line->out = tmpfile();
+	line->timing = tmpfile();
+	if(line->out == NULL || line->timing == NULL) goto fail;
+
+	fflush(stdout);
+	fflush(stderr);
+	line->pid = fork();
+	if(line->pid == -1) goto fail;
+	if(line->pid == 0){
+		dup2(fileno(line->out),STDOUT_FILENO);
+		dup2(fileno(line->out),STDERR_FILENO);
+		int status = run_line(line);
+		fflush(stdout);
+		fflush(line->timing);
+		_exit(status & 0xff);
+	}
+	line->state = _BATCH_RUNNING_;
+	return 0;
+
+fail:
+	saved = errno;
+	if(line->out != NULL) fclose(line->out);
+	if(line->timing != NULL) fclose(line->timing);
+	line->out = NULL;
+	line->timing = NULL;
+	errno = saved;
+	return -1;
+}
+
+static void copy_stream(FILE* from, FILE* to)
+{
+	char buf[8192];
+	size_t n;
+	rewind(from);
+	while((n = fread(buf,1,sizeof(buf),from)) > 0)
+		fwrite(buf,1,n,to);
+}
+
+/**
+ * Prints the captured output of a finished line, then its timings.
+ */
+static void flush_line(batch_line_t* line)
+{
+	copy_stream(line->out,stdout);
+	fflush(stdout);
+	copy_stream(line->timing,stderr);
+	release_line(line);
+}
+
+/**
+ * Frees every line that has not been printed yet, then the array.
+ */
+static void free_lines(batch_line_t* lines, int from, int n)
+{
+	int i;
+	for(i=from;i<n;i++)
+		release_line(&lines[i]);
+	free(lines);
+}
+
+static batch_line_t* read_script(const char* script, int* count)
+{
+	FILE* f = fopen(script,"r");
+	batch_line_t* lines = NULL;
+	int n = 0, cap = 0, lineno = 0;
+	char* buf = NULL;
+	size_t size = 0;
+	ssize_t len;
+
+	if(f == NULL) return NULL;
+	while((len = getline(&buf,&size,f)) != -1){
+		lineno++;
+		if(len > 0 && buf[len-1] == '\n') buf[len-1] = '\0';
+		char* text = trim(buf);
+		if(*text == '\0' || *text == '#') continue;
+
+		if(n == cap){
+			cap = (cap == 0) ? 64 : cap*2;
+			lines = (batch_line_t*)realloc(lines,sizeof(batch_line_t)*cap);
+		}
+		lines[n].lineno = lineno;
+		lines[n].text = strdup(text);
+		lines[n].pid = -1;
+		lines[n].out = NULL;
+		lines[n].timing = NULL;
+		lines[n].state = _BATCH_PENDING_;
+		lines[n].status = 0;
+		n++;
+	}
+	free(buf);
+	fclose(f);
+
+	*count = n;
+	if(lines == NULL) lines = (batch_line_t*)malloc(sizeof(batch_line_t));
+	return lines;
+}
+
+/**
+ * Runs a script with up to workers lines executing at the same time.
+ *
+ * Each non-empty line (lines starting with '#' are comments) is an
+ * independent unit of work; commands within a line are chained with "&&"
+ * or ";" and run in order.  The output of every line is captured and
+ * printed in script order once the line is done, followed by the wall time
+ * of each of its commands on stderr.
+ *
+ * @param script
+ *    Path of the script to run.
+ * @param workers
+ *    Maximum number of lines running concurrently.
+ *
+ * @returns
+ *    0 if every line succeeded, 1 if at least one failed, -1 if the script
+ *    could not be read or a worker could not be started (errno is set).
+ */
+int batch_run(const char* script, int workers)
+{
+	batch_line_t* lines;
+	int n, next_start = 0, next_print = 0, running = 0, failed = 0, i, status;
+	int window;
+	double start = now_seconds();
+	pid_t child;
+
+	if(workers < 1) workers = 1;
+	window = workers * _BATCH_WINDOW_PER_WORKER_;
+	if((lines = read_script(script,&n)) == NULL) return -1;
+
+	while(next_print < n){
+		while(running < workers && next_start < n && next_start - next_print < window){
+			if(start_line(&lines[next_start]) == -1){
+				int saved = errno;
+				while(running > 0 && wait(NULL) > 0) running--;
+				free_lines(lines,next_print,n);
+				errno = saved;
+				return -1;
+			}
+			next_start++;
+			running++;
+		}
+
+		child = wait(&status);
+		if(child == -1){
+			if(errno == EINTR) continue;
+			int saved = errno;
+			free_lines(lines,next_print,n);
+			errno = saved;
+			return -1;
+		}
+		for(i=next_print;i<next_start;i++){
+			if(lines[i].state == _BATCH_RUNNING_ && lines[i].pid == child){
+				lines[i].state = _BATCH_DONE_;
+				lines[i].status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+				if(lines[i].status != 0) failed++;
+				running--;
+				break;
+			}
+		}
+
+		while(next_print < n && lines[next_print].state == _BATCH_DONE_){
+			flush_line(&lines[next_print]);
+			next_print++;
+		}
+	}
+
+	fprintf(stderr,"[batch] %d line(s), %d failed, %d worker(s), %.3fs\n",
+		n,failed,workers,now_seconds()-start);
+	free(lines);
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,26 @@
+/** @file batch.h */
+
+#ifndef __BATCH_H_
+#define __BATCH_H_
+
+#include <sys/types.h>
+#include <stdio.h>
+
+/** How far ahead of the oldest unprinted line workers may run, per worker. */
+#define _BATCH_WINDOW_PER_WORKER_ 8
+
+/** One line of a batch script and the worker running it. */
+typedef struct _batch_line_t
+{
+	int lineno;     ///< Line number in the script, for reporting
+	char* text;     ///< The line, without the trailing newline
+	pid_t pid;      ///< Worker process, while the line is running
+	FILE* out;      ///< Captured stdout and stderr of the line
+	FILE* timing;   ///< Timing records written by the worker
+	int state;      ///< 0 pending, 1 running, 2 finished
+	int status;     ///< Exit status of the last command that ran
+} batch_line_t;
+
+int batch_run(const char* script, int workers);
+
+#endif
@@ -0,0 +1,597 @@
+/** @file exec.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "exec.h"
+
+extern char **environ;
+
+/** Characters that need a real /bin/sh when they appear unquoted. */
+#define _SH_SPECIAL_ "$`*?[();"
+
+/** One command of a pipeline, with its own redirections. */
+typedef struct _stage_t
+{
+	char** argv;
+	int argc;
+	char* in_file;
+	char* out_file;
+	int append;
+} stage_t;
+
+/** A tokenized command line. */
+typedef struct _pipeline_t
+{
+	stage_t* stages;
+	int nstages;
+	int background;
+	char* buf; ///< Backing storage for every word in the pipeline
+} pipeline_t;
+
+/** A cached PATH lookup. */
+typedef struct _path_entry_t
+{
+	char* name;
+	char* path;
+} path_entry_t;
+
+static path_entry_t path_cache[_EXEC_PATH_CACHE_SIZE_];
+static unsigned int path_cache_used;
+static char* path_cache_env;
+
+static exec_job_t jobs[_EXEC_MAX_JOBS_];
+
+
+static unsigned int hash_name(const char* s)
+{
+	unsigned int h = 2166136261u;
+	while(*s){
+		h ^= (unsigned char)*s++;
+		h *= 16777619u;
+	}
+	return h;
+}
+
+/**
+ * Forgets every cached PATH lookup.
+ *
+ * Called after anything that may change what a bare command name resolves
+ * to, such as a change of directory (PATH may contain relative entries).
+ */
+void exec_path_cache_flush()
+{
+	unsigned int i;
+	for(i=0;i<_EXEC_PATH_CACHE_SIZE_;i++){
+		free(path_cache[i].name);
+		free(path_cache[i].path);
+		path_cache[i].name = NULL;
+		path_cache[i].path = NULL;
+	}
+	path_cache_used = 0;
+	free(path_cache_env);
+	path_cache_env = NULL;
+}
+
+static void path_cache_drop(const char* name)
+{
+	unsigned int i;
+	for(i=0;i<_EXEC_PATH_CACHE_SIZE_;i++){
+		if(path_cache[i].name!=NULL && strcmp(path_cache[i].name,name)==0){
+			// open addressing: the simplest correct delete is a full flush
+			exec_path_cache_flush();
+			return;
+		}
+	}
+}
+
+static path_entry_t* path_cache_slot(const char* name)
+{
+	unsigned int i = hash_name(name) & (_EXEC_PATH_CACHE_SIZE_-1);
+	while(path_cache[i].name != NULL && strcmp(path_cache[i].name,name) != 0)
+		i = (i+1) & (_EXEC_PATH_CACHE_SIZE_-1);
+	return &path_cache[i];
+}
+
+/**
+ * Resolves a command name against PATH, caching the result.
+ *
+ * @param name
+ *    argv[0] of the command.
+ * @param cached
+ *    Set to 1 if the result came from the cache.
+ *
+ * @returns
+ *    The full path of the executable, or NULL if it was not found.  The
+ *    returned string must not be freed.
+ */
+static const char* resolve_path(const char* name, int* cached)
+{
+	*cached = 0;
+	if(strchr(name,'/') != NULL) return name;
+
+	const char* env = getenv("PATH");
+	if(env == NULL) env = "/bin:/usr/bin";
+	if(path_cache_env == NULL || strcmp(path_cache_env,env) != 0){
+		exec_path_cache_flush();
+		path_cache_env = strdup(env);
+	}
+
+	path_entry_t* slot = path_cache_slot(name);
+	if(slot->name != NULL){
+		*cached = 1;
+		return slot->path;
+	}
+
+	size_t name_len = strlen(name);
+	char* candidate = (char*)malloc(strlen(env) + name_len + 2);
+	const char* dir = env;
+	while(1){
+		const char* end = strchr(dir,':');
+		size_t dir_len = (end==NULL) ? strlen(dir) : (size_t)(end-dir);
+		struct stat st;
+
+		if(dir_len == 0){
+			strcpy(candidate,name);  // empty entry means the cwd
+		}
+		else{
+			memcpy(candidate,dir,dir_len);
+			candidate[dir_len] = '/';
+			strcpy(candidate+dir_len+1,name);
+		}
+		if(access(candidate,X_OK)==0 && stat(candidate,&st)==0 && S_ISREG(st.st_mode)){
+			if(path_cache_used*4 >= _EXEC_PATH_CACHE_SIZE_*3){
+				exec_path_cache_flush();
+				path_cache_env = strdup(env);
+				slot = path_cache_slot(name);
+			}
+			slot->name = strdup(name);
+			slot->path = candidate;
+			path_cache_used++;
+			return candidate;
+		}
+		if(end == NULL) break;
+		dir = end+1;
+	}
+
+	free(candidate);
+	return NULL;
+}
+
+
+static stage_t* pipeline_add_stage(pipeline_t* p, size_t max_words)
+{
+	stage_t* st;
+	p->stages = (stage_t*)realloc(p->stages,sizeof(stage_t)*(p->nstages+1));
+	st = &p->stages[p->nstages++];
+	st->argv = (char**)malloc(sizeof(char*)*(max_words+1));
+	st->argc = 0;
+	st->argv[0] = NULL;
+	st->in_file = NULL;
+	st->out_file = NULL;
+	st->append = 0;
+	return st;
+}
+
+static void pipeline_free(pipeline_t* p)
+{
+	int i;
+	for(i=0;i<p->nstages;i++)
+		free(p->stages[i].argv);
+	free(p->stages);
+	free(p->buf);
+	p->stages = NULL;
+	p->nstages = 0;
+	p->buf = NULL;
+}
+
+/**
+ * Words that mean something to /bin/sh when they start a command: reserved
+ * words, and the builtins that have no executable of their own to spawn.
+ */
+static const char* shell_words[] = {
+	"!", "{", "}", "[[", "case", "for", "function", "if", "until", "while",
+	".", ":", "alias", "bg", "break", "cd", "command", "continue", "declare",
+	"eval", "exec", "exit", "export", "fc", "fg", "getopts", "hash", "jobs",
+	"let", "local", "read", "readonly", "return", "set", "shift", "source",
+	"times", "trap", "type", "typeset", "ulimit", "umask", "unalias",
+	"unset", "wait", NULL
+};
+
+static int is_shell_word(const char* w)
+{
+	int i;
+	for(i=0;shell_words[i]!=NULL;i++)
+		if(strcmp(w,shell_words[i])==0) return 1;
+	return 0;
+}
+
+/**
+ * Splits a command line into a pipeline of argv vectors.
+ *
+ * Understands quoting, backslash escapes, '|', '<', '>', '>>' and a trailing
+ * '&'.  Anything else that means something to /bin/sh (variables, globs,
+ * sub-shells, lists, fd redirections, ...) is not interpreted here.
+ *
+ * @returns
+ *    0 if the line was tokenized, 1 if it must be handed to /bin/sh.
+ */
+static int parse_line(const char* line, pipeline_t* p)
+{
+	size_t len = strlen(line);
+	const char* s = line;
+	char* out;
+	char** pending = NULL;
+	stage_t* st;
+
+	p->stages = NULL;
+	p->nstages = 0;
+	p->background = 0;
+	p->buf = (char*)malloc(len+1);
+	out = p->buf;
+	st = pipeline_add_stage(p,len/2+1);
+
+	while(1){
+		while(isspace((unsigned char)*s)) s++;
+		if(*s == '\0') break;
+
+		if(*s == '|'){
+			if(s[1]=='|' || s[1]=='&' || st->argc==0 || pending) return 1;
+			st = pipeline_add_stage(p,len/2+1);
+			s++;
+			continue;
+		}
+		if(*s == '&'){
+			s++;
+			while(isspace((unsigned char)*s)) s++;
+			if(*s != '\0' || st->argc==0 || pending) return 1;
+			p->background = 1;
+			break;
+		}
+		if(*s == '<' || *s == '>'){
+			if(pending) return 1;
+			if(*s == '<'){
+				pending = &st->in_file;
+				s++;
+			}
+			else{
+				pending = &st->out_file;
+				st->append = (s[1]=='>');
+				s += st->append ? 2 : 1;
+			}
+			if(*s=='&' || *s=='|' || *s=='<' || *s=='>' || *s=='(') return 1;
+			continue;
+		}
+
+		// a word
+		char* word = out;
+		int quoted = 0;
+		if(*s=='#' || *s=='~') return 1;
+		while(*s && !isspace((unsigned char)*s) && strchr("|&<>",*s)==NULL){
+			if(*s == '\''){
+				s++;
+				while(*s && *s!='\'') *out++ = *s++;
+				if(*s == '\0') return 1;
+				s++;
+				quoted = 1;
+			}
+			else if(*s == '"'){
+				s++;
+				while(*s && *s!='"'){
+					if(*s=='$' || *s=='`') return 1;
+					if(*s=='\\' && s[1]!='\0' && strchr("\"\\$`",s[1])!=NULL) s++;
+					*out++ = *s++;
+				}
+				if(*s == '\0') return 1;
+				s++;
+				quoted = 1;
+			}
+			else if(*s == '\\'){
+				if(s[1] == '\0') return 1;
+				*out++ = s[1];
+				s += 2;
+				quoted = 1;
+			}
+			else if(strchr(_SH_SPECIAL_,*s) != NULL){
+				return 1;
+			}
+			else{
+				*out++ = *s++;
+			}
+		}
+		*out++ = '\0';
+
+		// "2>file" style fd redirections are left to the real shell
+		if(!quoted && (*s=='<' || *s=='>') && strspn(word,"0123456789")==strlen(word))
+			return 1;
+
+		if(pending){
+			*pending = word;
+			pending = NULL;
+		}
+		else{
+			if(st->argc==0 && !quoted && (strchr(word,'=')!=NULL || is_shell_word(word)))
+				return 1;
+			st->argv[st->argc++] = word;
+			st->argv[st->argc] = NULL;
+		}
+	}
+
+	if(pending) return 1;
+	if(st->argc == 0 && (p->nstages > 1 || st->in_file || st->out_file)) return 1;
+	if(st->argc == 0) p->nstages = 0;
+	return 0;
+}
+
+/**
+ * Turns a line that needs shell features into a one-stage "/bin/sh -c" pipeline.
+ */
+static void fallback_to_sh(const char* line, pipeline_t* p)
+{
+	stage_t* st;
+	pipeline_free(p);
+	p->background = 0;
+	p->buf = strdup(line);
+	st = pipeline_add_stage(p,3);
+	st->argv[0] = "/bin/sh";
+	st->argv[1] = "-c";
+	st->argv[2] = p->buf;
+	st->argv[3] = NULL;
+	st->argc = 3;
+}
+
+/**
+ * Starts one pipeline stage.
+ *
+ * @returns
+ *    The pid of the child, or -1 if it could not be started (an error
+ *    message has already been printed).
+ */
+static pid_t spawn_stage(stage_t* st, int in_fd, int out_fd, int* pipes, int npipe_fds)
+{
+	posix_spawn_file_actions_t fa;
+	pid_t child = -1;
+	int i, err, cached;
+	const char* path;
+
+	posix_spawn_file_actions_init(&fa);
+	if(in_fd != -1) posix_spawn_file_actions_adddup2(&fa,in_fd,STDIN_FILENO);
+	if(out_fd != -1) posix_spawn_file_actions_adddup2(&fa,out_fd,STDOUT_FILENO);
+	for(i=0;i<npipe_fds;i++) posix_spawn_file_actions_addclose(&fa,pipes[i]);
+	if(st->in_file)
+		posix_spawn_file_actions_addopen(&fa,STDIN_FILENO,st->in_file,O_RDONLY,0);
+	if(st->out_file)
+		posix_spawn_file_actions_addopen(&fa,STDOUT_FILENO,st->out_file,
+			O_WRONLY|O_CREAT|(st->append ? O_APPEND : O_TRUNC),0666);
+
+	path = resolve_path(st->argv[0],&cached);
+	if(path == NULL){
+		fprintf(stderr,"%s: command not found\n",st->argv[0]);
+	}
+	else{
+		// posix_spawn uses vfork semantics, so only one process is created
+		err = posix_spawn(&child,path,&fa,NULL,st->argv,environ);
+		if(err == ENOENT && cached){
+			// the binary moved since it was cached
+			path_cache_drop(st->argv[0]);
+			path = resolve_path(st->argv[0],&cached);
+			err = (path==NULL) ? ENOENT : posix_spawn(&child,path,&fa,NULL,st->argv,environ);
+		}
+		if(err != 0){
+			fprintf(stderr,"%s: %s\n",st->argv[0],strerror(err));
+			child = -1;
+		}
+	}
+
+	posix_spawn_file_actions_destroy(&fa);
+	return child;
+}
+
+/**
+ * Waits for a child, retrying if interrupted by a signal, and adds the
+ * resources it used to usage.
+ *
+ * CPU times are summed over the pipeline; maxrss is the largest peak of any
+ * single process, as the stages do not share an address space.
+ */
+static int wait_child(pid_t child, int* status, struct rusage* usage)
+{
+	struct rusage ru;
+	while(wait4(child,status,0,&ru) == -1){
+		if(errno != EINTR) return -1;
+	}
+	if(usage != NULL){
+		timeradd(&usage->ru_utime,&ru.ru_utime,&usage->ru_utime);
+		timeradd(&usage->ru_stime,&ru.ru_stime,&usage->ru_stime);
+		if(ru.ru_maxrss > usage->ru_maxrss) usage->ru_maxrss = ru.ru_maxrss;
+	}
+	return 0;
+}
+
+static int exit_code(int status)
+{
+	if(WIFEXITED(status)) return WEXITSTATUS(status);
+	if(WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+	return 0;
+}
+
+static int add_job(pid_t* pids, int npids, int nrunning, const char* line)
+{
+	int i;
+	for(i=0;i<_EXEC_MAX_JOBS_;i++){
+		if(jobs[i].id == 0){
+			jobs[i].id = i+1;
+			jobs[i].pids = pids;
+			jobs[i].npids = npids;
+			jobs[i].nrunning = nrunning;
+			jobs[i].cmd = strdup(line);
+			return jobs[i].id;
+		}
+	}
+	return -1;
+}
+
+/**
+ * Resets the executor state.  Must be called before exec_command().
+ */
+void exec_init()
+{
+	memset(jobs,0,sizeof(jobs));
+	memset(path_cache,0,sizeof(path_cache));
+	path_cache_used = 0;
+	path_cache_env = NULL;
+}
+
+/**
+ * Frees all memory held by the executor.
+ *
+ * Background jobs that are still running are not waited for; they keep
+ * running after the shell exits, like they would under /bin/sh.
+ */
+void exec_destroy()
+{
+	int i;
+	for(i=0;i<_EXEC_MAX_JOBS_;i++){
+		if(jobs[i].id != 0){
+			free(jobs[i].pids);
+			free(jobs[i].cmd);
+			jobs[i].id = 0;
+		}
+	}
+	exec_path_cache_flush();
+}
+
+/**
+ * Runs a non built-in command line.
+ *
+ * Simple commands, pipelines ('|'), redirections ('<', '>', '>>') and
+ * background jobs (trailing '&') are executed directly with posix_spawn(),
+ * without an intermediate /bin/sh.  Lines that use other shell syntax are
+ * run through "/bin/sh -c", which still costs a single process creation.
+ *
+ * @param line
+ *    The command line, without the trailing newline.
+ * @param usage
+ *    If not NULL, filled with the CPU time and peak memory of the processes
+ *    that were waited for (all zero for a background job).
+ *
+ * @returns
+ *    The exit status of the last command of the pipeline (0 for a job that
+ *    was sent to the background), or -1 if the pipeline could not be set up
+ *    (errno is set).
+ */
+int exec_command(const char* line, struct rusage* usage)
+{
+	pipeline_t p;
+	pid_t* pids;
+	int* pipes;
+	int i, status = 0, last = 0, nrunning = 0, job_id;
+
+	if(usage != NULL) memset(usage,0,sizeof(struct rusage));
+	if(parse_line(line,&p) != 0)
+		fallback_to_sh(line,&p);
+	if(p.nstages == 0){
+		pipeline_free(&p);
+		return 0;
+	}
+
+	pipes = (int*)malloc(sizeof(int)*2*p.nstages);
+	for(i=0;i<p.nstages-1;i++){
+		if(pipe(pipes+2*i) == -1){
+			int saved = errno;
+			while(--i >= 0){
+				close(pipes[2*i]);
+				close(pipes[2*i+1]);
+			}
+			free(pipes);
+			pipeline_free(&p);
+			errno = saved;
+			return -1;
+		}
+	}
+
+	// make sure the prompt is out before the children start writing
+	fflush(stdout);
+
+	pids = (pid_t*)malloc(sizeof(pid_t)*p.nstages);
+	for(i=0;i<p.nstages;i++){
+		pids[i] = spawn_stage(&p.stages[i],
+			(i>0) ? pipes[2*(i-1)] : -1,
+			(i<p.nstages-1) ? pipes[2*i+1] : -1,
+			pipes,2*(p.nstages-1));
+		if(pids[i] != -1) nrunning++;
+	}
+	for(i=0;i<2*(p.nstages-1);i++) close(pipes[i]);
+	free(pipes);
+
+	if(p.background && nrunning > 0){
+		job_id = add_job(pids,p.nstages,nrunning,line);
+		if(job_id != -1){
+			printf("[%d] %d\n",job_id,(int)pids[p.nstages-1]);
+			pipeline_free(&p);
+			return 0;
+		}
+		fprintf(stderr,"Too many background jobs, running in the foreground.\n");
+	}
+
+	for(i=0;i<p.nstages;i++){
+		if(pids[i] == -1){
+			last = 127;
+			continue;
+		}
+		if(wait_child(pids[i],&status,usage) == -1){
+			last = 127;
+			continue;
+		}
+		last = exit_code(status);
+	}
+
+	free(pids);
+	pipeline_free(&p);
+	return last;
+}
+
+/**
+ * Collects background jobs that have finished and reports them.
+ *
+ * Never blocks.  Called before every prompt.
+ */
+void exec_reap_jobs()
+{
+	int i, k, status;
+	for(i=0;i<_EXEC_MAX_JOBS_;i++){
+		if(jobs[i].id == 0) continue;
+		for(k=0;k<jobs[i].npids;k++){
+			if(jobs[i].pids[k] > 0 && waitpid(jobs[i].pids[k],&status,WNOHANG) > 0){
+				jobs[i].pids[k] = 0;
+				jobs[i].nrunning--;
+			}
+		}
+		if(jobs[i].nrunning == 0){
+			printf("[%d]  Done\t%s\n",jobs[i].id,jobs[i].cmd);
+			free(jobs[i].pids);
+			free(jobs[i].cmd);
+			jobs[i].id = 0;
+		}
+	}
+}
+
+/**
+ * Prints the background jobs that are still running.
+ */
+void exec_print_jobs()
+{
+	int i;
+	exec_reap_jobs();
+	for(i=0;i<_EXEC_MAX_JOBS_;i++){
+		if(jobs[i].id != 0)
+			printf("[%d]  Running\t%s\n",jobs[i].id,jobs[i].cmd);
+	}
+}
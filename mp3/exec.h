@@ -0,0 +1,31 @@
+/** @file exec.h */
+
+#ifndef __EXEC_H_
+#define __EXEC_H_
+
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+#define _EXEC_MAX_JOBS_ 64
+#define _EXEC_PATH_CACHE_SIZE_ 256
+
+/** A background job started with a trailing '&'. */
+typedef struct _exec_job_t
+{
+	int id;          ///< Job number shown to the user, 0 if the slot is free
+	pid_t* pids;     ///< One process per pipeline stage
+	int npids;       ///< Number of entries in pids
+	int nrunning;    ///< Number of stages that have not been reaped yet
+	char* cmd;       ///< Copy of the command line, for reporting
+} exec_job_t;
+
+void exec_init();
+void exec_destroy();
+
+int  exec_command(const char* line, struct rusage* usage);
+void exec_reap_jobs();
+void exec_print_jobs();
+void exec_path_cache_flush();
+
+#endif
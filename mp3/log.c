@@ -1,4 +1,5 @@
 /** @file log.c */
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "log.h"
@@ -16,9 +17,14 @@
  */
 void log_init(log_t* l)
 {
-	l->log_ptr = (char**)malloc(sizeof(char*)*_LOG_SIZE_ALLOC_);
+	l->log_ptr = (log_entry_t*)malloc(sizeof(log_entry_t)*_LOG_SIZE_ALLOC_);
+	l->stat_ptr = (log_stat_t*)malloc(sizeof(log_stat_t)*_LOG_SIZE_ALLOC_);
 	l->size = _LOG_SIZE_ALLOC_;
 	l->log_length = 0;
+	l->chunks = NULL;
+	l->nchunks = 0;
+	l->chunks_size = 0;
+	l->spare.data = NULL;
 }
 
 /**
@@ -34,9 +40,37 @@ void log_init(log_t* l)
  */
 void log_destroy(log_t* l)
 {
-	// free all pointers to the log file or not?
+	size_t i;
+	// strings added with log_append() belong to the caller
+	for(i=0;i<l->nchunks;i++)
+		free(l->chunks[i].data);
+	free(l->chunks);
+	free(l->spare.data);
 	free(l->log_ptr);
-	// free l itself or not?
+	free(l->stat_ptr);
+}
+
+/**
+ * Makes room for one more entry.
+ */
+static void log_reserve(log_t* l)
+{
+	log_entry_t* new_log_ptr=NULL;
+	log_stat_t* new_stat_ptr=NULL;
+	if(l->log_length + 10 > l->size)
+	{
+		new_log_ptr = (log_entry_t*)realloc( l->log_ptr,sizeof(log_entry_t)*(l->size+_LOG_SIZE_ALLOC_) );
+		if(new_log_ptr!=NULL) l->log_ptr = new_log_ptr;
+		new_stat_ptr = (log_stat_t*)realloc( l->stat_ptr,sizeof(log_stat_t)*(l->size+_LOG_SIZE_ALLOC_) );
+		if(new_stat_ptr!=NULL) l->stat_ptr = new_stat_ptr;
+		if(new_log_ptr!=NULL && new_stat_ptr!=NULL){
+			l->size += _LOG_SIZE_ALLOC_;
+		}
+		else{
+			puts ("Error (re)allocating memory in log_append()\n");
+       		exit (1);
+		}
+	}
 }
 
 /**
@@ -54,25 +88,101 @@ void log_destroy(log_t* l)
  */
 void log_append(log_t* l, char *item)
 {
-	char** new_log_ptr=NULL;
-	if(l->log_length + 10 > l->size)
-	{
-		new_log_ptr = (char**)realloc( l->log_ptr,sizeof(char*)*(l->size+_LOG_SIZE_ALLOC_) );
-		if(new_log_ptr!=NULL){
-			l->log_ptr = new_log_ptr;
-			l->size += _LOG_SIZE_ALLOC_;
+	log_reserve(l);
+
+	// the caller may still change the string, so its length is not cached
+	l->log_ptr[l->log_length].str = item;
+	l->log_ptr[l->log_length].len = 0;
+	l->log_ptr[l->log_length].owned = 0;
+	memset(&l->stat_ptr[l->log_length],0,sizeof(log_stat_t));
+	l->log_length ++;
+}
+
+/**
+ * Appends a copy of a string to the end of the log.
+ *
+ * Unlike log_append(), the string is copied into storage owned by the log.
+ * Copies are packed back to back into large chunks, so a long history costs
+ * one allocation per chunk instead of one per entry and is laid out in the
+ * order log_print() and log_search() walk it.
+ *
+ * @param l
+ *    Pointer to the log data structure.
+ * @param item
+ *    String to be copied into the log.
+ *
+ * @returns
+ *    The copy stored in the log.  It must not be freed; it stays valid until
+ *    it is removed with log_pop() or the log is destroyed.
+ */
+char *log_append_copy(log_t* l, const char *item)
+{
+	size_t len = strlen(item);
+	log_chunk_t* chunk = (l->nchunks > 0) ? &l->chunks[l->nchunks-1] : NULL;
+	char* p;
+
+	log_reserve(l);
+
+	if(chunk == NULL || chunk->used + len + 1 > chunk->cap){
+		if(l->nchunks == l->chunks_size){
+			l->chunks_size = (l->chunks_size == 0) ? 16 : l->chunks_size*2;
+			l->chunks = (log_chunk_t*)realloc(l->chunks,sizeof(log_chunk_t)*l->chunks_size);
+			if(l->chunks == NULL){
+				puts ("Error (re)allocating memory in log_append_copy()\n");
+				exit (1);
+			}
+		}
+		chunk = &l->chunks[l->nchunks++];
+		if(l->spare.data != NULL && l->spare.cap >= len + 1){
+			*chunk = l->spare;
+			l->spare.data = NULL;
 		}
 		else{
-			free(l->log_ptr);
-			puts ("Error (re)allocating memory in log_append()\n");
-       		exit (1);
+			chunk->cap = (len + 1 > _LOG_CHUNK_SIZE_) ? len + 1 : _LOG_CHUNK_SIZE_;
+			chunk->data = (char*)malloc(chunk->cap);
+			if(chunk->data == NULL){
+				puts ("Error allocating memory in log_append_copy()\n");
+				exit (1);
+			}
 		}
+		chunk->used = 0;
 	}
 
-	l->log_ptr[l->log_length] = item;
+	p = chunk->data + chunk->used;
+	memcpy(p,item,len+1);
+	chunk->used += len + 1;
+
+	l->log_ptr[l->log_length].str = p;
+	l->log_ptr[l->log_length].len = len;
+	l->log_ptr[l->log_length].owned = 1;
+	memset(&l->stat_ptr[l->log_length],0,sizeof(log_stat_t));
 	l->log_length ++;
+	return p;
 }
 
+/**
+ * Gives back the chunk space of an entry added with log_append_copy().
+ *
+ * Entries are popped in LIFO order, so the string is always the last one of
+ * the newest chunk.  A chunk that becomes empty is kept as the spare, which
+ * keeps the string just popped readable until the next append or pop; the
+ * pop that empties another chunk frees the spare it replaces.
+ */
+static void log_release(log_t* l, const log_entry_t* e)
+{
+	log_chunk_t* chunk;
+	if(!e->owned || l->nchunks == 0) return;
+
+	chunk = &l->chunks[l->nchunks-1];
+	if(e->str + e->len + 1 != chunk->data + chunk->used) return;
+
+	chunk->used -= e->len + 1;
+	if(chunk->used == 0){
+		free(l->spare.data);
+		l->spare = *chunk;
+		l->nchunks--;
+	}
+}
 /**
  * Removes and returns the last item in the log.
  *
@@ -88,25 +198,29 @@ void log_append(log_t* l, char *item)
  *    Pointer to the log data structure.
  *
  * @returns
- *    The last item in the log, or NULL if the log is empty.
+ *    The last item in the log, or NULL if the log is empty.  If the item was
+ *    added with log_append_copy(), it lives in the log's storage: it must not
+ *    be freed and is only valid until the next call that changes the log.
  *
  */
 char *log_pop(log_t* l)
 {
     // shorten the space if necessary
-    char** new_log_ptr=NULL;
+    log_entry_t* new_log_ptr=NULL;
+    log_stat_t* new_stat_ptr=NULL;
     size_t new_size=0;
     if(l->size > 3*_LOG_SIZE_ALLOC_ && l->log_length*3 < l->size)
     {
     	new_size = l->size/2;
-    	new_log_ptr = (char**)realloc(l->log_ptr,sizeof(char*)*new_size);
-    	if(new_log_ptr!= NULL){
-    		l->log_ptr = new_log_ptr;
+    	new_log_ptr = (log_entry_t*)realloc(l->log_ptr,sizeof(log_entry_t)*new_size);
+    	if(new_log_ptr!= NULL) l->log_ptr = new_log_ptr;
+    	new_stat_ptr = (log_stat_t*)realloc(l->stat_ptr,sizeof(log_stat_t)*new_size);
+    	if(new_stat_ptr!= NULL) l->stat_ptr = new_stat_ptr;
+    	if(new_log_ptr!= NULL && new_stat_ptr!= NULL){
     		l->size = new_size;
     	}
     	else
     	{
-    		free(l->log_ptr);
 			puts ("Error (re)allocating memory in log_pop()\n");
        		exit (1);
     	}
@@ -115,7 +229,8 @@ char *log_pop(log_t* l)
     if(l->log_length==0) return NULL;
     else if(l->log_length>0){
     	l->log_length --;
-    	return l->log_ptr[l->log_length];
+    	log_release(l,&l->log_ptr[l->log_length]);
+    	return l->log_ptr[l->log_length].str;
     }
     else{
     	free(l->log_ptr);
@@ -145,7 +260,7 @@ char *log_at(log_t* l, unsigned int idx)
 {
     if(idx >= l->log_length) return NULL;
 
-    return l->log_ptr[idx];
+    return l->log_ptr[idx].str;
 }
 
 /**
@@ -204,10 +319,17 @@ unsigned int log_size(log_t* l)
  */
 char *log_search(log_t* l, const char *prefix)
 {
-    int i;
-    for(i=l->log_length-1;i>=0;--i){
-    	if(strncmp(prefix,l->log_ptr[i],strlen(prefix))==0)
-    		return l->log_ptr[i];
+    size_t i, plen = strlen(prefix);
+    const log_entry_t* e;
+    for(i=l->log_length;i>0;--i){
+    	e = &l->log_ptr[i-1];
+    	if(e->owned){
+    		// known length: short entries are skipped without touching them
+    		if(e->len >= plen && memcmp(prefix,e->str,plen)==0)
+    			return e->str;
+    	}
+    	else if(strncmp(prefix,e->str,plen)==0)
+    		return e->str;
     }
     return NULL;
 }
@@ -215,14 +337,141 @@ char *log_search(log_t* l, const char *prefix)
 
 void log_print(log_t *l)
 {
-    int i;
+    size_t i;
+    const log_entry_t* e;
     if(log_size(l)==0){
         printf("\n");
     }
     else{
-        for (i = 0; i < log_size(l); ++i)
+        for (i = 0; i < l->log_length; ++i)
         {
-            printf("%s\n",log_at(l,i));
+            e = &l->log_ptr[i];
+            if(e->owned) fwrite(e->str,1,e->len,stdout);
+            else fputs(e->str,stdout);
+            putchar('\n');
         }
     }
 }
+
+
+/**
+ * Records the resources used by the idx-th command in the log.
+ *
+ * @param l
+ *    Pointer to the log data structure.
+ * @param idx
+ *    Zero-based index of the entry, as for log_at().
+ * @param stat
+ *    The measurements.  They are copied into the log.
+ */
+void log_set_stat(log_t* l, unsigned int idx, const log_stat_t* stat)
+{
+    if(idx >= l->log_length) return;
+
+    l->stat_ptr[idx] = *stat;
+    l->stat_ptr[idx].valid = 1;
+}
+
+/**
+ * Returns the resources recorded for the idx-th command in the log.
+ *
+ * @returns
+ *    Pointer to the measurements (stat->valid is 0 if none were recorded),
+ *    or NULL if such an entry does not exist.
+ */
+log_stat_t *log_stat_at(log_t* l, unsigned int idx)
+{
+    if(idx >= l->log_length) return NULL;
+
+    return &l->stat_ptr[idx];
+}
+
+static void print_stat_line(log_t* l, const log_stat_t* st)
+{
+    printf("%9.3fs %9.3fs %9.3fs %10ldKB  %s\n",
+        st->wall, st->user, st->sys, st->maxrss, l->log_ptr[st - l->stat_ptr].str);
+}
+
+static void print_stat_header()
+{
+    printf("%10s %10s %10s %12s  %s\n", "wall", "user", "sys", "maxrss", "command");
+}
+
+/**
+ * Prints totals over every measured command in the log, followed by the
+ * slowest and the most memory-hungry one.
+ */
+void log_print_stats(log_t* l)
+{
+    size_t i, n = 0;
+    double wall = 0.0, user = 0.0, sys = 0.0;
+    const log_stat_t *slowest = NULL, *biggest = NULL;
+
+    for(i = 0; i < l->log_length; ++i){
+        const log_stat_t* st = &l->stat_ptr[i];
+        if(!st->valid) continue;
+        n++;
+        wall += st->wall;
+        user += st->user;
+        sys += st->sys;
+        if(slowest == NULL || st->wall > slowest->wall) slowest = st;
+        if(biggest == NULL || st->maxrss > biggest->maxrss) biggest = st;
+    }
+
+    printf("%lu command(s) measured\n", (unsigned long)n);
+    if(n == 0) return;
+    printf("total: %.3fs wall, %.3fs user, %.3fs sys (%.3fs wall per command)\n",
+        wall, user, sys, wall/n);
+    print_stat_header();
+    print_stat_line(l, slowest);
+    if(biggest != slowest)
+        print_stat_line(l, biggest);
+}
+
+static int cmp_wall(const void* a, const void* b)
+{
+    double x = (*(log_stat_t* const*)a)->wall, y = (*(log_stat_t* const*)b)->wall;
+    return (x < y) - (x > y);
+}
+
+static int cmp_cpu(const void* a, const void* b)
+{
+    const log_stat_t *x = *(log_stat_t* const*)a, *y = *(log_stat_t* const*)b;
+    double cx = x->user + x->sys, cy = y->user + y->sys;
+    return (cx < cy) - (cx > cy);
+}
+
+static int cmp_rss(const void* a, const void* b)
+{
+    long x = (*(log_stat_t* const*)a)->maxrss, y = (*(log_stat_t* const*)b)->maxrss;
+    return (x < y) - (x > y);
+}
+
+/**
+ * Prints the n measured commands of the log that rank highest by key.
+ *
+ * @param l
+ *    Pointer to the log data structure.
+ * @param n
+ *    Number of commands to print.
+ * @param key
+ *    LOG_BY_WALL for the slowest, LOG_BY_CPU for the most CPU time (user +
+ *    sys) and LOG_BY_RSS for the most memory-hungry commands.
+ */
+void log_print_top(log_t* l, unsigned int n, log_key_t key)
+{
+    size_t i, count = 0;
+    log_stat_t** sorted = (log_stat_t**)malloc(sizeof(log_stat_t*)*(l->log_length+1));
+
+    for(i = 0; i < l->log_length; ++i)
+        if(l->stat_ptr[i].valid) sorted[count++] = &l->stat_ptr[i];
+
+    qsort(sorted, count, sizeof(log_stat_t*),
+        (key == LOG_BY_RSS) ? cmp_rss : (key == LOG_BY_CPU) ? cmp_cpu : cmp_wall);
+
+    if(count > 0) print_stat_header();
+    for(i = 0; i < count && i < n; ++i)
+        print_stat_line(l, sorted[i]);
+
+    free(sorted);
+}
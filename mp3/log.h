@@ -4,19 +4,55 @@
 #define __LOG_H_
 
 #define _LOG_SIZE_ALLOC_ 1024
+#define _LOG_CHUNK_SIZE_ (64*1024)
+
+/** Resources used by one logged command. */
+typedef struct _log_stat_t
+{
+	int valid;      ///< 0 if nothing was measured (e.g. built-ins)
+	double wall;    ///< Wall clock time, in seconds
+	double user;    ///< User CPU time, in seconds
+	double sys;     ///< System CPU time, in seconds
+	long maxrss;    ///< Peak resident set size, in kilobytes
+} log_stat_t;
+
+/** Sort keys for log_print_top(). */
+typedef enum { LOG_BY_WALL = 0, LOG_BY_CPU, LOG_BY_RSS } log_key_t;
+
+/** One entry of the log. */
+typedef struct _log_entry_t
+{
+	char* str;
+	unsigned int len;   ///< strlen(str), only meaningful if owned
+	unsigned int owned; ///< 1 if str lives in the log's chunks
+} log_entry_t;
+
+/** A block of packed, NUL-terminated strings. */
+typedef struct _log_chunk_t
+{
+	char* data;
+	size_t used;
+	size_t cap;
+} log_chunk_t;
 
 /** The log data structure. */
 typedef struct _log_t
 {
-	char** log_ptr;
+	log_entry_t* log_ptr;   ///< Entries, oldest first
+	log_stat_t* stat_ptr;   ///< Measurements, parallel to log_ptr
 	size_t size;
 	size_t log_length;
+	log_chunk_t* chunks;    ///< Storage for log_append_copy(), filled in order
+	size_t nchunks;
+	size_t chunks_size;
+	log_chunk_t spare;      ///< Last chunk emptied by log_pop(), kept for reuse
 } log_t;
 
 void log_init(log_t* l);
 void log_destroy(log_t* l);
 
 void log_append(log_t* l, char *item);
+char *log_append_copy(log_t* l, const char *item);
 char *log_pop(log_t* l);
 char *log_at(log_t* l, unsigned int idx);
 unsigned int log_size(log_t* l);
@@ -24,4 +60,9 @@ char *log_search(log_t* l, const char *prefix);
 
 void log_print(log_t* l);
 
+void log_set_stat(log_t* l, unsigned int idx, const log_stat_t* stat);
+log_stat_t *log_stat_at(log_t* l, unsigned int idx);
+void log_print_stats(log_t* l);
+void log_print_top(log_t* l, unsigned int n, log_key_t key);
+
 #endif
@@ -4,7 +4,10 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
 #include "log.h"
+#include "exec.h"
+#include "batch.h"
 
 /**
  * Starting point for shell.
@@ -23,34 +26,97 @@ ssize_t readSize;
 log_t log_ob;
 
 void insert_into_log(const char* buf){
-	char* p = (char*)malloc( sizeof(char) * (strlen(buf)+5) );
-	strcpy(p,buf);
-	log_append(&log_ob,p);
+	log_append_copy(&log_ob,buf);
+}
+
+double now_seconds(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return ts.tv_sec + ts.tv_nsec/1e9;
 }
 
 bool non_built_in_command_process(char* query_ptr)
 {
+ 	struct rusage ru;
+ 	log_stat_t stat;
+ 	double start = now_seconds();
  	insert_into_log(query_ptr);
- 	int ret = system(query_ptr);
- 	int status;
- 	wait(&status);
+ 	int ret = exec_command(query_ptr,&ru);
  	if(ret==-1) return false;
- 	else return true;
+
+ 	stat.wall = now_seconds() - start;
+ 	stat.user = ru.ru_utime.tv_sec + ru.ru_utime.tv_usec/1e6;
+ 	stat.sys = ru.ru_stime.tv_sec + ru.ru_stime.tv_usec/1e6;
+ 	stat.maxrss = ru.ru_maxrss;
+ 	log_set_stat(&log_ob,log_size(&log_ob)-1,&stat);
+ 	return true;
+}
+
+// !top N [wall|cpu|rss]
+void top_command_process(const char* args)
+{
+	char key[8] = "wall";
+	int n = 10;
+	sscanf(args,"%d %7s",&n,key);
+	if(n <= 0) n = 10;
+	if(strcmp(key,"rss")==0 || strcmp(key,"mem")==0)
+		log_print_top(&log_ob,n,LOG_BY_RSS);
+	else if(strcmp(key,"cpu")==0)
+		log_print_top(&log_ob,n,LOG_BY_CPU);
+	else
+		log_print_top(&log_ob,n,LOG_BY_WALL);
+}
+
+void print_prompt(){
+	exec_reap_jobs();
+	printf("(pid=%d)%s$ ", pid, cwd);
 }
 
 void final_free_memory(){
 	if(lineBuf!=NULL)
     	free(lineBuf);
-    char* p;
-    while( (p=log_pop(&log_ob))!=NULL )
-    	free(p);
+	// history strings are owned by the log
 	log_destroy(&log_ob);
+	exec_destroy();
 }
 
 
 
-int main()
+void print_usage(const char* name){
+	fprintf(stderr,"Usage: %s [-f script [-j workers]]\n",name);
+}
+
+int main(int argc, char** argv)
 {
+    int opt, workers = 1, ret;
+    char* script = NULL;
+    while((opt = getopt(argc,argv,"f:j:")) != -1){
+    	switch(opt){
+    	case 'f':
+    		script = optarg;
+    		break;
+    	case 'j':
+    		workers = atoi(optarg);
+    		if(workers <= 0){
+    			print_usage(argv[0]);
+    			return 1;
+    		}
+    		break;
+    	default:
+    		print_usage(argv[0]);
+    		return 1;
+    	}
+    }
+
+    exec_init();
+    // batch mode: run the script and leave
+    if(script != NULL){
+    	ret = batch_run(script,workers);
+    	if(ret == -1) printf("%s: %s\n",script,strerror(errno));
+    	exec_destroy();
+    	return (ret == 0) ? 0 : 1;
+    }
+
     log_init(&log_ob);
     pid = getpid();
     char buf[_BUF_SIZE_];
@@ -58,7 +124,7 @@ int main()
   	char* query_ptr=NULL;
     cwd = getcwd(buf,_BUF_SIZE_);
 
-    printf("(pid=%d)%s$ ", pid, cwd);
+    print_prompt();
 
     lineBuf = NULL;
     lineSize = 0;
@@ -93,8 +159,9 @@ int main()
     		}
     		else{
     			cwd = getcwd(buf,_BUF_SIZE_);
+    			exec_path_cache_flush();
     		}
-    		printf("(pid=%d)%s$ ", pid, cwd);
+    		print_prompt();
     		continue;
     	}
 
@@ -103,7 +170,19 @@ int main()
     		if(strcmp(query_ptr,"!#") == 0){
     			log_print(&log_ob);
     		}
-    		printf("(pid=%d)%s$ ", pid, cwd);
+    		print_prompt();
+    		continue;
+    	}
+
+    	// !stats and !top N are not stored in the history either
+    	if(strcmp(query_ptr,"!stats") == 0){
+    		log_print_stats(&log_ob);
+    		print_prompt();
+    		continue;
+    	}
+    	if(strcmp(query_ptr,"!top") == 0 || strncmp(query_ptr,"!top ",5) == 0){
+    		top_command_process(query_ptr+4);
+    		print_prompt();
     		continue;
     	}
 
@@ -116,16 +195,24 @@ int main()
     			}
     			else{ // not found result
     				printf("No Match\n");
-    				printf("(pid=%d)%s$ ", pid, cwd);
+    				print_prompt();
     				continue;
     			}
     		}
     		else{
-    			printf("(pid=%d)%s$ ", pid, cwd);
+    			print_prompt();
     			continue;
     		}
     	}
 
+    	// jobs
+    	if(strcmp(query_ptr,"jobs") == 0){
+    		insert_into_log(query_ptr);
+    		exec_print_jobs();
+    		print_prompt();
+    		continue;
+    	}
+
     	// terminate
     	if(strcmp(query_ptr,"exit") == 0){
     		insert_into_log(query_ptr);
@@ -133,7 +220,7 @@ int main()
     	}
 
     	if(non_built_in_command_process(query_ptr)){
-    		printf("(pid=%d)%s$ ", pid, cwd);
+    		print_prompt();
     		continue;
     	}
     	else{
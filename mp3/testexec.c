@@ -0,0 +1,32 @@
+/** @file testexec.c */
+#include <stdio.h>
+#include <stdlib.h>
+#include "exec.h"
+
+/** Shell builtins with no executable of their own, and their exit status. */
+static const struct { const char* line; int status; } builtins[] = {
+	{ "umask 022", 0 },
+	{ "type ls > /dev/null", 0 },
+	{ "command -v ls > /dev/null", 0 },
+	{ "exec true", 0 },
+	{ "exec false", 1 },
+	{ "read x < /dev/null", 1 },
+	{ ". /dev/null", 0 },
+	{ "trap '' USR1", 0 },
+	{ "wait", 0 },
+	{ NULL, 0 }
+};
+
+int main()
+{
+	int i, status, failed = 0;
+
+	exec_init();
+	for(i=0;builtins[i].line!=NULL;i++){
+		status = exec_command(builtins[i].line,NULL);
+		printf("%s: %d (expected %d)\n",builtins[i].line,status,builtins[i].status);
+		if(status != builtins[i].status) failed = 1;
+	}
+	exec_destroy();
+	return failed;
+}
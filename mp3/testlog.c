@@ -11,6 +11,23 @@ int main()
     log_init(&l);
 
     int i;
+    log_t c;
+    char buf[32];
+    log_init(&c);
+    for(i=0;i<100000;++i){
+        sprintf(buf,"cmd %d",i);
+        log_append_copy(&c,buf);
+    }
+    printf("copy size: %u (expected 100000)\n",log_size(&c));
+    printf("copy search: %s (expected cmd 99999)\n",log_search(&c,"cmd 9"));
+    printf("copy at: %s (expected cmd 12345)\n",log_at(&c,12345));
+    for(i=0;i<50000;++i)
+        log_pop(&c);
+    printf("copy pop: %s (expected cmd 49999)\n",log_pop(&c));
+    log_append_copy(&c,"reused");
+    printf("copy search: %s (expected reused)\n",log_search(&c,"re"));
+    log_destroy(&c);
+
     log_append(&l,"Iddd am a genius");
     log_append(&l,"2");
     log_append(&l, "ab  1");
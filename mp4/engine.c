@@ -0,0 +1,101 @@
+/** @file engine.c */
+
+#include <stdlib.h>
+
+#include "engine.h"
+
+
+/* Starts every core idle at time 0. */
+void engine_init(engine_t *engine, int cores, scheduler_t *scheduler, int rr_quantum)
+{
+	int i;
+
+	engine->scheduler = scheduler;
+	engine->rr_quantum = rr_quantum;
+	engine->cores = cores;
+	engine->cores_busy = 0;
+	engine->core = malloc(cores * sizeof(engine_core_t));
+	engine->due = malloc(cores * sizeof(int));
+	event_heap_init(&engine->events);
+
+	for (i = 0; i < cores; i++)
+	{
+		engine->core[i].id = i;
+		engine->core[i].job_id = -1;
+		engine->core[i].stamp = 0;
+		engine_run(engine, &engine->core[i], -1, 0, 0);
+	}
+}
+
+void engine_destroy(engine_t *engine)
+{
+	event_heap_destroy(&engine->events);
+	free(engine->core);
+	free(engine->due);
+}
+
+
+/* Puts job_id (-1 for none), which has remaining time left to run, on the core at time and reschedules the core's next event. */
+void engine_run(engine_t *engine, engine_core_t *core, int job_id, int remaining, int time)
+{
+	engine->cores_busy += (job_id != -1) - (core->job_id != -1);
+	core->job_id = job_id;
+	core->started = time;
+
+	if (job_id == -1)
+		core->finish_at = core->expire_at = NEVER;
+	else
+	{
+		core->finish_at = time + remaining;
+		int slice = engine->rr_quantum;
+		if (slice <= 0)
+			slice = (engine->scheduler != NULL) ? sched_quantum(engine->scheduler, core->id) : scheduler_quantum(core->id);
+		core->expire_at = (slice > 0) ? time + slice : NEVER;
+	}
+	core->next_event = (core->finish_at < core->expire_at) ? core->finish_at : core->expire_at;
+
+	core->stamp++;
+	if (core->next_event != NEVER)
+	{
+		core_event_t event = { core->next_event, core->id, core->stamp };
+		event_heap_push(&engine->events, event);
+	}
+}
+
+/* Returns how long the core's job has run since it was put on; call when the job leaves the core unfinished. */
+int engine_stop(engine_core_t *core, int time)
+{
+	int ran = time - core->started;
+	core->started = time;
+	return ran;
+}
+
+
+/* The core with the earliest event, or NULL if every core is idle. */
+engine_core_t *engine_next(engine_t *engine)
+{
+	core_event_t *event;
+	while ((event = event_heap_peek(&engine->events)) != NULL && event->stamp != engine->core[event->core].stamp)
+		event_heap_pop(&engine->events);
+	return (event != NULL) ? &engine->core[event->core] : NULL;
+}
+
+/* The time of the earliest core event, or NEVER. */
+int engine_next_time(engine_t *engine)
+{
+	engine_core_t *next = engine_next(engine);
+	return (next != NULL) ? next->next_event : NEVER;
+}
+
+/* Takes every core with an event at or before time off the queue into engine->due, earliest first; returns how many. */
+int engine_due(engine_t *engine, int time)
+{
+	int due_ct = 0;
+	engine_core_t *next;
+	while ((next = engine_next(engine)) != NULL && next->next_event <= time)
+	{
+		event_heap_pop(&engine->events);
+		engine->due[due_ct++] = next->id;
+	}
+	return due_ct;
+}
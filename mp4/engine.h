@@ -0,0 +1,67 @@
+/** @file engine.h
+ *
+ * The cores and core events of a simulation, shared by simulator and
+ * simsweep.  Time jumps from one event to the next, so a core only records
+ * when its job started and when it next needs attention: its job finishes
+ * or its quantum expires.  What a job still has to run is kept by the
+ * caller, which passes it to engine_run() and charges it with what
+ * engine_stop() returns.
+ */
+
+#ifndef ENGINE_H_
+#define ENGINE_H_
+
+#include <limits.h>
+
+#include "libscheduler/libscheduler.h"
+#include "containers.h"
+
+#define NEVER INT_MAX
+
+/* What a core is doing. */
+typedef struct _engine_core_t
+{
+	int id;
+	int job_id;		// -1 if idle
+	int started;		// time job_id was put on the core
+	int finish_at;		// time job_id completes if left alone
+	int expire_at;		// NEVER unless the job has a quantum
+	int next_event;		// the earlier of finish_at and expire_at; NEVER if idle
+	unsigned int stamp;	// bumped by engine_run(), so older entries in events are stale
+} engine_core_t;
+
+/*
+ * An entry in events: core has its next event at time, unless the core has
+ * been rescheduled since.  Rescheduling a core pushes a new entry rather
+ * than moving the old one, which is skipped when it reaches the top.
+ */
+typedef struct _core_event_t
+{
+	int time, core;
+	unsigned int stamp;
+} core_event_t;
+
+#define CORE_EVENT_BEFORE(a, b) ((a)->time < (b)->time || ((a)->time == (b)->time && (a)->core < (b)->core))
+CONTAINER_HEAP(event_heap, core_event_t, CORE_EVENT_BEFORE)
+
+typedef struct _engine_t
+{
+	scheduler_t *scheduler;	// NULL for the one behind the scheduler_*() functions
+	int rr_quantum;		// 0 unless the scheme is RR; other schemes ask the scheduler
+	int cores, cores_busy;
+	engine_core_t *core;
+	event_heap_t events;	// core events, by time then core id
+	int *due;		// filled by engine_due()
+} engine_t;
+
+void engine_init(engine_t *engine, int cores, scheduler_t *scheduler, int rr_quantum);
+void engine_destroy(engine_t *engine);
+
+void engine_run(engine_t *engine, engine_core_t *core, int job_id, int remaining, int time);
+int engine_stop(engine_core_t *core, int time);
+
+engine_core_t *engine_next(engine_t *engine);
+int engine_next_time(engine_t *engine);
+int engine_due(engine_t *engine, int time);
+
+#endif
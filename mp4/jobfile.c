@@ -0,0 +1,196 @@
+/** @file jobfile.c */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "jobfile.h"
+
+#define READER_BUFFER_SIZE 65536
+#define LINE_MAX_LENGTH 1024
+
+/*
+ * Reads a job file through one fixed buffer, one job at a time.
+ */
+struct _jobfile_reader_t
+{
+	FILE *file;
+	char buffer[READER_BUFFER_SIZE];
+	size_t pos, len;
+	int next_id;
+};
+
+
+jobfile_reader_t *jobfile_open(FILE *file)
+{
+	jobfile_reader_t *reader = malloc(sizeof(jobfile_reader_t));
+	reader->file = file;
+	reader->pos = reader->len = 0;
+	reader->next_id = 0;
+	return reader;
+}
+
+/* Frees the reader; the file is left open. */
+void jobfile_close(jobfile_reader_t *reader)
+{
+	free(reader);
+}
+
+/* Copies the next line (without its newline) into line; returns -1 at the end of the file. */
+static int reader_getline(jobfile_reader_t *reader, char *line, int max)
+{
+	int n = 0, got = 0;
+
+	while (1)
+	{
+		if (reader->pos == reader->len)
+		{
+			reader->len = fread(reader->buffer, 1, READER_BUFFER_SIZE, reader->file);
+			reader->pos = 0;
+			if (reader->len == 0)
+				break;
+		}
+
+		got = 1;
+		char *start = reader->buffer + reader->pos;
+		char *newline = memchr(start, '\n', reader->len - reader->pos);
+		size_t chunk = (newline ? newline : reader->buffer + reader->len) - start;
+		size_t copy = (chunk < (size_t)(max - n)) ? chunk : (size_t)(max - n);
+
+		memcpy(line + n, start, copy);
+		n += copy;
+		reader->pos += chunk;
+		if (newline)
+		{
+			reader->pos++;
+			break;
+		}
+	}
+
+	line[n] = '\0';
+	return got ? n : -1;
+}
+
+/* Skips the header line. */
+void jobfile_skip_header(jobfile_reader_t *reader)
+{
+	char line[LINE_MAX_LENGTH + 1];
+	reader_getline(reader, line, LINE_MAX_LENGTH);
+}
+
+/*
+ * Reads the next job.
+ * @return 1 if job was filled in, 0 at the end of the file, -1 on a malformed line
+ */
+int jobfile_next(jobfile_reader_t *reader, jobfile_job_t *job)
+{
+	char line[LINE_MAX_LENGTH + 1];
+	if (reader_getline(reader, line, LINE_MAX_LENGTH) == -1)
+		return 0;
+
+	char *arrival_time = strtok(line, ",");
+	char *run_time = strtok(NULL, ",");
+	char *priority = strtok(NULL, ",");
+
+	if (arrival_time == NULL || run_time == NULL || priority == NULL)
+		return -1;
+
+	job->job_id = reader->next_id++;
+	job->arrival_time = atoi(arrival_time);
+	job->run_time = atoi(run_time);
+	job->priority = atoi(priority);
+	return 1;
+}
+
+
+/* Orders jobs by arrival time, then by id. */
+int jobfile_compare_arrivals(const void *a, const void *b)
+{
+	const jobfile_job_t *x = a, *y = b;
+	if (x->arrival_time != y->arrival_time)
+		return (x->arrival_time < y->arrival_time) ? -1 : 1;
+	return x->job_id - y->job_id;
+}
+
+/* Reads every job, sorted by arrival time; returns the number read, or -1 on a malformed file. */
+int jobfile_read_all(FILE *file, jobfile_job_t **out)
+{
+	int n = 0, capacity = 1024, result;
+	jobfile_job_t *list = malloc(capacity * sizeof(jobfile_job_t));
+	jobfile_reader_t *reader = jobfile_open(file);
+
+	jobfile_skip_header(reader);
+	while ((result = jobfile_next(reader, &list[n])) == 1)
+	{
+		if (++n == capacity)
+		{
+			capacity *= 2;
+			if ((list = realloc(list, capacity * sizeof(jobfile_job_t))) == NULL)
+			{
+				fprintf(stderr, "Out of memory.\n");
+				exit(2);
+			}
+		}
+	}
+	jobfile_close(reader);
+
+	if (result == -1)
+	{
+		free(list);
+		return -1;
+	}
+
+	qsort(list, n, sizeof(jobfile_job_t), jobfile_compare_arrivals);
+	*out = list;
+	return n;
+}
+
+
+/*
+ * Parses a scheme name: fcfs, sjf, psjf, pri, ppri, rr#, mlfq or stride#,
+ * in any case.  quantum is set for rr# and stride#, 0 otherwise.
+ * @return 1 if name is a scheme, 0 if it is not, -1 if it is rr# or
+ * stride# without a positive quantum (scheme is still set)
+ */
+int jobfile_parse_scheme(const char *name, scheme_t *scheme, int *quantum)
+{
+	*quantum = 0;
+	if (strcasecmp(name, "FCFS") == 0) { *scheme = FCFS; }
+	else if (strcasecmp(name, "SJF") == 0) { *scheme = SJF; }
+	else if (strcasecmp(name, "PSJF") == 0) { *scheme = PSJF; }
+	else if (strcasecmp(name, "PRI") == 0) { *scheme = PRI; }
+	else if (strcasecmp(name, "PPRI") == 0) { *scheme = PPRI; }
+	else if (strcasecmp(name, "MLFQ") == 0) { *scheme = MLFQ; }
+	else if (strncasecmp(name, "RR", 2) == 0)
+	{
+		*scheme = RR;
+		return ((*quantum = atoi(name + 2)) > 0) ? 1 : -1;
+	}
+	else if (strncasecmp(name, "STRIDE", 6) == 0)
+	{
+		*scheme = STRIDE;
+		return ((*quantum = atoi(name + 6)) > 0) ? 1 : -1;
+	}
+	else
+		return 0;
+	return 1;
+}
+
+/**
+ * Parses the MLFQ quanta of -m: a comma-separated list of positive
+ * numbers, highest level first.  list is split in place.
+ * @return the number of levels, or 0 unless there are 1 to MLFQ_MAX_LEVELS
+ * positive numbers
+ */
+int jobfile_parse_quanta(char *list, int quanta[MLFQ_MAX_LEVELS])
+{
+	int levels = 0;
+	char *token;
+	for (token = strtok(list, ","); token != NULL; token = strtok(NULL, ","))
+	{
+		if (levels == MLFQ_MAX_LEVELS || (quanta[levels++] = atoi(token)) <= 0)
+			return 0;
+	}
+	return levels;
+}
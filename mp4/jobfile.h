@@ -0,0 +1,34 @@
+/** @file jobfile.h
+ *
+ * Reading job files and parsing scheme options, shared by simulator,
+ * simsweep and runner.  A job file is a CSV header line followed by one
+ * "arrival time,run time,priority" line per job; a job's id is its line
+ * number after the header, counting from 0.
+ */
+
+#ifndef JOBFILE_H_
+#define JOBFILE_H_
+
+#include <stdio.h>
+
+#include "libscheduler/libscheduler.h"
+
+typedef struct _jobfile_job_t
+{
+	int job_id, arrival_time, run_time, priority;
+} jobfile_job_t;
+
+typedef struct _jobfile_reader_t jobfile_reader_t;
+
+jobfile_reader_t *jobfile_open(FILE *file);
+void jobfile_skip_header(jobfile_reader_t *reader);
+int jobfile_next(jobfile_reader_t *reader, jobfile_job_t *job);
+void jobfile_close(jobfile_reader_t *reader);
+
+int jobfile_read_all(FILE *file, jobfile_job_t **out);
+int jobfile_compare_arrivals(const void *a, const void *b);
+
+int jobfile_parse_scheme(const char *name, scheme_t *scheme, int *quantum);
+int jobfile_parse_quanta(char *list, int quanta[MLFQ_MAX_LEVELS]);
+
+#endif
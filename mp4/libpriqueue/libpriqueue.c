@@ -6,46 +6,147 @@
 
 #include "libpriqueue.h"
 
-node_t*   new_node        ()
+/*
+  The queue is a PQ_ARITY-ary min-heap stored in one array.  Ties under the
+  comparer are broken by insertion order, which gives exactly the order the
+  old sorted linked list produced: equal elements come out first-in
+  first-out.
+
+  Every element also gets a handle.  q->slot maps a handle to the element's
+  current heap index, so an element can be found and removed in O(log n)
+  without scanning.
+*/
+
+static int entry_before(priqueue_t *q, const pq_entry_t *a, const pq_entry_t *b)
 {
-  node_t * p = (node_t*)malloc(sizeof(node_t));
-  p->obj = NULL;
-  p->next = NULL;
-  return p;
+  int c = q->comp(a->obj, b->obj);
+  if(c != 0) return c < 0;
+  return a->seq < b->seq;
 }
 
-void*   get_obj_node    (node_t* node_ptr)
+static void place(priqueue_t *q, int index, pq_entry_t entry)
 {
-  if(node_ptr==NULL){
-    ERROROUT("node is empty");
+  q->heap[index] = entry;
+  q->slot[entry.handle] = index;
+}
+
+static void sift_up(priqueue_t *q, int index)
+{
+  pq_entry_t entry = q->heap[index];
+  while(index > 0){
+    int parent = (index - 1) / PQ_ARITY;
+    if(!entry_before(q, &entry, &q->heap[parent])) break;
+    place(q, index, q->heap[parent]);
+    index = parent;
+  }
+  place(q, index, entry);
+}
+
+static void sift_down(priqueue_t *q, int index)
+{
+  pq_entry_t entry = q->heap[index];
+  while(1){
+    int first = index * PQ_ARITY + 1, best = -1, i;
+    for(i = first; i < first + PQ_ARITY && i < q->size; i++){
+      if(best == -1 || entry_before(q, &q->heap[i], &q->heap[best]))
+        best = i;
+    }
+    if(best == -1 || !entry_before(q, &q->heap[best], &entry)) break;
+    place(q, index, q->heap[best]);
+    index = best;
+  }
+  place(q, index, entry);
+}
+
+static void grow(priqueue_t *q)
+{
+  int capacity = q->capacity * 2;
+  q->heap = (pq_entry_t*)realloc(q->heap, sizeof(pq_entry_t) * capacity);
+  q->slot = (int*)realloc(q->slot, sizeof(int) * capacity);
+  q->free_handles = (int*)realloc(q->free_handles, sizeof(int) * capacity);
+  q->scratch = (int*)realloc(q->scratch, sizeof(int) * capacity);
+  if(q->heap == NULL || q->slot == NULL || q->free_handles == NULL || q->scratch == NULL){
+    ERROROUT("out of memory.");
     exit(1);
   }
-  return node_ptr->obj;
+  q->capacity = capacity;
+}
+
+static pq_handle_t new_handle(priqueue_t *q)
+{
+  if(q->num_free > 0) return q->free_handles[--q->num_free];
+  return q->num_handles++;
 }
 
-void*    destroy_node     (node_t* node_ptr)
+static void free_handle(priqueue_t *q, pq_handle_t handle)
 {
-  void* p = node_ptr->obj;
-  free(node_ptr);
-  return p;
+  q->slot[handle] = -1;
+  q->free_handles[q->num_free++] = handle;
 }
 
-void*    insert_value_node (node_t* node_ptr, void* obj_ptr)
+/* Removes the element stored at heap index, returning it. */
+static void *remove_index(priqueue_t *q, int index)
 {
-  void* p = node_ptr->obj;
-  node_ptr -> obj = obj_ptr;
-  return p;
+  pq_entry_t removed = q->heap[index];
+  free_handle(q, removed.handle);
+  q->size--;
+  if(index != q->size){
+    place(q, index, q->heap[q->size]);
+    if(index > 0 && entry_before(q, &q->heap[index], &q->heap[(index - 1) / PQ_ARITY]))
+      sift_up(q, index);
+    else
+      sift_down(q, index);
+  }
+  return removed.obj;
 }
 
-void*   insert_next_node   (node_t* node_ptr, node_t* inserter)
+/*
+  Heap index of the index'th element in priority order.
+
+  Walks the heap best-first from the root, keeping the candidates in a small
+  heap of indices (q->scratch); costs O(index * log(index)) comparisons
+  instead of sorting the whole queue.
+*/
+static int index_of_rank(priqueue_t *q, int rank)
 {
-  node_t * p = node_ptr -> next;
-  node_ptr -> next = inserter;
-  return (void*)p;
+  int *frontier = q->scratch;
+  int n = 1, popped = 0;
+  frontier[0] = 0;
+
+  while(1){
+    int top = frontier[0];
+    if(popped == rank) return top;
+    popped++;
+
+    // pop the best candidate off the frontier (a binary heap of indices)
+    int last = frontier[--n], i = 0;
+    while(1){
+      int c = 2 * i + 1;
+      if(c >= n) break;
+      if(c + 1 < n && entry_before(q, &q->heap[frontier[c + 1]], &q->heap[frontier[c]])) c++;
+      if(!entry_before(q, &q->heap[frontier[c]], &q->heap[last])) break;
+      frontier[i] = frontier[c];
+      i = c;
+    }
+    if(n > 0) frontier[i] = last;
+
+    // its children become candidates
+    int child;
+    for(child = top * PQ_ARITY + 1; child <= top * PQ_ARITY + PQ_ARITY && child < q->size; child++){
+      int j = n++;
+      while(j > 0 && entry_before(q, &q->heap[child], &q->heap[frontier[(j - 1) / 2]])){
+        frontier[j] = frontier[(j - 1) / 2];
+        j = (j - 1) / 2;
+      }
+      frontier[j] = child;
+    }
+  }
 }
+
+
 /**
   Initializes the priqueue_t data structure.
-  
+
   Assumtions
     - You may assume this function will only be called once per instance of priqueue_t
     - You may assume this function will be the first function called using an instance of priqueue_t.
@@ -56,59 +157,86 @@ void*   insert_next_node   (node_t* node_ptr, node_t* inserter)
 void priqueue_init(priqueue_t *q, int(*comparer)(const void *, const void *))
 {
   q->size = 0;
-  q->head = NULL;
+  q->capacity = PQ_INIT_CAPACITY / 2;
+  q->heap = NULL;
+  q->slot = NULL;
+  q->free_handles = NULL;
+  q->scratch = NULL;
+  grow(q);
+  q->num_free = 0;
+  q->num_handles = 0;
+  q->next_seq = 0;
+  q->fast = 0;
   q->comp = comparer;
 }
 
 
+/**
+  Selects whether priqueue_offer() reports the rank of the new element.
+
+  Computing the rank costs one comparison per queued element.  In fast mode
+  priqueue_offer() is O(log n) and returns the heap slot of the element
+  instead, which is still 0 exactly when the element became the head of
+  the queue.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param fast non-zero to enable fast mode
+ */
+void priqueue_set_fast(priqueue_t *q, int fast)
+{
+  q->fast = fast;
+}
+
+
+/**
+  Inserts the specified element into this priority queue, returning a
+  handle to it.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param ptr a pointer to the data to be inserted into the priority queue
+  @return a handle that can be passed to priqueue_remove_handle() and
+  priqueue_update() while the element is in the queue
+ */
+pq_handle_t priqueue_push(priqueue_t *q, void *ptr)
+{
+  pq_entry_t entry;
+  if(q->size == q->capacity) grow(q);
+
+  entry.obj = ptr;
+  entry.seq = q->next_seq++;
+  entry.handle = new_handle(q);
+  place(q, q->size, entry);
+  q->size++;
+  sift_up(q, q->size - 1);
+  return entry.handle;
+}
+
+
 /**
   Inserts the specified element into this priority queue.
 
   @param q a pointer to an instance of the priqueue_t data structure
   @param ptr a pointer to the data to be inserted into the priority queue
   @return The zero-based index where ptr is stored in the priority queue, where 0 indicates that ptr was stored at the front of the priority queue.
+  In fast mode (see priqueue_set_fast()), the heap slot of ptr, which is also 0 only when ptr is at the front.
  */
 int priqueue_offer(priqueue_t *q, void *ptr)
 {
-	node_t* node_ptr = new_node();
-  insert_value_node(node_ptr,ptr);
-  int i;
-  if(q->size ==0){
-    q->head = node_ptr;
-    q->size ++;
-    return 0;
-  }
-  
-  if(q->comp(node_ptr->obj,q->head->obj) < 0)
-  {
-    insert_next_node(node_ptr,q->head);
-    q->head = node_ptr;
-    q->size ++;
-    return 0;
-  }
-  
-  node_t* iterator = q->head;
-  for (i = 0; i < q->size; ++i)
-  {
-    if(iterator->next == NULL || q->comp(node_ptr->obj,iterator->next->obj)<0){
-      insert_next_node(node_ptr,iterator->next);
-      iterator->next = node_ptr;
-      q->size ++;
-      return i+1;
-    }
-    else iterator = iterator -> next;
-  }
+  pq_handle_t handle = priqueue_push(q, ptr);
+  int index = q->slot[handle], rank = 0, i;
+
+  if(q->fast || index == 0) return index;
 
-  ERROROUT("insert failed.");
-  exit(1);
-  return -1;
+  for(i = 0; i < q->size; i++)
+    if(i != index && entry_before(q, &q->heap[i], &q->heap[index])) rank++;
+  return rank;
 }
 
 
 /**
   Retrieves, but does not remove, the head of this queue, returning NULL if
   this queue is empty.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @return pointer to element at the head of the queue
   @return NULL if the queue is empty
@@ -116,14 +244,14 @@ int priqueue_offer(priqueue_t *q, void *ptr)
 void *priqueue_peek(priqueue_t *q)
 {
 	if(q->size == 0) return NULL;
-  return q->head->obj;
+  return q->heap[0].obj;
 }
 
 
 /**
   Retrieves and removes the head of this queue, or NULL if this queue
   is empty.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @return the head of this queue
   @return NULL if this queue is empty
@@ -131,18 +259,14 @@ void *priqueue_peek(priqueue_t *q)
 void *priqueue_poll(priqueue_t *q)
 {
 	if(q->size == 0) return NULL;
-
-  node_t * node_ptr = q->head;
-  q->head = node_ptr->next;
-  q->size --;
-  return destroy_node(node_ptr);
+  return remove_index(q, 0);
 }
 
 
 /**
   Returns the element at the specified position in this list, or NULL if
   the queue does not contain an index'th element.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @param index position of retrieved element
   @return the index'th element in the queue
@@ -155,50 +279,37 @@ void *priqueue_at(priqueue_t *q, int index)
     return NULL;
   }
   if(index >= q->size) return NULL;
-  if(index == 0) return q->head->obj;
-
-  int i;
-  node_t * iterator = q->head;
-  for(i=1;i<= index;++i)
-    iterator = iterator -> next;
-  return iterator -> obj;
-
+  return q->heap[index_of_rank(q, index)].obj;
 }
 
 
 /**
-  Removes all instances of ptr from the queue. 
-  
+  Removes all instances of ptr from the queue.
+
   This function should not use the comparer function, but check if the data contained in each element of the queue is equal (==) to ptr.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @param ptr address of element to be removed
   @return the number of entries removed
  */
 int priqueue_remove(priqueue_t *q, void *ptr)
 {
-  int number_removed = 0;
+  int number_removed = 0, i, kept = 0;
 
-  while(q->size >0 && ptr == get_obj_node(q->head)) {
-    priqueue_poll(q);
-    number_removed ++; 
+  // compact the survivors, then rebuild the heap once: O(n) for any number of matches
+  for(i = 0; i < q->size; i++){
+    if(q->heap[i].obj == ptr){
+      free_handle(q, q->heap[i].handle);
+      number_removed ++;
+    }
+    else
+      place(q, kept++, q->heap[i]);
   }
+  q->size = kept;
 
-  node_t *iterator, *node_ptr;
-  if(q->size > 0)
-  {
-    iterator = q->head;
-    while(iterator->next != NULL ){
-      if(get_obj_node(iterator->next) == ptr){
-        node_ptr = iterator -> next;
-        iterator -> next = node_ptr -> next;
-        q->size --;
-        destroy_node(node_ptr);
-        number_removed ++;
-        continue;
-      }
-      iterator = iterator -> next;
-    }
+  if(number_removed > 0 && q->size > 1){
+    for(i = (q->size - 2) / PQ_ARITY; i >= 0; i--)
+      sift_down(q, i);
   }
 
   return number_removed;
@@ -208,7 +319,7 @@ int priqueue_remove(priqueue_t *q, void *ptr)
 /**
   Removes the specified index from the queue, moving later elements up
   a spot in the queue to fill the gap.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @param index position of element to be removed
   @return the element removed from the queue
@@ -221,24 +332,46 @@ void *priqueue_remove_at(priqueue_t *q, int index)
     return NULL;
   }
   if(index >= q->size) return NULL;
-  if(index == 0) return priqueue_poll(q);
-
-  int i;
-  node_t *iterator = q->head, *node_ptr;
-  for(i=1;i<= index -1 ;++i)
-    iterator = iterator -> next;
-
-  node_ptr = iterator -> next;
-  iterator -> next = node_ptr -> next;
-  q-> size --;
-  return destroy_node(node_ptr);
-  
+  return remove_index(q, index_of_rank(q, index));
+}
+
+
+/**
+  Removes the element a handle refers to, in O(log n).
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_push() for an element that is still queued
+  @return the element removed from the queue
+  @return NULL if the handle does not refer to a queued element
+ */
+void *priqueue_remove_handle(priqueue_t *q, pq_handle_t handle)
+{
+  if(handle < 0 || handle >= q->num_handles || q->slot[handle] < 0) return NULL;
+  return remove_index(q, q->slot[handle]);
+}
+
+
+/**
+  Restores the queue order after the key of a queued element changed.
+
+  @param q a pointer to an instance of the priqueue_t data structure
+  @param handle a handle returned by priqueue_push() for an element that is still queued
+ */
+void priqueue_update(priqueue_t *q, pq_handle_t handle)
+{
+  int index;
+  if(handle < 0 || handle >= q->num_handles || (index = q->slot[handle]) < 0) return;
+
+  if(index > 0 && entry_before(q, &q->heap[index], &q->heap[(index - 1) / PQ_ARITY]))
+    sift_up(q, index);
+  else
+    sift_down(q, index);
 }
 
 
 /**
   Returns the number of elements in the queue.
- 
+
   @param q a pointer to an instance of the priqueue_t data structure
   @return the number of elements in the queue
  */
@@ -250,10 +383,19 @@ int priqueue_size(priqueue_t *q)
 
 /**
   Destroys and frees all the memory associated with q.
-  
+
   @param q a pointer to an instance of the priqueue_t data structure
  */
 void priqueue_destroy(priqueue_t *q)
 {
-  while(q->size >0) priqueue_poll(q);
+  free(q->heap);
+  free(q->slot);
+  free(q->free_handles);
+  free(q->scratch);
+  q->heap = NULL;
+  q->slot = NULL;
+  q->free_handles = NULL;
+  q->scratch = NULL;
+  q->size = 0;
+  q->capacity = 0;
 }
@@ -13,17 +13,19 @@
 	#define D(x)
 #endif
 
-typedef struct _node_
+/** Children per heap node.  4 keeps sibling comparisons in one cache line. */
+#define PQ_ARITY 4
+#define PQ_INIT_CAPACITY 16
+
+/** Stable reference to an element, valid until that element leaves the queue. */
+typedef int pq_handle_t;
+
+typedef struct _pq_entry_t
 {
 	void *obj;
-	struct _node_ *next;
-} node_t;
-
-node_t*		new_node			();
-void*		destroy_node		(node_t*);
-void*		insert_value_node	(node_t*, void*);
-void*		insert_next_node	(node_t*, node_t*);
-void*		get_obj_node		(node_t*);
+	unsigned long seq;	///< insertion order, so equal elements stay FIFO
+	pq_handle_t handle;
+} pq_entry_t;
 
 
 /**
@@ -32,19 +34,31 @@ void*		get_obj_node		(node_t*);
 typedef struct _priqueue_t
 {
 	int size;
-	node_t *head;
+	int capacity;
+	pq_entry_t *heap;
+	int *slot;		///< heap index of each handle, -1 if the handle is free
+	int *free_handles;	///< stack of handles available for reuse
+	int num_free;
+	int num_handles;
+	unsigned long next_seq;
+	int fast;		///< if set, priqueue_offer() skips computing the rank
+	int *scratch;		///< frontier used by priqueue_at()
 	int (*comp)(const void *, const void *);
 } priqueue_t;
 
 
 void   priqueue_init     (priqueue_t *q, int(*comparer)(const void *, const void *));
+void   priqueue_set_fast (priqueue_t *q, int fast);
 
 int    priqueue_offer    (priqueue_t *q, void *ptr);
+pq_handle_t priqueue_push(priqueue_t *q, void *ptr);
 void * priqueue_peek     (priqueue_t *q);
 void * priqueue_poll     (priqueue_t *q);
 void * priqueue_at       (priqueue_t *q, int index);
 int    priqueue_remove   (priqueue_t *q, void *ptr);
 void * priqueue_remove_at(priqueue_t *q, int index);
+void * priqueue_remove_handle(priqueue_t *q, pq_handle_t handle);
+void   priqueue_update   (priqueue_t *q, pq_handle_t handle);
 int    priqueue_size     (priqueue_t *q);
 
 void   priqueue_destroy  (priqueue_t *q);
@@ -0,0 +1,378 @@
+/** @file librunner.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "librunner.h"
+#include "containers.h"
+
+/*
+  Each worker thread is one core of a libscheduler instance.  The
+  scheduler decides which task each core runs; the workers only carry its
+  decisions out, calling the task's step between yield points.
+
+  Everything below is guarded by the runner's lock, except that a worker
+  calls a task's step without it.  A task is on at most one worker at a
+  time: if the scheduler preempts a task and hands it to another core
+  before its current step has returned, the new core waits for it.
+*/
+
+typedef struct _runner_task_t
+{
+  runner_step_t step;
+  void *arg;
+  int worker;                   // worker calling step, -1 if none
+  int done;                     // step returned non-zero after the task was preempted
+  runner_task_record_t record;
+} runner_task_t;
+
+CONTAINER_VECTOR(task_vector, runner_task_t *)
+
+typedef struct _runner_worker_t
+{
+  runner_t *runner;
+  int id;
+  int assigned;                 // task the scheduler has on this core, -1 if idle
+  pthread_t thread;
+} runner_worker_t;
+
+struct _runner_t
+{
+  scheduler_t *scheduler;
+  int rr_quantum;
+  int tick_usec;
+  struct timespec epoch;
+
+  pthread_mutex_t lock;
+  pthread_cond_t changed;       // broadcast whenever an assignment, task or count changes
+  task_vector_t tasks;          // by task number, which is also the job number
+  int unfinished;
+  int shutting_down;
+
+  int workers_ct;
+  runner_worker_t *workers;
+};
+
+
+/**
+  Fills in the defaults: the scheduler's defaults, an RR quantum of 2
+  ticks and 1 millisecond ticks.
+
+  @param options the options to fill in
+ */
+void runner_default_options(runner_options_t *options)
+{
+  scheduler_default_options(&options->scheduler);
+  options->rr_quantum = 2;
+  options->tick_usec = 1000;
+}
+
+/**
+  Microseconds since the runner was created.
+
+  @param r the runner
+  @return the time now
+ */
+long long runner_now(runner_t *r)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (ts.tv_sec - r->epoch.tv_sec) * 1000000LL + (ts.tv_nsec - r->epoch.tv_nsec) / 1000;
+}
+
+static int now_ticks(runner_t *r, long long now)
+{
+  return (int)(now / r->tick_usec);
+}
+
+/* Ticks the task may run on worker w before its quantum expires; 0 for no quantum. */
+static int slice_ticks(runner_t *r, runner_worker_t *w)
+{
+  if(r->rr_quantum > 0) return r->rr_quantum;
+  return sched_quantum(r->scheduler, w->id);
+}
+
+/*
+  Runs whatever the scheduler puts on the worker's core until the runner
+  shuts down.  Called and returns with the lock held.
+*/
+static void worker_loop(runner_t *r, runner_worker_t *w)
+{
+  while(1){
+    while(w->assigned == -1 && !r->shutting_down)
+      pthread_cond_wait(&r->changed, &r->lock);
+    if(w->assigned == -1) return;
+
+    int number = w->assigned;
+    runner_task_t *task = r->tasks.data[number];
+    if(task->worker != -1){
+      // still finishing a step on the core it was preempted from
+      pthread_cond_wait(&r->changed, &r->lock);
+      continue;
+    }
+
+    if(task->done){
+      // finished just as it was preempted; tell the scheduler now it is back on a core
+      w->assigned = sched_job_finished(r->scheduler, w->id, number, now_ticks(r, runner_now(r)));
+      r->unfinished--;
+      pthread_cond_broadcast(&r->changed);
+      continue;
+    }
+
+    long long start = runner_now(r), now;
+    int slice = slice_ticks(r, w);
+    long long expire = (slice > 0) ? (long long)(now_ticks(r, start) + slice) * r->tick_usec : LLONG_MAX;
+    task->worker = w->id;
+    if(task->record.started == -1) task->record.started = start;
+
+    while(1){
+      pthread_mutex_unlock(&r->lock);
+      int done = task->step(task->arg);
+      pthread_mutex_lock(&r->lock);
+      now = runner_now(r);
+
+      if(done) task->record.finished = now;
+      if(w->assigned != number){
+        // an arrival took the core; the scheduler has requeued the task
+        task->record.preemptions++;
+        task->done = done;
+        break;
+      }
+      if(done){
+        w->assigned = sched_job_finished(r->scheduler, w->id, number, now_ticks(r, now));
+        r->unfinished--;
+        break;
+      }
+      if(now >= expire){
+        w->assigned = sched_quantum_expired(r->scheduler, w->id, now_ticks(r, now));
+        if(w->assigned != number) task->record.preemptions++;
+        break;
+      }
+    }
+
+    task->record.ran += now - start;
+    task->worker = -1;
+    pthread_cond_broadcast(&r->changed);
+  }
+}
+
+static void *worker_main(void *arg)
+{
+  runner_worker_t *w = arg;
+  pthread_mutex_lock(&w->runner->lock);
+  worker_loop(w->runner, w);
+  pthread_mutex_unlock(&w->runner->lock);
+  return NULL;
+}
+
+
+/**
+  Starts a pool of worker threads, each one a core of a new scheduler.
+
+  @param workers the number of worker threads, known to the scheduler as core(id=0) to core(id=workers-1)
+  @param scheme the scheduling scheme
+  @param options the configuration, see runner_default_options(); NULL for the defaults
+  @return the new runner, to be released with runner_destroy(), or NULL if a thread could not be started
+ */
+runner_t *runner_create(int workers, scheme_t scheme, const runner_options_t *options)
+{
+  runner_options_t defaults;
+  int i;
+
+  if(options == NULL){
+    runner_default_options(&defaults);
+    options = &defaults;
+  }
+
+  runner_t *r = malloc(sizeof(runner_t));
+  r->scheduler = sched_create(workers, scheme, &options->scheduler);
+  r->rr_quantum = (scheme == RR) ? options->rr_quantum : 0;
+  r->tick_usec = (options->tick_usec > 0) ? options->tick_usec : 1;
+  clock_gettime(CLOCK_MONOTONIC, &r->epoch);
+  pthread_mutex_init(&r->lock, NULL);
+  pthread_cond_init(&r->changed, NULL);
+  task_vector_init(&r->tasks);
+  r->unfinished = 0;
+  r->shutting_down = 0;
+  r->workers_ct = workers;
+  r->workers = malloc(workers * sizeof(runner_worker_t));
+
+  for(i = 0; i < workers; i++){
+    r->workers[i].runner = r;
+    r->workers[i].id = i;
+    r->workers[i].assigned = -1;
+  }
+  for(i = 0; i < workers; i++){
+    if(pthread_create(&r->workers[i].thread, NULL, worker_main, &r->workers[i]) != 0){
+      r->workers_ct = i;
+      runner_destroy(r);
+      return NULL;
+    }
+  }
+  return r;
+}
+
+/**
+  Hands a task to the scheduler as a new job arriving now.  If the
+  scheduler puts it on a busy core, that core's task is preempted at its
+  next yield point.  May be called from any thread, including from a step.
+
+  @param r the runner
+  @param step the task's work, see runner_step_t
+  @param arg passed to every call of step
+  @param running_time the task's expected running time in ticks, used by SJF and PSJF
+  @param priority the task's priority, used by PRI, PPRI and STRIDE
+  @return the task's number, for runner_record()
+ */
+int runner_submit(runner_t *r, runner_step_t step, void *arg, int running_time, int priority)
+{
+  runner_task_t *task = malloc(sizeof(runner_task_t));
+  task->step = step;
+  task->arg = arg;
+  task->worker = -1;
+  task->done = 0;
+  task->record.started = task->record.finished = -1;
+  task->record.ran = 0;
+  task->record.preemptions = 0;
+
+  pthread_mutex_lock(&r->lock);
+  int number = task_vector_size(&r->tasks);
+  task_vector_push(&r->tasks, task);
+  r->unfinished++;
+  task->record.submitted = runner_now(r);
+
+  int core = sched_new_job(r->scheduler, number, now_ticks(r, task->record.submitted), running_time, priority);
+  if(core >= 0 && core < r->workers_ct){
+    r->workers[core].assigned = number;
+    pthread_cond_broadcast(&r->changed);
+  }
+  pthread_mutex_unlock(&r->lock);
+  return number;
+}
+
+/**
+  Blocks until every task submitted so far has finished.
+
+  @param r the runner
+ */
+void runner_wait(runner_t *r)
+{
+  pthread_mutex_lock(&r->lock);
+  while(r->unfinished > 0)
+    pthread_cond_wait(&r->changed, &r->lock);
+  pthread_mutex_unlock(&r->lock);
+}
+
+/**
+  @param r the runner
+  @return the number of tasks submitted
+ */
+int runner_tasks(runner_t *r)
+{
+  pthread_mutex_lock(&r->lock);
+  int n = task_vector_size(&r->tasks);
+  pthread_mutex_unlock(&r->lock);
+  return n;
+}
+
+/**
+  What was measured for a task.  Only complete once the task has finished,
+  eg. after runner_wait().
+
+  @param r the runner
+  @param task a number returned by runner_submit()
+  @return the task's record, valid until runner_destroy()
+ */
+const runner_task_record_t *runner_record(runner_t *r, int task)
+{
+  pthread_mutex_lock(&r->lock);
+  runner_task_t *t = r->tasks.data[task];
+  pthread_mutex_unlock(&r->lock);
+  return &t->record;
+}
+
+/* Mean over finished tasks of what(record), in milliseconds. */
+static float average(runner_t *r, long long (*what)(const runner_task_record_t *))
+{
+  long long total = 0;
+  int i, n = 0;
+
+  pthread_mutex_lock(&r->lock);
+  for(i = 0; i < task_vector_size(&r->tasks); i++){
+    const runner_task_record_t *record = &r->tasks.data[i]->record;
+    if(record->finished == -1) continue;
+    total += what(record);
+    n++;
+  }
+  pthread_mutex_unlock(&r->lock);
+  return (n > 0) ? total / 1000.0f / n : 0.0f;
+}
+
+static long long turnaround(const runner_task_record_t *record) { return record->finished - record->submitted; }
+static long long waiting(const runner_task_record_t *record) { return record->finished - record->submitted - record->ran; }
+static long long response(const runner_task_record_t *record) { return record->started - record->submitted; }
+
+/**
+  Measured average turnaround time (finish - submit) of the finished tasks.
+
+  @param r the runner
+  @return the average in milliseconds, 0 if no task has finished
+ */
+float runner_average_turnaround_time(runner_t *r)
+{
+  return average(r, turnaround);
+}
+
+/**
+  Measured average waiting time (turnaround - time spent in step) of the
+  finished tasks.
+
+  @param r the runner
+  @return the average in milliseconds, 0 if no task has finished
+ */
+float runner_average_waiting_time(runner_t *r)
+{
+  return average(r, waiting);
+}
+
+/**
+  Measured average response time (first step - submit) of the finished tasks.
+
+  @param r the runner
+  @return the average in milliseconds, 0 if no task has finished
+ */
+float runner_average_response_time(runner_t *r)
+{
+  return average(r, response);
+}
+
+/**
+  Waits for every task, stops the workers and frees the runner.
+
+  @param r the runner
+ */
+void runner_destroy(runner_t *r)
+{
+  int i;
+
+  runner_wait(r);
+  pthread_mutex_lock(&r->lock);
+  r->shutting_down = 1;
+  pthread_cond_broadcast(&r->changed);
+  pthread_mutex_unlock(&r->lock);
+  for(i = 0; i < r->workers_ct; i++)
+    pthread_join(r->workers[i].thread, NULL);
+
+  for(i = 0; i < task_vector_size(&r->tasks); i++)
+    free(r->tasks.data[i]);
+  task_vector_destroy(&r->tasks);
+  sched_destroy(r->scheduler);
+  pthread_cond_destroy(&r->changed);
+  pthread_mutex_destroy(&r->lock);
+  free(r->workers);
+  free(r);
+}
@@ -0,0 +1,55 @@
+/** @file librunner.h
+ */
+
+#ifndef LIBRUNNER_H_
+#define LIBRUNNER_H_
+
+#include "../libscheduler/libscheduler.h"
+
+/**
+  One slice of a task's work.  The runner calls it over and over, on
+  whichever worker the scheduler puts the task on, until it returns
+  non-zero.  Each return is a yield point: between two calls the task may
+  be preempted, have its quantum expire or move to another worker, so all
+  of its state must live in arg.
+*/
+typedef int (*runner_step_t)(void *arg);
+
+/**
+  How a runner is set up.  Times given to the scheduler are in ticks of
+  tick_usec microseconds since runner_create(), so a trace written for the
+  simulator runs with one time unit lasting one tick.
+*/
+typedef struct _runner_options_t
+{
+  scheduler_options_t scheduler;  ///< see scheduler_default_options()
+  int rr_quantum;                 ///< ticks per RR quantum; ignored by other schemes
+  int tick_usec;                  ///< length of a tick
+} runner_options_t;
+
+/** What was measured for one task, in microseconds since runner_create(). */
+typedef struct _runner_task_record_t
+{
+  long long submitted;
+  long long started;    ///< first time a worker called its step, -1 before then
+  long long finished;   ///< -1 until its step returned non-zero
+  long long ran;        ///< time spent in its step on all workers
+  int preemptions;      ///< times it left a worker unfinished
+} runner_task_record_t;
+
+typedef struct _runner_t runner_t;
+
+void  runner_default_options           (runner_options_t *options);
+
+runner_t *runner_create                (int workers, scheme_t scheme, const runner_options_t *options);
+int   runner_submit                    (runner_t *r, runner_step_t step, void *arg, int running_time, int priority);
+void  runner_wait                      (runner_t *r);
+int   runner_tasks                     (runner_t *r);
+const runner_task_record_t *runner_record (runner_t *r, int task);
+float runner_average_turnaround_time   (runner_t *r);
+float runner_average_waiting_time      (runner_t *r);
+float runner_average_response_time     (runner_t *r);
+long long runner_now                   (runner_t *r);
+void  runner_destroy                   (runner_t *r);
+
+#endif /* LIBRUNNER_H_ */
@@ -26,91 +26,416 @@ typedef struct _job_t_
   int remaining_time;
   int first_time_on_core;
   int last_update_time_on_core;
+  int core_id;              // core the job runs on, -1 while queued
+  pq_handle_t core_handle;  // handle in core.running while on a core
+  int level;                // MLFQ: current queue level, 0 is the highest
+  int quantum_left;         // MLFQ: allotment left at this level
+  long long pass;           // STRIDE: virtual time the job has consumed
+  long long stride;         // STRIDE: pass added per quantum, inversely proportional to tickets
+  int queued_on;            // core whose queue the job waits in (per-core queues)
+  pq_handle_t queue_handle; // handle in that queue
+  pq_handle_t demoted_handle;  // MLFQ: handle in demoted while queued below level 0
+  int boost_epoch;          // MLFQ: boost epoch when the job was queued
+  scheduler_t *owner;       // the scheduler the job belongs to, for the comparers
+  struct _job_t_ *next_free;  // link in the pool's free list while unused
 } job_t;
 
+#define BITS_PER_WORD (8 * (int)sizeof(unsigned long))
+
+/*
+  idle has one bit per core, set while the core has no job, so the
+  lowest-id idle core is found a word at a time.  running holds the jobs
+  on the cores with the job most worth preempting at its head.
+*/
 typedef struct _core_t_
 {
   int num_cores;
   job_t** job_in_cores;
+  unsigned long* idle;
+  int idle_words;
+  priqueue_t running;
 } core_t;
-core_t core;
 
-float total_wait = 0.0;
-int num_wait = 0;
-void insert_wait(int time)
+
+/*
+  Streaming quantile estimate with the P-square algorithm (Jain and
+  Chlamtac, 1985): five markers track the minimum, the p/2, p and (1+p)/2
+  quantiles and the maximum, and are nudged toward their ideal positions as
+  observations arrive.  Constant memory, however many jobs finish.
+*/
+typedef struct _p2_t_
+{
+  double p;
+  int n;
+  double height[5];
+  double pos[5];
+  double want[5];
+  double step[5];
+} p2_t;
+
+void p2_init(p2_t *e, double p)
 {
-  total_wait += time;
-  num_wait ++;
+  e -> p = p;
+  e -> n = 0;
+  e -> step[0] = 0; e -> step[1] = p / 2; e -> step[2] = p;
+  e -> step[3] = (1 + p) / 2; e -> step[4] = 1;
 }
 
-float total_response = 0.0;
-int num_response = 0;
-void insert_response(int time)
+static int compare_double(const void *a, const void *b)
 {
-  total_response += time;
-  num_response ++;
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+void p2_add(p2_t *e, double x)
+{
+  int i, k;
+  if(e->n < 5){
+    e -> height[e->n++] = x;
+    if(e->n == 5){
+      qsort(e->height, 5, sizeof(double), compare_double);
+      for(i=0;i<5;i++){
+        e -> pos[i] = i + 1;
+        e -> want[i] = 1 + 4 * e->step[i];
+      }
+    }
+    return;
+  }
+
+  // the cell x falls in; the extreme markers just move to x
+  if(x < e->height[0]){ e -> height[0] = x; k = 0; }
+  else if(x >= e->height[4]){ e -> height[4] = x; k = 3; }
+  else for(k=0; x >= e->height[k+1]; k++);
+
+  for(i=k+1;i<5;i++) e -> pos[i] ++;
+  for(i=0;i<5;i++) e -> want[i] += e -> step[i];
+  e -> n ++;
+
+  for(i=1;i<4;i++){
+    double d = e->want[i] - e->pos[i];
+    if((d >= 1 && e->pos[i+1] - e->pos[i] > 1) || (d <= -1 && e->pos[i-1] - e->pos[i] < -1)){
+      int s = (d > 0) ? 1 : -1;
+      double *q = e -> height, *n = e -> pos;
+      double h = q[i] + s / (n[i+1] - n[i-1]) *
+                 ((n[i] - n[i-1] + s) * (q[i+1] - q[i]) / (n[i+1] - n[i]) +
+                  (n[i+1] - n[i] - s) * (q[i] - q[i-1]) / (n[i] - n[i-1]));
+      if(q[i-1] < h && h < q[i+1]) q[i] = h;
+      else q[i] += s * (q[i+s] - q[i]) / (n[i+s] - n[i]);
+      n[i] += s;
+    }
+  }
 }
 
-float total_turnaround = 0.0;
-int num_turnaround = 0;
-void insert_turnaround(int time)
+double p2_value(p2_t *e)
 {
-  total_turnaround += time;
-  num_turnaround ++;
+  if(e->n >= 5) return e -> height[2];
+  if(e->n == 0) return 0;
+
+  // too few observations for the markers: take the nearest rank
+  double sorted[5];
+  int rank;
+  memcpy(sorted, e->height, sizeof(double) * e->n);
+  qsort(sorted, e->n, sizeof(double), compare_double);
+  rank = (int)(e->p * e->n);
+  if(rank < e->p * e->n) rank++;
+  rank--;
+  return sorted[(rank < 0) ? 0 : rank];
 }
 
-scheme_t applied_schema;
-priqueue_t* job_queue_ptr;
-core_t core;
+// one per-job quantity: its mean, maximum and tail quantiles
+typedef struct _distribution_t_
+{
+  double total, max;
+  int count;
+  p2_t p50, p95, p99;
+} distribution_t;
 
+void distribution_init(distribution_t *d)
+{
+  d -> total = d -> max = 0;
+  d -> count = 0;
+  p2_init(&d->p50, 0.50);
+  p2_init(&d->p95, 0.95);
+  p2_init(&d->p99, 0.99);
+}
 
-int now; // the time now.
-void update_time(int time)
+void distribution_add(distribution_t *d, double x)
 {
-  now = time;
-  job_t * job_ptr = NULL;
-  // update the remaining time stored in the queue.
-  int i;
-  for(i=0;i<core.num_cores;++i)
-  {
-    job_ptr = core.job_in_cores[i];
-    if(job_ptr != NULL){
-      if(job_ptr->first_time_on_core==-1 && job_ptr->last_update_time_on_core != now){
-        job_ptr->first_time_on_core = job_ptr -> last_update_time_on_core;
-        insert_response(job_ptr->first_time_on_core - job_ptr->arrival_time);
-      }
+  d -> total += x;
+  if(d->count == 0 || x > d->max) d -> max = x;
+  d -> count ++;
+  p2_add(&d->p50, x);
+  p2_add(&d->p95, x);
+  p2_add(&d->p99, x);
+}
+
+void distribution_report(distribution_t *d, scheduler_distribution_t *out)
+{
+  out -> mean = (d->count == 0) ? 0.0 : d->total / d->count;
+  out -> p50 = p2_value(&d->p50);
+  out -> p95 = p2_value(&d->p95);
+  out -> p99 = p2_value(&d->p99);
+  out -> max = d -> max;
+}
+
+
+/*
+  Per-core run queues, see scheduler_configure_queues().  Each core has its
+  own queue; loads[] counts what each core holds, and two heaps over it give
+  the least loaded core (for placing arrivals) and the longest queue (for an
+  idle core to steal from).
+*/
+typedef struct _core_load_t_
+{
+  int id;
+  int queued;     // jobs waiting in the core's queue
+  int running;    // 1 while the core has a job
+  pq_handle_t load_handle, backlog_handle;
+} core_load_t;
+
+
+// STRIDE: the pass of a job with one ticket advances by STRIDE1 per slice
+#define STRIDE1 (1 << 20)
+
+/*
+  Everything one scheduler knows.  Nothing is shared between instances, so
+  separate instances may be driven from separate threads.
+*/
+struct _scheduler_t
+{
+  scheme_t applied_schema;
+  scheduler_options_t options;
+  int now;                        // the time now.
+
+  core_t core;
+  priqueue_t job_queue;
+
+  float total_wait, total_response, total_turnaround;
+  int num_wait, num_response, num_turnaround;
+  distribution_t waiting_dist, response_dist, turnaround_dist, slowdown_dist;
+  double share_total, share_squares;  // Jain's index over running time / turnaround
+
+  int mlfq_boost_epoch;
+  priqueue_t demoted;             // queued jobs below level 0, see mlfq_boost()
+  long long global_pass;
+
+  priqueue_t* core_queues;        // per-core queues only
+  core_load_t* loads;
+  priqueue_t by_load, by_backlog;
+  int next_affinity_core;
+  int migrations;
+
+  job_t* free_jobs;               // job_t pool
+  job_t** job_slabs;
+  int num_job_slabs;
+};
+
+
+void insert_wait(scheduler_t *s, int time)
+{
+  s -> total_wait += time;
+  s -> num_wait ++;
+}
+
+void insert_response(scheduler_t *s, int time)
+{
+  s -> total_response += time;
+  s -> num_response ++;
+}
+
+void insert_turnaround(scheduler_t *s, int time)
+{
+  s -> total_turnaround += time;
+  s -> num_turnaround ++;
+}
+
+
+void mlfq_boost(scheduler_t *s);
+
+int load_comparer(const void * a, const void * b)
+{
+  const core_load_t* x = (const core_load_t*)a;
+  const core_load_t* y = (const core_load_t*)b;
+  int result = (x->queued + x->running) - (y->queued + y->running);
+  return (result==0) ? x->id - y->id : result;
+}
+
+int backlog_comparer(const void * a, const void * b)
+{
+  const core_load_t* x = (const core_load_t*)a;
+  const core_load_t* y = (const core_load_t*)b;
+  return (x->queued != y->queued) ? y->queued - x->queued : x->id - y->id;
+}
+
+void load_changed(scheduler_t *s, int core_id)
+{
+  priqueue_update(&s->by_load, s->loads[core_id].load_handle);
+  priqueue_update(&s->by_backlog, s->loads[core_id].backlog_handle);
+}
 
-      job_ptr -> remaining_time -= 
-                  now - job_ptr -> last_update_time_on_core;
-      job_ptr -> last_update_time_on_core = now;
+// the queue a job on (or placed on) core_id waits in
+priqueue_t* queue_of(scheduler_t *s, int core_id)
+{
+  return (s->options.queue_mode == QUEUE_GLOBAL) ? &s->job_queue : &s->core_queues[core_id];
+}
+
+void queue_offer(scheduler_t *s, int core_id, job_t* job_ptr)
+{
+  job_ptr -> queue_handle = priqueue_push(queue_of(s,core_id),job_ptr);
+  job_ptr -> queued_on = core_id;
+  job_ptr -> boost_epoch = s -> mlfq_boost_epoch;
+  if(job_ptr->level > 0) job_ptr -> demoted_handle = priqueue_push(&s->demoted,job_ptr);
+  if(s->options.queue_mode != QUEUE_GLOBAL){
+    s -> loads[core_id].queued ++;
+    load_changed(s,core_id);
+  }
+}
 
+job_t* queue_poll(scheduler_t *s, int core_id)
+{
+  job_t* job_ptr = priqueue_poll(queue_of(s,core_id));
+  if(job_ptr != NULL && job_ptr->level > 0)
+    priqueue_remove_handle(&s->demoted, job_ptr->demoted_handle);
+  if(job_ptr != NULL && s->options.queue_mode != QUEUE_GLOBAL){
+    s -> loads[core_id].queued --;
+    load_changed(s,core_id);
+  }
+  return job_ptr;
+}
+
+void set_running(scheduler_t *s, int core_id, int running)
+{
+  if(s->options.queue_mode != QUEUE_GLOBAL){
+    s -> loads[core_id].running = running;
+    load_changed(s,core_id);
+  }
+}
+
+// the next job for a core that just became free: its own queue first, then
+// the head of the longest queue
+job_t* queue_next_for(scheduler_t *s, int core_id)
+{
+  job_t* job_ptr = queue_poll(s,core_id);
+  if(job_ptr == NULL && s->options.queue_mode != QUEUE_GLOBAL){
+    core_load_t* busiest = (core_load_t*)priqueue_peek(&s->by_backlog);
+    if(busiest->queued > 0){
+      job_ptr = queue_poll(s,busiest->id);
+      s -> migrations ++;
     }
   }
-  
+  return job_ptr;
 }
 
-int get_now()
+
+// The remaining time of a job on a core is brought up to date only when the
+// job is looked at (see core_sync()), so advancing the clock is O(1).
+void update_time(scheduler_t *s, int time)
+{
+  int period = s -> options.mlfq_boost_period;
+  s -> now = time;
+  if(s->applied_schema == MLFQ && period > 0 && s->now / period > s->mlfq_boost_epoch){
+    s -> mlfq_boost_epoch = s->now / period;
+    mlfq_boost(s);
+  }
+}
+
+int get_now(scheduler_t *s)
 {
-  return now;
+  return s -> now;
 }
 /**
   Stores information making up a job to be scheduled including any statistics.
 
-  You may need to define some global variables or a struct to store your job queue elements. 
+  You may need to define some global variables or a struct to store your job queue elements.
 */
 
-job_t* new_job()
+/*
+  job_t records come from slabs of JOB_SLAB_SIZE and return to a free list,
+  so once the pool has grown to the peak number of live jobs, arrivals and
+  completions no longer touch malloc.
+*/
+#define JOB_SLAB_SIZE 256
+
+job_t* new_job(scheduler_t *s)
 {
-  job_t* ptr = (job_t*)malloc(sizeof(job_t));
+  if(s->free_jobs == NULL){
+    job_t* slab = (job_t*)malloc(sizeof(job_t)*JOB_SLAB_SIZE);
+    s -> job_slabs = (job_t**)realloc(s->job_slabs, sizeof(job_t*)*(s->num_job_slabs+1));
+    if(slab == NULL || s->job_slabs == NULL){
+      ERROROUT("out of memory.");
+      exit(1);
+    }
+    s -> job_slabs[s->num_job_slabs++] = slab;
+
+    int i;
+    for(i=JOB_SLAB_SIZE-1;i>=0;i--){
+      slab[i].next_free = s -> free_jobs;
+      s -> free_jobs = &slab[i];
+    }
+  }
+
+  job_t* ptr = s -> free_jobs;
+  s -> free_jobs = ptr -> next_free;
+  ptr -> owner = s;
   return ptr;
 }
 
-void destroy_job(job_t* ptr)
+void destroy_job(scheduler_t *s, job_t* ptr)
+{
+  ptr -> next_free = s -> free_jobs;
+  s -> free_jobs = ptr;
+}
+
+void job_pool_destroy(scheduler_t *s)
 {
-  free(ptr);
+  int i;
+  for(i=0;i<s->num_job_slabs;i++) free(s->job_slabs[i]);
+  free(s->job_slabs);
+  s -> job_slabs = NULL;
+  s -> num_job_slabs = 0;
+  s -> free_jobs = NULL;
 }
 
 
+// account for the time the job on core_id has run since its last update.
+void core_sync(scheduler_t *s, int core_id)
+{
+  job_t* job_ptr = s->core.job_in_cores[core_id];
+  if(job_ptr->first_time_on_core==-1 && job_ptr->last_update_time_on_core != s->now){
+    job_ptr->first_time_on_core = job_ptr -> last_update_time_on_core;
+    insert_response(s, job_ptr->first_time_on_core - job_ptr->arrival_time);
+  }
+
+  job_ptr -> remaining_time -=
+              s->now - job_ptr -> last_update_time_on_core;
+  job_ptr -> quantum_left -=
+              s->now - job_ptr -> last_update_time_on_core;
+  job_ptr -> last_update_time_on_core = s->now;
+}
+
+/*
+  Orders running jobs so the head is the one a new arrival would preempt
+  first: the greatest under comparer(), and among equals the lowest core,
+  which is the one a scan of the cores in order would pick (MLFQ keeps the
+  order jobs were put on cores in).  Running jobs all lose remaining time
+  at the same rate, so for PSJF remaining_time + last_update_time_on_core
+  is a key that does not go stale between syncs.
+*/
+int running_comparer(const void * job1_ptr, const void * job2_ptr)
+{
+  const job_t* a = (const job_t*)job1_ptr;
+  const job_t* b = (const job_t*)job2_ptr;
+  int result;
+  if(a->owner->applied_schema == PSJF){
+    result = (b->remaining_time + b->last_update_time_on_core) - (a->remaining_time + a->last_update_time_on_core);
+    if(result == 0) result = b->arrival_time - a->arrival_time;
+  }
+  else
+    result = comparer(job2_ptr, job1_ptr);
+  if(result == 0 && a->owner->applied_schema != MLFQ)
+    result = a->core_id - b->core_id;
+  return result;
+}
 
 void core_init(core_t *ptr, int num)
 {
@@ -118,90 +443,158 @@ void core_init(core_t *ptr, int num)
   ptr -> job_in_cores = (job_t**)malloc(sizeof(job_t*)*num);
   int i;
   for(i=0;i<num;i++) ptr->job_in_cores[i] = NULL;
+
+  ptr -> idle_words = (num + BITS_PER_WORD - 1) / BITS_PER_WORD;
+  ptr -> idle = (unsigned long*)calloc(ptr->idle_words, sizeof(unsigned long));
+  for(i=0;i<num;i++) ptr->idle[i / BITS_PER_WORD] |= 1UL << (i % BITS_PER_WORD);
+
+  priqueue_init(&ptr->running, &running_comparer);
+  priqueue_set_fast(&ptr->running, 1);
 }
 
 void core_destroy(core_t *ptr)
 {
+  priqueue_destroy(&ptr->running);
+  free(ptr->idle);
   free(ptr->job_in_cores);
 }
 
-// delete job from core according to the job_number,
+// take the job off the core according to the job_number, without queueing it,
 // at the same time, check whether the job is indeed in the core.
-job_t* core_job_remove_on_id(int core_id, int job_number)
+job_t* core_job_take_on_id(scheduler_t *s, int core_id, int job_number)
 {
-  if(core_id<0 || core_id >= core.num_cores){
+  core_t *core = &s -> core;
+  if(core_id<0 || core_id >= core->num_cores){
     ERROROUT("out of range.");
     exit(1);
   }
-  if(core.job_in_cores[core_id]->job_number != job_number){
+  if(core->job_in_cores[core_id]->job_number != job_number){
     ERROROUT("the job is not in the corresponding core.");
     exit(1);
   }
 
-  job_t* job_ptr = core.job_in_cores[core_id];
+  core_sync(s,core_id);
+  job_t* job_ptr = core->job_in_cores[core_id];
+  priqueue_remove_handle(&core->running, job_ptr->core_handle);
   job_ptr -> last_update_time_on_core = -1;
-  // re insert back into the queue.
-  core.job_in_cores[core_id] = NULL;
-  priqueue_offer(job_queue_ptr,job_ptr);
+  job_ptr -> core_id = -1;
+  core->job_in_cores[core_id] = NULL;
+  core->idle[core_id / BITS_PER_WORD] |= 1UL << (core_id % BITS_PER_WORD);
+  set_running(s,core_id,0);
   return job_ptr;
 }
 
-int core_available()
+// delete job from core according to the job_number and put it back in the queue.
+job_t* core_job_remove_on_id(scheduler_t *s, int core_id, int job_number)
 {
-  int i;
-  for(i=0;i<core.num_cores;i++) if(core.job_in_cores[i] == NULL) return i;
+  job_t* job_ptr = core_job_take_on_id(s,core_id,job_number);
+  queue_offer(s,core_id,job_ptr);
+  return job_ptr;
+}
+
+int core_available(scheduler_t *s)
+{
+  int w;
+  for(w=0;w<s->core.idle_words;w++)
+    if(s->core.idle[w] != 0) return w * BITS_PER_WORD + __builtin_ctzl(s->core.idle[w]);
 
   return -1;
 }
 
 // return the job assigned into the core
-job_t* core_assign_on_id(int index, job_t* job_ptr)
+job_t* core_assign_on_id(scheduler_t *s, int index, job_t* job_ptr)
 {
-  if(core.job_in_cores[index] != NULL){
+  core_t *core = &s -> core;
+  if(core->job_in_cores[index] != NULL){
     ERROROUT("core already occupied.");
     exit(1);
   }
-  core.job_in_cores[index] = job_ptr;
-
-  job_ptr -> last_update_time_on_core = get_now();
+  core->job_in_cores[index] = job_ptr;
+  core->idle[index / BITS_PER_WORD] &= ~(1UL << (index % BITS_PER_WORD));
+
+  job_ptr -> last_update_time_on_core = get_now(s);
+  job_ptr -> core_id = index;
+  // a job that waited through a boost starts a fresh allotment
+  if(s->applied_schema == MLFQ && (job_ptr -> quantum_left <= 0 || job_ptr -> boost_epoch < s -> mlfq_boost_epoch))
+    job_ptr -> quantum_left = s->options.mlfq_quanta[job_ptr->level];
+  if(s->applied_schema == STRIDE && job_ptr -> pass > s->global_pass)
+    s -> global_pass = job_ptr -> pass;
+  job_ptr -> core_handle = priqueue_push(&core->running, job_ptr);
+  set_running(s,index,1);
   return job_ptr;
 }
 
 
-int core_preempt(job_t* job_ptr)
+// the victim is the greatest running job under comparer(), ties going to the
+// latest arrival, then the lowest core; it is preempted only if job_ptr
+// compares below it.
+int core_preempt(scheduler_t *s, job_t* job_ptr)
 {
-  if(core_available() != -1){
+  if(core_available(s) != -1){
     ERROROUT("no need to preempt.");
     exit(1);
   }
-  int comp_result = 0, new_result = 0;
-  int index = -1, i;
-  for(i=0;i<core.num_cores;i++) {
-    new_result = comparer(job_ptr, core.job_in_cores[i]);
-    if(new_result < comp_result){
-      comp_result = new_result;
-      index = i;
-    }else if(new_result == comp_result){
-      if(index != -1){
-        index = (core.job_in_cores[index]->arrival_time >= core.job_in_cores[i]->arrival_time) ? index : i;
-      }
-    }
-  }
+  job_t* victim = (job_t*)priqueue_peek(&s->core.running);
+  int index = victim -> core_id;
+  core_sync(s,index);
+  if(comparer(job_ptr, victim) >= 0) return -1;
 
   // insert job into core.
-  if(index >= 0){
-    core_job_remove_on_id(index,core.job_in_cores[index]->job_number);
-    core_assign_on_id(index,job_ptr);
-  }
+  core_job_remove_on_id(s,index,victim->job_number);
+  core_assign_on_id(s,index,job_ptr);
 
   return index;
 }
 
 
 // return true if the scheme is preempt
-bool scheme_is_preempt() 
+bool scheme_is_preempt(scheduler_t *s)
+{
+  return (s->applied_schema == PSJF || s->applied_schema == PPRI || s->applied_schema == MLFQ);
+}
+
+
+/*
+  Every boost period, MLFQ lifts every job back to the top level so jobs
+  demoted behind a stream of short ones are not starved.  Queued jobs keep
+  their relative order.
+
+  Jobs already at level 0 are ahead of the rest and stay put, so only the
+  demoted ones, kept in demoted in queue order, are requeued at the back.
+  A queued job's fresh allotment is handed out when it is next dispatched
+  (see core_assign_on_id()), so a boost costs O(demoted * log n) rather
+  than rebuilding every queue.
+*/
+int demoted_comparer(const void * job1_ptr, const void * job2_ptr)
 {
-  return (applied_schema == PSJF || applied_schema == PPRI);
+  return ((job_t*)job1_ptr) -> level - ((job_t*)job2_ptr) -> level;
+}
+
+void mlfq_boost(scheduler_t *s)
+{
+  core_t *core = &s -> core;
+  job_t *job_ptr;
+  int i;
+  while( (job_ptr = priqueue_poll(&s->demoted)) != NULL ){
+    priqueue_t *queue = queue_of(s,job_ptr->queued_on);
+    priqueue_remove_handle(queue, job_ptr->queue_handle);
+    job_ptr -> level = 0;
+    job_ptr -> queue_handle = priqueue_push(queue, job_ptr);
+  }
+
+  // running jobs keep the slice they were started with
+  for(i=0;i<core->num_cores;i++){
+    if(core->job_in_cores[i] != NULL && core->job_in_cores[i]->level != 0){
+      core->job_in_cores[i] -> level = 0;
+      priqueue_update(&core->running, core->job_in_cores[i]->core_handle);
+    }
+  }
+}
+
+// a priority of 0 holds 100 tickets, 1 holds 50, 4 holds 20, ...
+int job_tickets(int priority)
+{
+  return (priority <= 0) ? 100 : ((100 / (priority + 1) > 0) ? 100 / (priority + 1) : 1);
 }
 
 
@@ -210,7 +603,8 @@ bool scheme_is_preempt()
 
 int comparer(const void * job1_ptr, const void * job2_ptr)
 {
-  // typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR}
+  // typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR, MLFQ, STRIDE}
+  scheme_t applied_schema = ((job_t*)job1_ptr) -> owner -> applied_schema;
   int result = 0;
   int timediff = (int)( ((job_t*)job1_ptr) -> arrival_time - ((job_t*)job2_ptr) -> arrival_time );
   if(applied_schema == FCFS)
@@ -231,15 +625,420 @@ int comparer(const void * job1_ptr, const void * job2_ptr)
   }else if(applied_schema == RR)
   {
     return 0;
+  }else if(applied_schema == MLFQ)
+  {
+    // within a level, jobs keep the order they were queued in
+    return ((job_t*)job1_ptr) -> level - ((job_t*)job2_ptr) -> level;
+  }else if(applied_schema == STRIDE)
+  {
+    long long passdiff = ((job_t*)job1_ptr) -> pass - ((job_t*)job2_ptr) -> pass;
+    return (passdiff < 0) ? -1 : (passdiff > 0);
   }
 
   ERROROUT("Invald schema!");
   return 0;
 }
 
+
+/**
+  Fills in the options scheduler_start_up() uses unless configured
+  otherwise: a global queue, MLFQ with quanta 1, 2 and 4 boosted every 20
+  time units, a STRIDE slice of 2 and no job callback.
+
+  @param options the options to fill in
+ */
+void scheduler_default_options(scheduler_options_t *options)
+{
+  options -> mlfq_levels = 3;
+  options -> mlfq_quanta[0] = 1;
+  options -> mlfq_quanta[1] = 2;
+  options -> mlfq_quanta[2] = 4;
+  options -> mlfq_boost_period = 20;
+  options -> stride_quantum = 2;
+  options -> queue_mode = QUEUE_GLOBAL;
+  options -> job_callback = NULL;
+  options -> job_callback_arg = NULL;
+}
+
+
+/**
+  Creates a scheduler independent of every other one, including the one
+  the scheduler_*() functions drive.
+
+  @param cores the number of cores, known as core(id=0) to core(id=cores-1)
+  @param scheme the scheduling scheme
+  @param options the configuration, see scheduler_default_options(); NULL for the defaults
+  @return the new scheduler, to be released with sched_destroy()
+ */
+scheduler_t *sched_create(int cores, scheme_t scheme, const scheduler_options_t *options)
+{
+  scheduler_t *s = (scheduler_t*)calloc(1, sizeof(scheduler_t));
+  if(s == NULL){
+    ERROROUT("out of memory.");
+    exit(1);
+  }
+
+  s -> applied_schema = scheme;
+  if(options != NULL) s -> options = *options;
+  else scheduler_default_options(&s->options);
+  if(s->options.mlfq_levels < 1 || s->options.mlfq_levels > MLFQ_MAX_LEVELS){
+    ERROROUT("invalid number of levels.");
+    exit(1);
+  }
+
+  priqueue_init(&s->job_queue,&comparer);
+  priqueue_set_fast(&s->job_queue,1);
+  priqueue_init(&s->demoted,&demoted_comparer);
+  priqueue_set_fast(&s->demoted,1);
+  core_init(&s->core, cores);
+  distribution_init(&s->waiting_dist);
+  distribution_init(&s->response_dist);
+  distribution_init(&s->turnaround_dist);
+  distribution_init(&s->slowdown_dist);
+
+  if(s->options.queue_mode != QUEUE_GLOBAL){
+    int i;
+    s -> core_queues = (priqueue_t*)malloc(sizeof(priqueue_t)*cores);
+    s -> loads = (core_load_t*)malloc(sizeof(core_load_t)*cores);
+    priqueue_init(&s->by_load,&load_comparer);
+    priqueue_set_fast(&s->by_load,1);
+    priqueue_init(&s->by_backlog,&backlog_comparer);
+    priqueue_set_fast(&s->by_backlog,1);
+    for(i=0;i<cores;i++){
+      priqueue_init(&s->core_queues[i],&comparer);
+      priqueue_set_fast(&s->core_queues[i],1);
+      s -> loads[i].id = i;
+      s -> loads[i].queued = 0;
+      s -> loads[i].running = 0;
+      s -> loads[i].load_handle = priqueue_push(&s->by_load,&s->loads[i]);
+      s -> loads[i].backlog_handle = priqueue_push(&s->by_backlog,&s->loads[i]);
+    }
+  }
+
+  update_time(s,0);
+  return s;
+}
+
+
+/** scheduler_new_job() for the scheduler s. */
+int sched_new_job(scheduler_t *s, int job_number, int time, int running_time, int priority)
+{
+	update_time(s,time);
+  job_t* new_job_ptr = new_job(s);
+  new_job_ptr -> job_number = job_number;
+  new_job_ptr -> arrival_time = time;
+  new_job_ptr -> running_time = running_time;
+  new_job_ptr -> remaining_time = running_time;
+  new_job_ptr -> priority = priority;
+  new_job_ptr -> first_time_on_core = -1;
+  new_job_ptr -> last_update_time_on_core = -1;
+  new_job_ptr -> core_id = -1;
+  new_job_ptr -> level = 0;
+  new_job_ptr -> quantum_left = s->options.mlfq_quanta[0];
+  new_job_ptr -> pass = s -> global_pass;
+  new_job_ptr -> stride = STRIDE1 / job_tickets(priority);
+  new_job_ptr -> boost_epoch = s -> mlfq_boost_epoch;
+
+  core_t *core = &s -> core;
+  int index;
+
+  if(s->options.queue_mode != QUEUE_GLOBAL){
+    int target = (s->options.queue_mode == QUEUE_PER_CORE_RR) ?
+                   s->next_affinity_core++ % core->num_cores :
+                   ((core_load_t*)priqueue_peek(&s->by_load)) -> id;
+
+    if(core->job_in_cores[target] == NULL){
+      core_assign_on_id(s,target,new_job_ptr);
+      return target;
+    }
+    if( (index = core_available(s)) != -1 ){
+      s -> migrations ++;
+      core_assign_on_id(s,index,new_job_ptr);
+      return index;
+    }
+    if(scheme_is_preempt(s)){
+      core_sync(s,target);
+      if(comparer(new_job_ptr, core->job_in_cores[target]) < 0){
+        core_job_remove_on_id(s,target,core->job_in_cores[target]->job_number);
+        core_assign_on_id(s,target,new_job_ptr);
+        return target;
+      }
+    }
+    queue_offer(s,target,new_job_ptr);
+    return -1;
+  }
+
+  if( (index = core_available(s)) != -1 ){
+    core_assign_on_id(s,index,new_job_ptr);
+    return index;
+  }
+  else if(scheme_is_preempt(s)){
+    index = core_preempt(s,new_job_ptr);
+    if(index == -1) priqueue_offer(&s->job_queue,new_job_ptr);
+    return index;
+  }else{
+    priqueue_offer(&s->job_queue,new_job_ptr);
+    return -1;
+  }
+}
+
+
+// feed a finished job into the distributions and hand its record to the callback
+void record_job(scheduler_t *s, job_t *job_ptr)
+{
+  scheduler_job_record_t record;
+  record.job_number = job_ptr -> job_number;
+  record.arrival_time = job_ptr -> arrival_time;
+  record.running_time = job_ptr -> running_time;
+  record.priority = job_ptr -> priority;
+  record.first_run_time = (job_ptr->first_time_on_core == -1) ? get_now(s) : job_ptr->first_time_on_core;
+  record.finish_time = get_now(s);
+  record.waiting_time = record.finish_time - record.arrival_time - record.running_time;
+  record.response_time = record.first_run_time - record.arrival_time;
+  record.turnaround_time = record.finish_time - record.arrival_time;
+  record.slowdown = (record.running_time > 0) ? (float)record.turnaround_time / record.running_time : 1.0;
+
+  distribution_add(&s->waiting_dist, record.waiting_time);
+  distribution_add(&s->response_dist, record.response_time);
+  distribution_add(&s->turnaround_dist, record.turnaround_time);
+  distribution_add(&s->slowdown_dist, record.slowdown);
+  s -> share_total += 1.0 / record.slowdown;
+  s -> share_squares += 1.0 / ((double)record.slowdown * record.slowdown);
+
+  if(s->options.job_callback != NULL) s->options.job_callback(&record, s->options.job_callback_arg);
+}
+
+
+/** scheduler_job_finished() for the scheduler s. */
+int sched_job_finished(scheduler_t *s, int core_id, int job_number, int time)
+{
+	update_time(s,time);
+  job_t * job_ptr = core_job_take_on_id(s,core_id,job_number);
+
+  insert_wait(s, get_now(s) - job_ptr->arrival_time - job_ptr->running_time);
+  insert_turnaround(s, get_now(s) - job_ptr->arrival_time);
+  record_job(s,job_ptr);
+
+  destroy_job(s,job_ptr);
+
+  job_ptr = queue_next_for(s,core_id);
+  if(job_ptr){
+    core_assign_on_id(s,core_id,job_ptr);
+    return job_ptr -> job_number;
+  }
+
+  return -1;
+}
+
+
+/** scheduler_quantum_expired() for the scheduler s. */
+int sched_quantum_expired(scheduler_t *s, int core_id, int time)
+{
+	update_time(s,time);
+  job_t *expired = s->core.job_in_cores[core_id];
+  core_sync(s,core_id);
+  if(s->applied_schema == MLFQ){
+    // used its whole allotment: move down a level
+    if(expired -> level < s->options.mlfq_levels - 1) expired -> level ++;
+    expired -> quantum_left = s->options.mlfq_quanta[expired->level];
+  }else if(s->applied_schema == STRIDE){
+    expired -> pass += expired -> stride;
+  }
+  core_job_remove_on_id(s,core_id,expired->job_number);
+
+  job_t *job_ptr = queue_next_for(s,core_id);
+  if(job_ptr){
+    core_assign_on_id(s,core_id,job_ptr);
+    return job_ptr -> job_number;
+  }
+
+  return -1;
+}
+
+
+/** scheduler_quantum() for the scheduler s. */
+int sched_quantum(scheduler_t *s, int core_id)
+{
+  job_t *job_ptr = s->core.job_in_cores[core_id];
+  if(job_ptr == NULL) return 0;
+  if(s->applied_schema == MLFQ) return job_ptr -> quantum_left;
+  if(s->applied_schema == STRIDE) return s->options.stride_quantum;
+  return 0;
+}
+
+
+/** scheduler_migrations() for the scheduler s. */
+int sched_migrations(scheduler_t *s)
+{
+  return s -> migrations;
+}
+
+
+/** scheduler_metrics() for the scheduler s. */
+void sched_metrics(scheduler_t *s, scheduler_metrics_t *metrics)
+{
+  metrics -> jobs = s->waiting_dist.count;
+  distribution_report(&s->waiting_dist, &metrics->waiting);
+  distribution_report(&s->response_dist, &metrics->response);
+  distribution_report(&s->turnaround_dist, &metrics->turnaround);
+  distribution_report(&s->slowdown_dist, &metrics->slowdown);
+  metrics -> fairness = (s->share_squares == 0) ? 1.0 :
+                          s->share_total * s->share_total / (s->waiting_dist.count * s->share_squares);
+}
+
+
+/** scheduler_average_waiting_time() for the scheduler s. */
+float sched_average_waiting_time(scheduler_t *s)
+{
+	return (s->num_wait == 0) ? 0.0 : (float)s->total_wait/s->num_wait;
+}
+
+
+/** scheduler_average_turnaround_time() for the scheduler s. */
+float sched_average_turnaround_time(scheduler_t *s)
+{
+	return (s->num_turnaround==0) ? 0.0 : (float)s->total_turnaround/s->num_turnaround;
+}
+
+
+/** scheduler_average_response_time() for the scheduler s. */
+float sched_average_response_time(scheduler_t *s)
+{
+	return (s->num_response == 0) ? 0.0 : (float)s->total_response/s->num_response;
+}
+
+
+/** Frees a scheduler made by sched_create() and every job it still holds. */
+void sched_destroy(scheduler_t *s)
+{
+  void *p = NULL;
+  while( (p = priqueue_poll(&s->job_queue)) != NULL ) destroy_job(s,(job_t*)p);
+  if(s->options.queue_mode != QUEUE_GLOBAL){
+    int i;
+    for(i=0;i<s->core.num_cores;i++){
+      while( (p = priqueue_poll(&s->core_queues[i])) != NULL ) destroy_job(s,(job_t*)p);
+      priqueue_destroy(&s->core_queues[i]);
+    }
+    priqueue_destroy(&s->by_load);
+    priqueue_destroy(&s->by_backlog);
+    free(s->core_queues);
+    free(s->loads);
+  }
+  core_destroy(&s->core);
+  priqueue_destroy(&s->job_queue);
+  priqueue_destroy(&s->demoted);
+  job_pool_destroy(s);
+  free(s);
+}
+
+
+/*
+  The scheduler_*() functions below drive one scheduler, created by
+  scheduler_start_up() from the options the scheduler_configure_*()
+  functions have collected.
+*/
+static scheduler_t *the_scheduler = NULL;
+static scheduler_options_t configured = {
+  .mlfq_levels = 3, .mlfq_quanta = {1, 2, 4}, .mlfq_boost_period = 20,
+  .stride_quantum = 2, .queue_mode = QUEUE_GLOBAL,
+  .job_callback = NULL, .job_callback_arg = NULL
+};
+static void (*job_callback)(const scheduler_job_record_t *) = NULL;
+
+static void call_job_callback(const scheduler_job_record_t *record, void *arg)
+{
+  (void)arg;
+  job_callback(record);
+}
+
+
+/**
+  Sets up the multi-level feedback queue used by the MLFQ scheme.
+
+  A new job enters level 0.  A job that uses up its allotment at a level
+  moves down one level; a job that is preempted keeps what is left of it.
+  A job at a higher level (lower number) preempts one at a lower level, and
+  within a level jobs run in the order they were queued.
+
+  Call before scheduler_start_up().  The default is 3 levels with quanta
+  1, 2 and 4, boosted every 20 time units.
+
+  @param levels the number of levels, 1 to MLFQ_MAX_LEVELS
+  @param quanta the allotment of each level, starting with level 0
+  @param boost_period every boost_period time units all jobs return to level 0; 0 never boosts
+*/
+void scheduler_configure_mlfq(int levels, const int *quanta, int boost_period)
+{
+  int i;
+  if(levels < 1 || levels > MLFQ_MAX_LEVELS){
+    ERROROUT("invalid number of levels.");
+    exit(1);
+  }
+  configured.mlfq_levels = levels;
+  for(i=0;i<levels;i++) configured.mlfq_quanta[i] = quanta[i];
+  configured.mlfq_boost_period = boost_period;
+}
+
+
+/**
+  Sets the time slice used by the STRIDE scheme.
+
+  STRIDE gives each job tickets from its priority (100 / (priority + 1)) and
+  always runs the job that has consumed the least virtual time (its pass);
+  each slice a job uses advances its pass by 2^20 / tickets, so over time
+  jobs get the CPU in proportion to their tickets.  New jobs start at the
+  pass of the last job dispatched, so they cannot monopolize the cores.
+
+  Call before scheduler_start_up().  The default slice is 2.
+
+  @param quantum time units a job runs before scheduler_quantum_expired() is due
+*/
+void scheduler_configure_stride(int quantum)
+{
+  configured.stride_quantum = quantum;
+}
+
+
+/**
+  Selects between one run queue shared by all cores (the default) and a run
+  queue per core.
+
+  With per-core queues an arriving job is placed on a core chosen by the
+  affinity policy: QUEUE_PER_CORE_RR deals arrivals to the cores in turn,
+  QUEUE_PER_CORE_LEAST picks the core holding the fewest jobs.  It runs there
+  if that core is idle, else on the lowest-id idle core, else it may preempt
+  the job on its core, else it waits in that core's queue.  A core that
+  becomes free takes the head of its own queue, or steals the head of the
+  longest queue when its own is empty.  Preemption compares only against the
+  job on the chosen core.
+
+  Every job that ends up on a core other than the one it was placed on counts
+  as a migration, see scheduler_migrations().
+
+  Call before scheduler_start_up().
+
+  @param mode QUEUE_GLOBAL, QUEUE_PER_CORE_RR or QUEUE_PER_CORE_LEAST
+*/
+void scheduler_configure_queues(queue_mode_t mode)
+{
+  configured.queue_mode = mode;
+}
+
+
+/**
+  Sets a function to be called with the record of each job as it finishes,
+  or NULL for none.  Records are not kept by the scheduler.
+*/
+void scheduler_set_job_callback(void (*callback)(const scheduler_job_record_t *record))
+{
+  job_callback = callback;
+  configured.job_callback = (callback != NULL) ? call_job_callback : NULL;
+}
+
+
 /**
   Initalizes the scheduler.
- 
+
   Assumptions:
     - You may assume this will be the first scheduler function called.
     - You may assume this function will be called once once.
@@ -247,21 +1046,17 @@ int comparer(const void * job1_ptr, const void * job2_ptr)
     - You may assume that scheme is a valid scheduling scheme.
 
   @param cores the number of cores that is available by the scheduler. These cores will be known as core(id=0), core(id=1), ..., core(id=cores-1).
-  @param scheme  the scheduling scheme that should be used. This value will be one of the six enum values of scheme_t
+  @param scheme  the scheduling scheme that should be used. This value will be one of the enum values of scheme_t
 */
 void scheduler_start_up(int cores, scheme_t scheme)
 {
-  applied_schema = scheme;
-  job_queue_ptr = (priqueue_t*)malloc(sizeof(priqueue_t));
-  priqueue_init(job_queue_ptr,&comparer);
-  core_init(&core, cores);
-  update_time(0);
+  the_scheduler = sched_create(cores, scheme, &configured);
 }
 
 
 /**
   Called when a new job arrives.
- 
+
   If multiple cores are idle, the job should be assigned to the core with the
   lowest id.
   If the job arriving should be scheduled to run during the next
@@ -276,46 +1071,23 @@ void scheduler_start_up(int cores, scheme_t scheme)
   @param running_time the total number of time units this job will run before it will be finished.
   @param priority the priority of the job. (The lower the value, the higher the priority.)
   @return index of core job should be scheduled on
-  @return -1 if no scheduling changes should be made. 
- 
+  @return -1 if no scheduling changes should be made.
+
  */
 int scheduler_new_job(int job_number, int time, int running_time, int priority)
 {
-	update_time(time);
-  job_t* new_job_ptr = new_job();
-  new_job_ptr -> job_number = job_number;
-  new_job_ptr -> arrival_time = time;
-  new_job_ptr -> running_time = running_time;
-  new_job_ptr -> remaining_time = running_time;
-  new_job_ptr -> priority = priority;
-  new_job_ptr -> first_time_on_core = -1;
-  new_job_ptr -> last_update_time_on_core = -1;
-
-  int index;
-
-  if( (index = core_available()) != -1 ){
-    core_assign_on_id(index,new_job_ptr);
-    return index;
-  }
-  else if(scheme_is_preempt()){
-    index = core_preempt(new_job_ptr);
-    if(index == -1) priqueue_offer(job_queue_ptr,new_job_ptr);
-    return index;
-  }else{
-    priqueue_offer(job_queue_ptr,new_job_ptr);
-    return -1;
-  }
+  return sched_new_job(the_scheduler, job_number, time, running_time, priority);
 }
 
 
 /**
   Called when a job has completed execution.
- 
+
   The core_id, job_number and time parameters are provided for convenience. You may be able to calculate the values with your own data structure.
   If any job should be scheduled to run on the core free'd up by the
   finished job, return the job_number of the job that should be scheduled to
   run on core core_id.
- 
+
   @param core_id the zero-based index of the core where the job was located.
   @param job_number a globally unique identification number of the job.
   @param time the current time of the simulator.
@@ -324,50 +1096,68 @@ int scheduler_new_job(int job_number, int time, int running_time, int priority)
  */
 int scheduler_job_finished(int core_id, int job_number, int time)
 {
-	update_time(time);
-  job_t * job_ptr = core_job_remove_on_id(core_id,job_number);
-  priqueue_remove(job_queue_ptr,job_ptr);
-
-  insert_wait(get_now() - job_ptr->arrival_time - job_ptr->running_time);
-  insert_turnaround(get_now() - job_ptr->arrival_time);
-
-  destroy_job(job_ptr);
-
-  job_ptr = priqueue_poll(job_queue_ptr);
-  if(job_ptr){
-    core_assign_on_id(core_id,job_ptr);
-    return job_ptr -> job_number;
-  }
-
-  return -1;
+  return sched_job_finished(the_scheduler, core_id, job_number, time);
 }
 
 
 /**
   When the scheme is set to RR, called when the quantum timer has expired
-  on a core.
- 
+  on a core.  For MLFQ and STRIDE, called when the job on a core has run
+  for the time scheduler_quantum() gave it.
+
   If any job should be scheduled to run on the core free'd up by
   the quantum expiration, return the job_number of the job that should be
   scheduled to run on core core_id.
 
   @param core_id the zero-based index of the core where the quantum has expired.
-  @param time the current time of the simulator. 
+  @param time the current time of the simulator.
   @return job_number of the job that should be scheduled on core cord_id
   @return -1 if core should remain idle
  */
 int scheduler_quantum_expired(int core_id, int time)
 {
-	update_time(time);
-  core_job_remove_on_id(core_id,core.job_in_cores[core_id]->job_number);
+  return sched_quantum_expired(the_scheduler, core_id, time);
+}
 
-  job_t *job_ptr = priqueue_poll(job_queue_ptr);
-  if(job_ptr){
-    core_assign_on_id(core_id,job_ptr);
-    return job_ptr -> job_number;
-  }
 
-  return -1;
+/**
+  Returns how long the job on core_id may run before scheduler_quantum_expired()
+  should be called for that core.  RR quanta stay with the caller.
+
+  @param core_id the zero-based index of a core
+  @return the time slice of the job on core_id
+  @return 0 if the core is idle or the scheme has no time slices
+ */
+int scheduler_quantum(int core_id)
+{
+  return sched_quantum(the_scheduler, core_id);
+}
+
+
+/**
+  Returns how many times a job ran on a core other than the one it was
+  placed on.  Always 0 with a global queue.
+ */
+int scheduler_migrations()
+{
+  return sched_migrations(the_scheduler);
+}
+
+
+/**
+  Reports the mean, median, 95th and 99th percentile and maximum of the
+  waiting, response and turnaround times and the slowdown of every job
+  that has finished, plus Jain's fairness index over each job's share
+  (running time / turnaround).
+
+  Percentiles are P-square estimates kept in constant memory; they are
+  exact up to five jobs and close after that.
+
+  @param metrics filled in with the summary
+ */
+void scheduler_metrics(scheduler_metrics_t *metrics)
+{
+  sched_metrics(the_scheduler, metrics);
 }
 
 
@@ -380,7 +1170,7 @@ int scheduler_quantum_expired(int core_id, int time)
  */
 float scheduler_average_waiting_time()
 {
-	return (num_wait == 0) ? 0.0 : (float)total_wait/num_wait;
+	return sched_average_waiting_time(the_scheduler);
 }
 
 
@@ -393,7 +1183,7 @@ float scheduler_average_waiting_time()
  */
 float scheduler_average_turnaround_time()
 {
-	return (num_turnaround==0) ? 0.0 : (float)total_turnaround/num_turnaround;
+	return sched_average_turnaround_time(the_scheduler);
 }
 
 
@@ -406,23 +1196,20 @@ float scheduler_average_turnaround_time()
  */
 float scheduler_average_response_time()
 {
-	return (num_response == 0) ? 0.0 : (float)total_response/num_response;
+	return sched_average_response_time(the_scheduler);
 }
 
 
 /**
   Free any memory associated with your scheduler.
- 
+
   Assumptions:
     - This function will be the last function called in your library.
 */
 void scheduler_clean_up()
 {
-  void *p = NULL;
-  while( (p = priqueue_poll(job_queue_ptr)) != NULL ) destroy_job((job_t*)p);
-  core_destroy(&core);
-  priqueue_destroy(job_queue_ptr);
-  free(job_queue_ptr);
+  sched_destroy(the_scheduler);
+  the_scheduler = NULL;
 }
 
 
@@ -432,8 +1219,8 @@ void scheduler_clean_up()
   makes to your scheduler.
   In our provided output, we have implemented this function to list the jobs in the order they are to be scheduled. Furthermore, we have also listed the current state of the job (either running on a given core or idle). For example, if we have a non-preemptive algorithm and job(id=4) has began running, job(id=2) arrives with a higher priority, and job(id=1) arrives with a lower priority, the output in our sample output will be:
 
-    2(-1) 4(0) 1(-1)  
-  
+    2(-1) 4(0) 1(-1)
+
   This function is not required and will not be graded. You may leave it
   blank if you do not find it useful.
  */
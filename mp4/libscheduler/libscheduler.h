@@ -7,19 +7,105 @@
 /**
   Constants which represent the different scheduling algorithms
 */
-typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR} scheme_t;
+typedef enum {FCFS = 0, SJF, PSJF, PRI, PPRI, RR, MLFQ, STRIDE} scheme_t;
+
+/**
+  Run queue layouts, see scheduler_configure_queues()
+*/
+typedef enum {QUEUE_GLOBAL = 0, QUEUE_PER_CORE_RR, QUEUE_PER_CORE_LEAST} queue_mode_t;
+
+/** Most levels a multi-level feedback queue may have. */
+#define MLFQ_MAX_LEVELS 16
+
+void  scheduler_configure_mlfq         (int levels, const int *quanta, int boost_period);
+void  scheduler_configure_stride       (int quantum);
+void  scheduler_configure_queues       (queue_mode_t mode);
+
+/**
+  What happened to one job, passed to the callback set with
+  scheduler_set_job_callback() when the job finishes.
+*/
+typedef struct _scheduler_job_record_t
+{
+  int job_number;
+  int arrival_time;
+  int running_time;
+  int priority;
+  int first_run_time;   ///< time the job first ran on a core
+  int finish_time;
+  int waiting_time;     ///< finish - arrival - running time
+  int response_time;    ///< first run - arrival
+  int turnaround_time;  ///< finish - arrival
+  float slowdown;       ///< turnaround / running time
+} scheduler_job_record_t;
+
+/** Summary of one per-job quantity over all finished jobs. */
+typedef struct _scheduler_distribution_t
+{
+  float mean, p50, p95, p99, max;
+} scheduler_distribution_t;
+
+/** Everything scheduler_metrics() reports. */
+typedef struct _scheduler_metrics_t
+{
+  int jobs;
+  scheduler_distribution_t waiting, response, turnaround, slowdown;
+  float fairness;       ///< Jain's index over running time / turnaround, 1 is perfectly fair
+} scheduler_metrics_t;
+
+void  scheduler_set_job_callback       (void (*callback)(const scheduler_job_record_t *record));
+
+/**
+  How a scheduler is set up, beyond its cores and scheme.  The
+  scheduler_configure_*() functions fill these in for scheduler_start_up();
+  see them for what each field does.
+*/
+typedef struct _scheduler_options_t
+{
+  int mlfq_levels;
+  int mlfq_quanta[MLFQ_MAX_LEVELS];
+  int mlfq_boost_period;
+  int stride_quantum;
+  queue_mode_t queue_mode;
+  void (*job_callback)(const scheduler_job_record_t *record, void *arg);
+  void *job_callback_arg;   ///< passed to job_callback
+} scheduler_options_t;
+
+void  scheduler_default_options        (scheduler_options_t *options);
 
 void  scheduler_start_up               (int cores, scheme_t scheme);
 int   scheduler_new_job                (int job_number, int time, int running_time, int priority);
 int   scheduler_job_finished           (int core_id, int job_number, int time);
 int   scheduler_quantum_expired        (int core_id, int time);
+int   scheduler_quantum                (int core_id);
 float scheduler_average_turnaround_time();
 float scheduler_average_waiting_time   ();
 float scheduler_average_response_time  ();
+int   scheduler_migrations             ();
+void  scheduler_metrics                (scheduler_metrics_t *metrics);
 void  scheduler_clean_up               ();
 
 void  scheduler_show_queue             ();
 
+/**
+  One scheduler instance.  The scheduler_*() functions above drive a single
+  instance behind the scenes; the sched_*() functions below take the
+  instance explicitly, so any number can run side by side, one per thread.
+*/
+typedef struct _scheduler_t scheduler_t;
+
+scheduler_t *sched_create              (int cores, scheme_t scheme, const scheduler_options_t *options);
+int   sched_new_job                    (scheduler_t *s, int job_number, int time, int running_time, int priority);
+int   sched_job_finished               (scheduler_t *s, int core_id, int job_number, int time);
+int   sched_quantum_expired            (scheduler_t *s, int core_id, int time);
+int   sched_quantum                    (scheduler_t *s, int core_id);
+float sched_average_turnaround_time    (scheduler_t *s);
+float sched_average_waiting_time       (scheduler_t *s);
+float sched_average_response_time      (scheduler_t *s);
+int   sched_migrations                 (scheduler_t *s);
+void  sched_metrics                    (scheduler_t *s, scheduler_metrics_t *metrics);
+void  sched_destroy                    (scheduler_t *s);
+
 
 
 
@@ -0,0 +1,183 @@
+/** @file queuebench.c
+ *
+ * Times the operations the schedulers lean on: offering jobs in arrival
+ * order, polling them in priority order, and dropping a job from the middle
+ * of the queue when it is preempted or finishes.  The heap's removals go
+ * through handles, the list's through a search for the pointer, as each
+ * engine does it in libscheduler.  Usage: ./queuebench [elements]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "libpriqueue/libpriqueue.h"
+
+/*
+  libpriqueue before the 4-ary heap: a singly linked list kept sorted on
+  insertion, so an offer walks past every element that compares lower and a
+  removal scans for the pointer.
+*/
+typedef struct _list_node_t
+{
+	void *obj;
+	struct _list_node_t *next;
+} list_node_t;
+
+typedef struct _list_queue_t
+{
+	int size;
+	list_node_t *head;
+	int (*comp)(const void *, const void *);
+} list_queue_t;
+
+static void list_init(list_queue_t *q, int (*comp)(const void *, const void *))
+{
+	q->size = 0;
+	q->head = NULL;
+	q->comp = comp;
+}
+
+static void list_offer(list_queue_t *q, void *ptr)
+{
+	list_node_t *node = malloc(sizeof(list_node_t));
+	list_node_t **link = &q->head;
+	node->obj = ptr;
+	while (*link != NULL && q->comp(ptr, (*link)->obj) >= 0)
+		link = &(*link)->next;
+	node->next = *link;
+	*link = node;
+	q->size++;
+}
+
+static void *list_poll(list_queue_t *q)
+{
+	list_node_t *node = q->head;
+	void *obj;
+	if (node == NULL)
+		return NULL;
+	q->head = node->next;
+	q->size--;
+	obj = node->obj;
+	free(node);
+	return obj;
+}
+
+static int list_remove(list_queue_t *q, void *ptr)
+{
+	list_node_t **link = &q->head;
+	int removed = 0;
+	while (*link != NULL)
+	{
+		if ((*link)->obj == ptr)
+		{
+			list_node_t *node = *link;
+			*link = node->next;
+			free(node);
+			q->size--;
+			removed++;
+		}
+		else
+			link = &(*link)->next;
+	}
+	return removed;
+}
+
+
+static int compare_int(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+static double seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	int n = (argc > 1) ? atoi(argv[1]) : 20000;
+	int i, checksum_list = 0, checksum_heap = 0;
+	int *values;
+	pq_handle_t *handles;
+	list_queue_t lq;
+	priqueue_t hq;
+	double t, t_list_fill, t_list_drain, t_list_remove, t_heap_fill, t_heap_drain, t_heap_remove;
+
+	if (n <= 0)
+	{
+		fprintf(stderr, "Usage: %s [elements]\n", argv[0]);
+		return 1;
+	}
+
+	values = malloc(n * sizeof(int));
+	handles = malloc(n * sizeof(pq_handle_t));
+	srand(241);
+	for (i = 0; i < n; i++)
+		values[i] = rand() % (n * 4);
+
+	list_init(&lq, compare_int);
+	priqueue_init(&hq, compare_int);
+	priqueue_set_fast(&hq, 1);
+
+	/* offer n, then poll n */
+	t = seconds();
+	for (i = 0; i < n; i++)
+		list_offer(&lq, &values[i]);
+	t_list_fill = seconds() - t;
+	t = seconds();
+	for (i = 0; i < n; i++)
+		checksum_list = checksum_list * 31 + *(int *)list_poll(&lq);
+	t_list_drain = seconds() - t;
+
+	t = seconds();
+	for (i = 0; i < n; i++)
+		priqueue_offer(&hq, &values[i]);
+	t_heap_fill = seconds() - t;
+	t = seconds();
+	for (i = 0; i < n; i++)
+		checksum_heap = checksum_heap * 31 + *(int *)priqueue_poll(&hq);
+	t_heap_drain = seconds() - t;
+
+	if (checksum_list != checksum_heap)
+	{
+		fprintf(stderr, "Order mismatch between the list and the heap.\n");
+		return 2;
+	}
+
+	/* fill, then remove every other element by identity */
+	for (i = 0; i < n; i++)
+		list_offer(&lq, &values[i]);
+	t = seconds();
+	for (i = 0; i < n; i += 2)
+		list_remove(&lq, &values[i]);
+	t_list_remove = seconds() - t;
+
+	for (i = 0; i < n; i++)
+		handles[i] = priqueue_push(&hq, &values[i]);
+	t = seconds();
+	for (i = 0; i < n; i += 2)
+		priqueue_remove_handle(&hq, handles[i]);
+	t_heap_remove = seconds() - t;
+
+	if (lq.size != priqueue_size(&hq))
+	{
+		fprintf(stderr, "Size mismatch after removals.\n");
+		return 2;
+	}
+
+	printf("%d elements            list        heap     speedup\n", n);
+	printf("offer all       %10.4fs %10.4fs %10.1fx\n", t_list_fill, t_heap_fill, t_list_fill / t_heap_fill);
+	printf("poll all        %10.4fs %10.4fs %10.1fx\n", t_list_drain, t_heap_drain, t_list_drain / t_heap_drain);
+	printf("remove half     %10.4fs %10.4fs %10.1fx\n", t_list_remove, t_heap_remove, t_list_remove / t_heap_remove);
+
+	while (list_poll(&lq) != NULL)
+		;
+	priqueue_destroy(&hq);
+	free(handles);
+	free(values);
+
+	return 0;
+}
@@ -65,6 +65,25 @@ int main()
 		printf("%d ", *((int *)priqueue_at(&q2, i)) );
 	printf("\n");
 
+	printf("Removed at index 2: %d (expected 14).\n", *((int *)priqueue_remove_at(&q, 2)) );
+	printf("Elements in order queue (expected 10 13 20 30): ");
+	for (i = 0; i < priqueue_size(&q); i++)
+		printf("%d ", *((int *)priqueue_at(&q, i)) );
+	printf("\n");
+
+	/* Handles stay valid while other elements come and go. */
+	pq_handle_t h40 = priqueue_push(&q2, &values[40]);
+	pq_handle_t h5 = priqueue_push(&q2, &values[5]);
+	priqueue_poll(&q2);
+	printf("Removed by handle: %d (expected 5).\n", *((int *)priqueue_remove_handle(&q2, h5)) );
+	printf("Stale handle: %p (expected (nil)).\n", priqueue_remove_handle(&q2, h5));
+	printf("Offer at index: %d (expected 1).\n", priqueue_offer(&q2, &values[25]));
+	printf("Elements in reverse order queue (expected 30 25 20 10): ");
+	for (i = 0; i < priqueue_size(&q2); i++)
+		printf("%d ", *((int *)priqueue_at(&q2, i)) );
+	printf("\n");
+	(void)h40;
+
 	priqueue_destroy(&q2);
 	priqueue_destroy(&q);
 
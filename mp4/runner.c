@@ -0,0 +1,272 @@
+/** @file runner.c
+ *
+ * Runs a job file for real on a pool of worker threads scheduled by
+ * libscheduler, and prints the measured averages.  Usage: see print_usage().
+ *
+ * Each job of the file becomes a task submitted at its arrival time.  A
+ * CPU-bound task spins until it has used its running time of CPU; an
+ * I/O-bound one alternates a little computation with sleeping, holding its
+ * worker while it sleeps, until its running time has passed.  Times are
+ * printed in ticks, the simulator's time units, so the output lines up
+ * with what `simulator` predicts for the same file.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "librunner/librunner.h"
+#include "jobfile.h"
+
+#define YIELDS_PER_TICK 4	// CPU-bound: yield points per tick of work
+#define IO_COMPUTE_PERCENT 10	// I/O-bound: share of each step spent computing
+
+typedef struct _runner_job_t
+{
+	int job_id, arrival_time, run_time, priority;
+	int io_bound;
+	long long left;		// microseconds of work left; CPU time if CPU-bound
+	int task;
+} runner_job_t;
+
+static int tick_usec;
+
+
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s -c <workers> -s <scheme> [-m <quanta>] [-b <period>] [-a rr|least] [-u <usec>] [-i <percent>] <input file>\n", program_name);
+	fprintf(stderr, "       %s -c 2 -s rr2 -i 50 examples/proc1.csv\n", program_name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#, mlfq, stride#\n");
+	fprintf(stderr, "  -m  mlfq: comma-separated quantum of each level, highest first (default 1,2,4)\n");
+	fprintf(stderr, "  -b  mlfq: boost every job to the top level every <period> ticks, 0 for never (default 20)\n");
+	fprintf(stderr, "  -a  give each worker its own run queue, placing arriving jobs round-robin or on the least loaded worker\n");
+	fprintf(stderr, "  -u  length of a tick in microseconds (default 1000)\n");
+	fprintf(stderr, "  -i  percentage of jobs that are I/O-bound rather than CPU-bound (default 0)\n");
+}
+
+
+static long long usec(clockid_t clock)
+{
+	struct timespec ts;
+	clock_gettime(clock, &ts);
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* One yield point's worth of CPU-bound work: spin for a fraction of a tick of CPU time. */
+static int cpu_step(void *arg)
+{
+	runner_job_t *job = arg;
+	long long chunk = tick_usec / YIELDS_PER_TICK;
+	long long start = usec(CLOCK_THREAD_CPUTIME_ID), used;
+
+	if (chunk < 1)
+		chunk = 1;
+	if (chunk > job->left)
+		chunk = job->left;
+	while ((used = usec(CLOCK_THREAD_CPUTIME_ID) - start) < chunk)
+		;
+	return (job->left -= used) <= 0;
+}
+
+/* One request's worth of I/O-bound work: compute briefly, then wait on the "device" for the rest of a tick. */
+static int io_step(void *arg)
+{
+	runner_job_t *job = arg;
+	long long chunk = (tick_usec < job->left) ? tick_usec : job->left;
+	long long start = usec(CLOCK_MONOTONIC), compute = chunk * IO_COMPUTE_PERCENT / 100;
+
+	while (usec(CLOCK_MONOTONIC) - start < compute)
+		;
+	if (chunk > compute)
+		usleep(chunk - compute);
+	return (job->left -= usec(CLOCK_MONOTONIC) - start) <= 0;
+}
+
+
+/* Prints one row of averages over the jobs with io_bound == which, or all of them if which is -1. */
+static void print_row(const char *name, runner_t *runner, runner_job_t *jobs, int jobs_ct, int which)
+{
+	double waiting = 0, turnaround = 0, response = 0;
+	int i, n = 0, preemptions = 0;
+
+	for (i = 0; i < jobs_ct; i++)
+	{
+		if (which != -1 && jobs[i].io_bound != which)
+			continue;
+		const runner_task_record_t *r = runner_record(runner, jobs[i].task);
+		turnaround += r->finished - r->submitted;
+		waiting += r->finished - r->submitted - r->ran;
+		response += r->started - r->submitted;
+		preemptions += r->preemptions;
+		n++;
+	}
+	if (n == 0)
+		return;
+	printf("%-6s %6d %10.2f %10.2f %10.2f %12d\n", name, n, waiting / n / tick_usec, turnaround / n / tick_usec,
+			response / n / tick_usec, preemptions);
+}
+
+int main(int argc, char **argv)
+{
+	runner_options_t options;
+	scheme_t scheme = FCFS;
+	int workers = 0, quantum = 0, io_percent = 0;
+	const char *scheme_name = NULL;
+	int c, i;
+
+	runner_default_options(&options);
+
+	while ((c = getopt(argc, argv, "c:s:m:b:a:u:i:")) != -1)
+	{
+		switch (c)
+		{
+			case 'c':
+				if ((workers = atoi(optarg)) <= 0)
+				{
+					fprintf(stderr, "Option -c <workers> requires a positive number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 's':
+				if (jobfile_parse_scheme(optarg, &scheme, &quantum) != 1)
+				{
+					fprintf(stderr, "Unknown scheme \"%s\".\n", optarg);
+					print_usage(argv[0]);
+					return 1;
+				}
+				scheme_name = optarg;
+				break;
+
+			case 'm':
+				if ((options.scheduler.mlfq_levels = jobfile_parse_quanta(optarg, options.scheduler.mlfq_quanta)) == 0)
+				{
+					fprintf(stderr, "Option -m <quanta> requires 1 to %d positive numbers. (Eg: -m 1,2,4)\n", MLFQ_MAX_LEVELS);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'b':
+				if ((options.scheduler.mlfq_boost_period = atoi(optarg)) < 0)
+				{
+					fprintf(stderr, "Option -b <period> requires a non-negative number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'a':
+				if (strcasecmp(optarg, "rr") == 0) { options.scheduler.queue_mode = QUEUE_PER_CORE_RR; }
+				else if (strcasecmp(optarg, "least") == 0) { options.scheduler.queue_mode = QUEUE_PER_CORE_LEAST; }
+				else
+				{
+					fprintf(stderr, "Option -a requires rr or least.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'u':
+				if ((options.tick_usec = atoi(optarg)) <= 0)
+				{
+					fprintf(stderr, "Option -u <usec> requires a positive number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'i':
+				if ((io_percent = atoi(optarg)) < 0 || io_percent > 100)
+				{
+					fprintf(stderr, "Option -i <percent> requires a number from 0 to 100.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (workers == 0 || scheme_name == NULL || optind != argc - 1)
+	{
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	FILE *file = fopen(argv[optind], "r");
+	jobfile_job_t *read;
+	runner_job_t *jobs;
+	int jobs_ct;
+	if (file == NULL)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", argv[optind]);
+		return 2;
+	}
+	if ((jobs_ct = jobfile_read_all(file, &read)) == -1)
+	{
+		fprintf(stderr, "Illegal file format.\n");
+		return 2;
+	}
+	fclose(file);
+
+	tick_usec = options.tick_usec;
+	options.rr_quantum = quantum;
+	options.scheduler.stride_quantum = quantum;
+	jobs = malloc((jobs_ct + 1) * sizeof(runner_job_t));
+	for (i = 0; i < jobs_ct; i++)
+	{
+		jobs[i].job_id = read[i].job_id;
+		jobs[i].arrival_time = read[i].arrival_time;
+		jobs[i].run_time = read[i].run_time;
+		jobs[i].priority = read[i].priority;
+		// spread the I/O-bound jobs evenly through the file
+		jobs[i].io_bound = (jobs[i].job_id + 1) * io_percent / 100 > jobs[i].job_id * io_percent / 100;
+		jobs[i].left = (long long)jobs[i].run_time * tick_usec;
+	}
+	free(read);
+
+	runner_t *runner = runner_create(workers, scheme, &options);
+	if (runner == NULL)
+	{
+		fprintf(stderr, "Unable to start the workers.\n");
+		return 3;
+	}
+
+	/*
+	 * Submit each job at its arrival time, then wait for them all.
+	 */
+	for (i = 0; i < jobs_ct; i++)
+	{
+		long long delay = (long long)jobs[i].arrival_time * tick_usec - runner_now(runner);
+		if (delay > 0)
+			usleep(delay);
+		jobs[i].task = runner_submit(runner, jobs[i].io_bound ? io_step : cpu_step, &jobs[i], jobs[i].run_time, jobs[i].priority);
+	}
+	runner_wait(runner);
+	long long makespan = runner_now(runner);
+
+	printf("Ran %d job(s) from \"%s\" on %d worker(s) using %s in %.3fs (%.2f ticks of %d usec).\n\n",
+			jobs_ct, argv[optind], workers, scheme_name, makespan / 1e6,
+			(double)makespan / tick_usec, tick_usec);
+
+	printf("jobs    count    waiting turnaround   response  preemptions\n");
+	print_row("all", runner, jobs, jobs_ct, -1);
+	if (io_percent > 0 && io_percent < 100)
+	{
+		print_row("cpu", runner, jobs, jobs_ct, 0);
+		print_row("io", runner, jobs, jobs_ct, 1);
+	}
+
+	runner_destroy(runner);
+	free(jobs);
+
+	return 0;
+}
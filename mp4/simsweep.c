@@ -0,0 +1,461 @@
+/** @file simsweep.c
+ *
+ * Runs one job file through every combination of core count, scheme and
+ * queue layout, several simulations at a time, and prints one row per
+ * combination.  Usage: see print_usage().
+ *
+ * Each simulation has its own scheduler_t, so the combinations run in
+ * parallel threads in one process.  A simulation follows the same rules as
+ * `simulator -t`, and gives the same averages for a file sorted by arrival
+ * time.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <pthread.h>
+#include <time.h>
+
+#include "libscheduler/libscheduler.h"
+#include "jobfile.h"
+#include "engine.h"
+
+#define MAX_LIST 64
+
+/* One combination to simulate, and what came of it. */
+typedef struct _sweep_run_t
+{
+	int cores;
+	scheme_t scheme;
+	int quantum;			// RR and STRIDE
+	queue_mode_t queue_mode;
+	const char *scheme_name, *queue_name;
+
+	const char *error;		// NULL if the scheduler behaved
+	int makespan;
+	float waiting, turnaround, response;
+	int migrations;
+	scheduler_metrics_t metrics;
+} sweep_run_t;
+
+/* The state of one simulation. */
+typedef struct _sweep_sim_t
+{
+	scheduler_t *scheduler;
+	const jobfile_job_t *jobs;
+	int *remaining;		// by job id
+	int *slot_of;		// by job id, -1 unless the job has arrived and not finished
+	int *slot_job;		// job id in each slot, in the order simulator.c visits them
+	int *core_of;		// by job id, the core the job last ran on
+	int size;
+	engine_t engine;
+} sweep_sim_t;
+
+static jobfile_job_t *jobs;
+static int jobs_ct;
+static scheduler_options_t options;
+
+static sweep_run_t *runs;
+static int runs_ct, next_run;
+static pthread_mutex_t next_run_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+void print_usage(char *program_name)
+{
+	fprintf(stderr, "Usage: %s [-c <cores,...>] [-s <schemes,...>] [-a <queues,...>] [-m <quanta>] [-b <period>] [-p <threads>] <input file>\n", program_name);
+	fprintf(stderr, "       %s -c 1,2,4 -s fcfs,sjf,rr2 examples/proc1.csv\n", program_name);
+	fprintf(stderr, "\n");
+	fprintf(stderr, "Every combination of the listed core counts, schemes and queue layouts is simulated.\n");
+	fprintf(stderr, "  -c  core counts (default 1,2,4,8)\n");
+	fprintf(stderr, "  -s  schemes: fcfs, sjf, psjf, pri, ppri, rr#, mlfq, stride# (default all, with rr2 and stride2)\n");
+	fprintf(stderr, "  -a  queue layouts: global, rr, least (default global)\n");
+	fprintf(stderr, "  -m  mlfq: comma-separated quantum of each level, highest first (default 1,2,4)\n");
+	fprintf(stderr, "  -b  mlfq: boost period, 0 for never (default 20)\n");
+	fprintf(stderr, "  -p  simulations run at once (default: the number of online processors)\n");
+}
+
+
+/* Splits a comma-separated list in place; returns the number of items, or -1 if there are too many. */
+static int split_list(char *list, char **items)
+{
+	int n = 0;
+	char *token;
+	for (token = strtok(list, ","); token != NULL; token = strtok(NULL, ","))
+	{
+		if (n == MAX_LIST)
+			return -1;
+		items[n++] = token;
+	}
+	return n;
+}
+
+static int parse_queue_mode(const char *name, queue_mode_t *mode)
+{
+	if (strcasecmp(name, "GLOBAL") == 0) { *mode = QUEUE_GLOBAL; }
+	else if (strcasecmp(name, "RR") == 0) { *mode = QUEUE_PER_CORE_RR; }
+	else if (strcasecmp(name, "LEAST") == 0) { *mode = QUEUE_PER_CORE_LEAST; }
+	else
+		return 0;
+	return 1;
+}
+
+
+static int compare_slots(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
+/* Puts job_id (-1 for none) on the core at time. */
+static void core_run(sweep_sim_t *sim, engine_core_t *core, int job_id, int time)
+{
+	if (job_id != -1)
+		sim->core_of[job_id] = core->id;
+	engine_run(&sim->engine, core, job_id, (job_id != -1) ? sim->remaining[job_id] : 0, time);
+}
+
+/* Charges the core's job for the time it has run. */
+static void core_stop(sweep_sim_t *sim, engine_core_t *core, int time)
+{
+	sim->remaining[core->job_id] -= engine_stop(core, time);
+}
+
+static void table_remove_at(sweep_sim_t *sim, int slot)
+{
+	sim->slot_of[sim->slot_job[slot]] = -1;
+	sim->size--;
+	if (slot != sim->size)
+	{
+		sim->slot_job[slot] = sim->slot_job[sim->size];
+		sim->slot_of[sim->slot_job[slot]] = slot;
+	}
+}
+
+static int is_active(sweep_sim_t *sim, int job_id)
+{
+	return job_id >= 0 && job_id < jobs_ct && sim->slot_of[job_id] != -1;
+}
+
+
+/*
+ * Simulates one combination, filling in its results.  The steps and their
+ * order are those of the main loop in simulator.c in trace mode.
+ */
+static void simulate(sweep_run_t *run)
+{
+	sweep_sim_t sim;
+	scheduler_options_t run_options = options;
+	int i, time = 0, next_arrival = 0;
+	int *slots = malloc(run->cores * sizeof(int));
+
+	run_options.queue_mode = run->queue_mode;
+	run_options.stride_quantum = run->quantum;
+	sim.scheduler = sched_create(run->cores, run->scheme, &run_options);
+	sim.remaining = malloc(jobs_ct * sizeof(int));
+	sim.slot_of = malloc(jobs_ct * sizeof(int));
+	sim.slot_job = malloc(jobs_ct * sizeof(int));
+	sim.core_of = malloc(jobs_ct * sizeof(int));
+	sim.size = 0;
+	engine_init(&sim.engine, run->cores, sim.scheduler, (run->scheme == RR) ? run->quantum : 0);
+	run->error = NULL;
+
+	for (i = 0; i < jobs_ct; i++)
+	{
+		sim.remaining[jobs[i].job_id] = jobs[i].run_time;
+		sim.slot_of[i] = -1;
+	}
+
+	while (sim.size > 0 || next_arrival < jobs_ct)
+	{
+		int due_ct = engine_due(&sim.engine, time);
+		engine_core_t *core = sim.engine.core;
+		int *due = sim.engine.due;
+
+		// 1. finished jobs, in slot order
+		int finished = 0;
+		for (i = 0; i < due_ct; i++)
+			if (core[due[i]].job_id != -1 && core[due[i]].finish_at <= time)
+				slots[finished++] = sim.slot_of[core[due[i]].job_id];
+		qsort(slots, finished, sizeof(int), compare_slots);
+
+		int lo = 0, hi = finished;
+		while (lo < hi)
+		{
+			int slot = slots[lo], last = sim.size - 1;
+			int job_id = sim.slot_job[slot];
+			engine_core_t *finished_core = &core[sim.core_of[job_id]];
+
+			int new_job_id = sched_job_finished(sim.scheduler, finished_core->id, job_id, time);
+			table_remove_at(&sim, slot);
+			core_run(&sim, finished_core, -1, time);
+
+			if (hi - 1 > lo && slots[hi - 1] == last)
+				slots[lo] = slot, hi--;
+			else
+				lo++;
+
+			if (new_job_id != -1)
+			{
+				if (!is_active(&sim, new_job_id))
+				{
+					run->error = "scheduler_job_finished() selected an invalid job";
+					goto done;
+				}
+				core_run(&sim, finished_core, new_job_id, time);
+			}
+		}
+
+		if (sim.size == 0 && next_arrival == jobs_ct)
+			break;
+
+		// 2. expired quanta
+		for (i = 0; i < due_ct; i++)
+		{
+			engine_core_t *expired = &core[due[i]];
+			if (expired->job_id != -1 && expired->expire_at <= time)
+			{
+				int new_job_id = sched_quantum_expired(sim.scheduler, expired->id, time);
+				core_stop(&sim, expired, time);
+				core_run(&sim, expired, -1, time);
+
+				if (new_job_id != -1)
+				{
+					if (!is_active(&sim, new_job_id))
+					{
+						run->error = "scheduler_quantum_expired() selected an invalid job";
+						goto done;
+					}
+					core_run(&sim, expired, new_job_id, time);
+				}
+			}
+		}
+
+		// 3. arrivals
+		while (next_arrival < jobs_ct && jobs[next_arrival].arrival_time == time)
+		{
+			const jobfile_job_t *job = &jobs[next_arrival++];
+			sim.slot_of[job->job_id] = sim.size;
+			sim.slot_job[sim.size++] = job->job_id;
+
+			int core_id = sched_new_job(sim.scheduler, job->job_id, time, job->run_time, job->priority);
+			if (core_id >= 0 && core_id < run->cores)
+			{
+				if (core[core_id].job_id != -1)
+					core_stop(&sim, &core[core_id], time);
+				core_run(&sim, &core[core_id], job->job_id, time);
+			}
+			else if (core_id != -1)
+			{
+				run->error = "scheduler_new_job() selected an invalid core";
+				goto done;
+			}
+		}
+
+		// 4. the next time anything happens
+		int next_time = engine_next_time(&sim.engine);
+		if (next_arrival < jobs_ct && jobs[next_arrival].arrival_time < next_time)
+			next_time = jobs[next_arrival].arrival_time;
+		if (next_time == NEVER || next_time <= time)
+			next_time = time + 1;
+
+		if (sim.size > 0 && sim.engine.cores_busy == 0)
+		{
+			run->error = "all cores are idle and at least one job remains unscheduled";
+			goto done;
+		}
+
+		time = next_time;
+	}
+
+done:
+	run->makespan = time;
+	run->waiting = sched_average_waiting_time(sim.scheduler);
+	run->turnaround = sched_average_turnaround_time(sim.scheduler);
+	run->response = sched_average_response_time(sim.scheduler);
+	run->migrations = sched_migrations(sim.scheduler);
+	sched_metrics(sim.scheduler, &run->metrics);
+
+	sched_destroy(sim.scheduler);
+	engine_destroy(&sim.engine);
+	free(sim.remaining);
+	free(sim.slot_of);
+	free(sim.slot_job);
+	free(sim.core_of);
+	free(slots);
+}
+
+/* Takes combinations off the list until none are left. */
+static void *worker(void *arg)
+{
+	(void)arg;
+	while (1)
+	{
+		pthread_mutex_lock(&next_run_mutex);
+		int index = next_run++;
+		pthread_mutex_unlock(&next_run_mutex);
+
+		if (index >= runs_ct)
+			return NULL;
+		simulate(&runs[index]);
+	}
+}
+
+
+static double seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+	char default_cores[] = "1,2,4,8";
+	char default_schemes[] = "fcfs,sjf,psjf,pri,ppri,rr2,mlfq,stride2";
+	char default_queues[] = "global";
+	char *core_list = default_cores, *scheme_list = default_schemes, *queue_list = default_queues;
+	char *core_items[MAX_LIST], *scheme_items[MAX_LIST], *queue_items[MAX_LIST];
+	int core_ct, scheme_ct, queue_ct;
+	int threads = sysconf(_SC_NPROCESSORS_ONLN);
+	int c, i, j, k;
+
+	scheduler_default_options(&options);
+
+	while ((c = getopt(argc, argv, "c:s:a:m:b:p:")) != -1)
+	{
+		switch (c)
+		{
+			case 'c': core_list = optarg; break;
+			case 's': scheme_list = optarg; break;
+			case 'a': queue_list = optarg; break;
+
+			case 'm':
+				if ((options.mlfq_levels = jobfile_parse_quanta(optarg, options.mlfq_quanta)) == 0)
+				{
+					fprintf(stderr, "Option -m <quanta> requires 1 to %d positive numbers. (Eg: -m 1,2,4)\n", MLFQ_MAX_LEVELS);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'b':
+				if ((options.mlfq_boost_period = atoi(optarg)) < 0)
+				{
+					fprintf(stderr, "Option -b <period> requires a non-negative number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'p':
+				if ((threads = atoi(optarg)) <= 0)
+				{
+					fprintf(stderr, "Option -p <threads> requires a positive number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			default:
+				print_usage(argv[0]);
+				return 1;
+		}
+	}
+
+	if (optind != argc - 1)
+	{
+		fprintf(stderr, "A single input file is required.\n");
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	if ((core_ct = split_list(core_list, core_items)) <= 0 || (scheme_ct = split_list(scheme_list, scheme_items)) <= 0 ||
+		(queue_ct = split_list(queue_list, queue_items)) <= 0)
+	{
+		fprintf(stderr, "Options -c, -s and -a take 1 to %d comma-separated values.\n", MAX_LIST);
+		print_usage(argv[0]);
+		return 1;
+	}
+
+	/*
+	 * Build the cross product.
+	 */
+	runs_ct = core_ct * scheme_ct * queue_ct;
+	runs = malloc(runs_ct * sizeof(sweep_run_t));
+	sweep_run_t *run = runs;
+	for (i = 0; i < core_ct; i++)
+		for (j = 0; j < scheme_ct; j++)
+			for (k = 0; k < queue_ct; k++, run++)
+			{
+				if ((run->cores = atoi(core_items[i])) <= 0)
+				{
+					fprintf(stderr, "Option -c requires positive numbers.\n");
+					return 1;
+				}
+				if (jobfile_parse_scheme(scheme_items[j], &run->scheme, &run->quantum) != 1)
+				{
+					fprintf(stderr, "Unknown scheme \"%s\".\n", scheme_items[j]);
+					print_usage(argv[0]);
+					return 1;
+				}
+				if (!parse_queue_mode(queue_items[k], &run->queue_mode))
+				{
+					fprintf(stderr, "Unknown queue layout \"%s\".\n", queue_items[k]);
+					print_usage(argv[0]);
+					return 1;
+				}
+				run->scheme_name = scheme_items[j];
+				run->queue_name = queue_items[k];
+			}
+
+	FILE *file = fopen(argv[optind], "r");
+	if (file == NULL)
+	{
+		fprintf(stderr, "Unable to open file \"%s\".\n", argv[optind]);
+		return 2;
+	}
+	if ((jobs_ct = jobfile_read_all(file, &jobs)) == -1)
+	{
+		fprintf(stderr, "Illegal file format.\n");
+		return 2;
+	}
+	fclose(file);
+
+	/*
+	 * Run them, threads at a time.
+	 */
+	if (threads > runs_ct)
+		threads = runs_ct;
+	pthread_t *tids = malloc(threads * sizeof(pthread_t));
+	double start = seconds();
+
+	for (i = 0; i < threads; i++)
+		if (pthread_create(&tids[i], NULL, worker, NULL) != 0)
+		{
+			fprintf(stderr, "Unable to start a thread.\n");
+			return 3;
+		}
+	for (i = 0; i < threads; i++)
+		pthread_join(tids[i], NULL);
+
+	printf("Swept %d combination(s) of %d job(s) from \"%s\" on %d thread(s) in %.2fs.\n\n",
+			runs_ct, jobs_ct, argv[optind], threads, seconds() - start);
+
+	printf("cores  scheme    queues    makespan    waiting turnaround   response  p99 turn.  p99 slow.  fairness  migrations\n");
+	for (i = 0; i < runs_ct; i++)
+	{
+		run = &runs[i];
+		printf("%5d  %-8s  %-8s", run->cores, run->scheme_name, run->queue_name);
+		if (run->error != NULL)
+			printf("  failed: %s\n", run->error);
+		else
+			printf("  %8d %10.2f %10.2f %10.2f %10.2f %10.2f  %8.4f  %10d\n", run->makespan, run->waiting, run->turnaround,
+					run->response, run->metrics.turnaround.p99, run->metrics.slowdown.p99, run->metrics.fairness, run->migrations);
+	}
+
+	free(tids);
+	free(runs);
+	free(jobs);
+
+	return 0;
+}
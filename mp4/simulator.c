@@ -7,9 +7,11 @@
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
-#include <assert.h>
+#include <stdarg.h>
 
 #include "libscheduler/libscheduler.h"
+#include "jobfile.h"
+#include "engine.h"
 
 
 typedef struct _simulator_job_list_t
@@ -18,45 +20,187 @@ typedef struct _simulator_job_list_t
 	int core_id, arrived;
 } simulator_job_list_t;
 
+
+/*
+ * The jobs the simulation is tracking.  A finished job's slot is filled by
+ * the last job in the array, which fixes the order jobs are visited in;
+ * index maps a job id to its slot so a job is found without a scan.
+ */
+typedef struct _job_table_t
+{
+	simulator_job_list_t *jobs;
+	int size, capacity;
+	int *index_keys, *index_slots;	// open addressing, key -1 is empty
+	int index_mask;
+} job_table_t;
+
+/* Room for the longest timing diagram symbol, "(-2147483648)". */
+#define JOB_SYMBOL_SIZE 16
+
+static engine_t engine;		// the cores and their events
+static FILE *jobs_csv;		// -o
+static FILE *gantt;		// -g
+static int gantt_events;
+
+
 void print_usage(char *program_name)
 {
-	fprintf(stderr, "Usage: %s -c <cores> -s <scheme> <input file>\n", program_name);
+	fprintf(stderr, "Usage: %s -c <cores> -s <scheme> [-m <quanta>] [-b <period>] [-a rr|least] [-o <jobs.csv>] [-j <metrics.json>] [-g <trace.json>] [-t [-v]] <input file>\n", program_name);
 	fprintf(stderr, "       %s -c 2 -s fcfs examples/proc1.csv\n", program_name);
 	fprintf(stderr, "\n");
-	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#\n");
+	fprintf(stderr, "Acceptable schemes are: fcfs, sjf, psjf, pri, ppri, rr#, mlfq, stride#\n");
+	fprintf(stderr, "  -m  mlfq: comma-separated quantum of each level, highest first (default 1,2,4)\n");
+	fprintf(stderr, "  -b  mlfq: boost every job to the top level every <period> time units, 0 for never (default 20)\n");
+	fprintf(stderr, "  -a  give each core its own run queue, placing arriving jobs round-robin or on the least loaded core\n");
+	fprintf(stderr, "  -o  write one CSV row per finished job\n");
+	fprintf(stderr, "  -j  write latency percentiles, slowdown and fairness as JSON\n");
+	fprintf(stderr, "  -g  write a Chrome trace-event timeline (chrome://tracing, Perfetto) with one track\n");
+	fprintf(stderr, "      per core; one time unit is shown as one microsecond\n");
+	fprintf(stderr, "  -t  trace mode: stream jobs from the file (arrivals must be sorted) and keep only\n");
+	fprintf(stderr, "      active jobs in memory; prints only a summary\n");
+	fprintf(stderr, "  -v  with -t, also print every event and time unit\n");
+}
+
+
+static unsigned int hash_id(int job_id, int mask)
+{
+	return ((unsigned int)job_id * 2654435761u) & mask;
 }
 
-int set_active_job(int job_id, int core_id, simulator_job_list_t *jobs, int active_jobs)
+static void table_index_put(job_table_t *table, int job_id, int slot)
+{
+	unsigned int h = hash_id(job_id, table->index_mask);
+	while (table->index_keys[h] != -1 && table->index_keys[h] != job_id)
+		h = (h + 1) & table->index_mask;
+	table->index_keys[h] = job_id;
+	table->index_slots[h] = slot;
+}
+
+static void table_index_init(job_table_t *table, int index_size)
 {
 	int i;
-	for (i = 0; i < active_jobs; i++)
+	table->index_keys = malloc(index_size * sizeof(int));
+	table->index_slots = malloc(index_size * sizeof(int));
+	table->index_mask = index_size - 1;
+	for (i = 0; i < index_size; i++)
+		table->index_keys[i] = -1;
+	for (i = 0; i < table->size; i++)
+		table_index_put(table, table->jobs[i].job_id, i);
+}
+
+void table_init(job_table_t *table)
+{
+	table->size = 0;
+	table->capacity = 16;
+	table->jobs = malloc(table->capacity * sizeof(simulator_job_list_t));
+	table_index_init(table, table->capacity * 2);
+}
+
+void table_destroy(job_table_t *table)
+{
+	free(table->jobs);
+	free(table->index_keys);
+	free(table->index_slots);
+}
+
+/* Returns the slot of job_id, or -1 if the table does not hold it. */
+int table_find(job_table_t *table, int job_id)
+{
+	unsigned int h = hash_id(job_id, table->index_mask);
+	while (table->index_keys[h] != -1)
 	{
-		if (jobs[i].job_id == job_id && jobs[i].arrived)
+		if (table->index_keys[h] == job_id)
+			return table->index_slots[h];
+		h = (h + 1) & table->index_mask;
+	}
+	return -1;
+}
+
+/* Appends a job that has not arrived yet, returning its slot. */
+int table_add(job_table_t *table, const jobfile_job_t *job)
+{
+	if (table->size == table->capacity)
+	{
+		table->capacity *= 2;
+		table->jobs = realloc(table->jobs, table->capacity * sizeof(simulator_job_list_t));
+		if (table->jobs == NULL)
 		{
-			jobs[i].core_id = core_id;
-			return 1;
+			fprintf(stderr, "Out of memory.\n");
+			exit(2);
 		}
+		free(table->index_keys);
+		free(table->index_slots);
+		table_index_init(table, table->capacity * 2);
+	}
+
+	simulator_job_list_t *added = &table->jobs[table->size];
+	added->job_id = job->job_id;
+	added->arrival_time = job->arrival_time;
+	added->run_time = job->run_time;
+	added->priority = job->priority;
+	added->core_id = -1;
+	added->arrived = 0;
+	table_index_put(table, job->job_id, table->size);
+	return table->size++;
+}
+
+/* Removes the job in slot, moving the last job into its place. */
+void table_remove_at(job_table_t *table, int slot)
+{
+	unsigned int hole = hash_id(table->jobs[slot].job_id, table->index_mask), j, home;
+	while (table->index_keys[hole] != table->jobs[slot].job_id)
+		hole = (hole + 1) & table->index_mask;
+
+	// backward-shift deletion keeps every probe sequence unbroken
+	table->index_keys[hole] = -1;
+	for (j = (hole + 1) & table->index_mask; table->index_keys[j] != -1; j = (j + 1) & table->index_mask)
+	{
+		home = hash_id(table->index_keys[j], table->index_mask);
+		if ((hole <= j) ? (home > hole && home <= j) : (home > hole || home <= j))
+			continue;
+		table->index_keys[hole] = table->index_keys[j];
+		table->index_slots[hole] = table->index_slots[j];
+		table->index_keys[j] = -1;
+		hole = j;
+	}
+
+	table->size--;
+	if (slot != table->size)
+	{
+		table->jobs[slot] = table->jobs[table->size];
+		table_index_put(table, table->jobs[slot].job_id, slot);
+	}
+}
+
+
+int set_active_job(int job_id, int core_id, job_table_t *table)
+{
+	int slot = table_find(table, job_id);
+	if (slot != -1 && table->jobs[slot].arrived)
+	{
+		table->jobs[slot].core_id = core_id;
+		return 1;
 	}
 
 	return 0;
 }
 
-void print_available_jobs(simulator_job_list_t *jobs, int active_jobs)
+void print_available_jobs(job_table_t *table)
 {
 	printf("Active jobs are: ");
 
 	int i, first = 1;
-	for (i = 0; i < active_jobs; i++)
+	for (i = 0; i < table->size; i++)
 	{
-		if (jobs[i].arrived)
+		if (table->jobs[i].arrived)
 		{
 			if (first)
 			{
-				printf("%d", jobs[i].job_id);
+				printf("%d", table->jobs[i].job_id);
 				first = 0;
 			}
 			else
-				printf(", %d", jobs[i].job_id);
+				printf(", %d", table->jobs[i].job_id);
 		}
 	}
 
@@ -78,17 +222,149 @@ void print_available_cores(int cores)
 	}
 }
 
+/* The timing diagram's symbol for a job: 0-9, a-z, A-Z, then (id). */
+void format_job(char *buf, size_t size, int job_id)
+{
+	if (job_id < 10)
+		snprintf(buf, size, "%d", job_id);
+	else if (job_id < 10 + 26)
+		snprintf(buf, size, "%c", job_id - 10 + 'a');
+	else if (job_id < 10 + 26 + 26)
+		snprintf(buf, size, "%c", job_id - 10 - 26 + 'A');
+	else
+		snprintf(buf, size, "(%d)", job_id);
+}
+
+/* Puts job_id (-1 for none) on the core at time and reschedules the core's next event. */
+void core_run(engine_core_t *core, int job_id, int time, job_table_t *table)
+{
+	engine_run(&engine, core, job_id, (job_id != -1) ? table->jobs[table_find(table, job_id)].run_time : 0, time);
+}
+
+/* Charges the core's job for the time it has run; call when the job leaves the core unfinished. */
+void core_stop(engine_core_t *core, int time, job_table_t *table)
+{
+	table->jobs[table_find(table, core->job_id)].run_time -= engine_stop(core, time);
+}
+
+void write_job_record(const scheduler_job_record_t *r)
+{
+	fprintf(jobs_csv, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%.4f\n", r->job_number, r->arrival_time, r->running_time, r->priority,
+			r->first_run_time, r->finish_time, r->waiting_time, r->response_time, r->turnaround_time, r->slowdown);
+}
+
+/*
+ * The -g timeline, in Chrome's trace-event JSON: every core is a thread of
+ * one process, every stretch of a job on a core is a complete ("X") event,
+ * and preemptions and quantum expiries are instant ("i") events on the core.
+ */
+static void gantt_event(const char *format, ...)
+{
+	va_list args;
+	fprintf(gantt, gantt_events++ ? ",\n" : "\n");
+	va_start(args, format);
+	vfprintf(gantt, format, args);
+	va_end(args);
+}
+
+void gantt_open(int cores, const char *scheme_name)
+{
+	int i;
+	fprintf(gantt, "{\"traceEvents\": [");
+	gantt_event("{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"args\": {\"name\": \"%s on %d core(s)\"}}", scheme_name, cores);
+	for (i = 0; i < cores; i++)
+		gantt_event("{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"Core %d\"}}", i, i);
+}
+
+/* Ends the core's current stretch at time; why is "finished", "expired" or "preempted". */
+void gantt_segment(engine_core_t *core, int time, const char *why)
+{
+	if (gantt == NULL || core->job_id == -1)
+		return;
+	if (time > core->started)
+		gantt_event("{\"name\": \"job %d\", \"cat\": \"job\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %d, \"dur\": %d, "
+				"\"args\": {\"job\": %d, \"end\": \"%s\"}}", core->job_id, core->id, core->started, time - core->started, core->job_id, why);
+	if (strcmp(why, "finished") != 0)
+		gantt_event("{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 0, \"tid\": %d, \"ts\": %d, "
+				"\"args\": {\"job\": %d}}", why, why, core->id, time, core->job_id);
+}
+
+/*
+ * Ends the timeline.  Registered with atexit(), so the file is valid JSON
+ * however the simulation stops, including when the scheduler misbehaves.
+ */
+void gantt_close()
+{
+	if (gantt == NULL)
+		return;
+	fprintf(gantt, "\n]}\n");
+	fclose(gantt);
+	gantt = NULL;
+}
+
+static void write_distribution(FILE *out, const char *name, scheduler_distribution_t *d, const char *separator)
+{
+	fprintf(out, "  \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f}%s\n",
+			name, d->mean, d->p50, d->p95, d->p99, d->max, separator);
+}
+
+void write_metrics_json(FILE *out, int cores, const char *scheme_name, int time, scheduler_metrics_t *m)
+{
+	fprintf(out, "{\n");
+	fprintf(out, "  \"cores\": %d,\n", cores);
+	fprintf(out, "  \"scheme\": \"%s\",\n", scheme_name);
+	fprintf(out, "  \"jobs\": %d,\n", m->jobs);
+	fprintf(out, "  \"makespan\": %d,\n", time);
+	write_distribution(out, "waiting", &m->waiting, ",");
+	write_distribution(out, "response", &m->response, ",");
+	write_distribution(out, "turnaround", &m->turnaround, ",");
+	write_distribution(out, "slowdown", &m->slowdown, ",");
+	fprintf(out, "  \"fairness\": %.4f,\n", m->fairness);
+	fprintf(out, "  \"migrations\": %d\n", scheduler_migrations());
+	fprintf(out, "}\n");
+}
+
+static void print_distribution(const char *name, scheduler_distribution_t *d)
+{
+	printf("  %-11s %10.2f %10.2f %10.2f %10.2f %10.2f\n", name, d->mean, d->p50, d->p95, d->p99, d->max);
+}
+
+/* Grows buffer to hold at least n slots, keeping it between calls. */
+static int *reserve_slots(int *buffer, int *size, int n)
+{
+	if (n > *size)
+	{
+		*size = n * 2;
+		if ((buffer = realloc(buffer, *size * sizeof(int))) == NULL)
+		{
+			fprintf(stderr, "Out of memory.\n");
+			exit(3);
+		}
+	}
+	return buffer;
+}
+
+static int compare_slots(const void *a, const void *b)
+{
+	return *(const int *)a - *(const int *)b;
+}
+
 
 int main(int argc, char **argv)
 {
-	int c;
+	int c, i;
 	int cores = 0, scheme = -1, quantum = 0;
+	scheme_t parsed;
+	int trace = 0, verbose = 0;
+	queue_mode_t queue_mode = QUEUE_GLOBAL;
+	char *csv_name = NULL, *json_name = NULL, *gantt_name = NULL, *scheme_name = NULL;
+	int mlfq_levels = 3, mlfq_quanta[MLFQ_MAX_LEVELS] = {1, 2, 4}, mlfq_boost = 20;
 	char *file_name;
 
 	/*
 	 * Parse command line options.
 	 */
-	while ((c = getopt(argc, argv, "c:s:")) != -1)
+	while ((c = getopt(argc, argv, "c:s:m:b:a:o:j:g:tv")) != -1)
 	{
 		switch (c)
 		{
@@ -104,25 +380,71 @@ int main(int argc, char **argv)
 				break;
 
 			case 's':
-				if (strcasecmp(optarg, "FCFS") == 0) { scheme = FCFS; }
-				else if (strcasecmp(optarg, "SJF") == 0) { scheme = SJF; }
-				else if (strcasecmp(optarg, "PSJF") == 0) { scheme = PSJF; }
-				else if (strcasecmp(optarg, "PRI") == 0) { scheme = PRI; }
-				else if (strcasecmp(optarg, "PPRI") == 0) { scheme = PPRI; }
-				else if (strncasecmp(optarg, "RR", 2) == 0)
+				scheme_name = optarg;
+				switch (jobfile_parse_scheme(optarg, &parsed, &quantum))
 				{
-					scheme = RR;
-					quantum = atoi(optarg + 2);
+					case 1:
+						scheme = parsed;
+						break;
 
-					if (quantum <= 0)
-					{
-						fprintf(stderr, "Option -s <scheme> requires a positive number for the quantum of RR. (Eg: -s RR2)\n");
+					case -1:
+						fprintf(stderr, "Option -s <scheme> requires a positive number for the quantum of %s. (Eg: -s %s2)\n",
+								(parsed == RR) ? "RR" : "STRIDE", (parsed == RR) ? "RR" : "STRIDE");
 						print_usage(argv[0]);
 						return 1;
-					}
 				}
 				break;
 
+			case 'm':
+				if ((mlfq_levels = jobfile_parse_quanta(optarg, mlfq_quanta)) == 0)
+				{
+					fprintf(stderr, "Option -m <quanta> requires 1 to %d positive numbers. (Eg: -m 1,2,4)\n", MLFQ_MAX_LEVELS);
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'b':
+				mlfq_boost = atoi(optarg);
+				if (mlfq_boost < 0)
+				{
+					fprintf(stderr, "Option -b <period> requires a non-negative number.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'a':
+				if (strcasecmp(optarg, "RR") == 0) { queue_mode = QUEUE_PER_CORE_RR; }
+				else if (strcasecmp(optarg, "LEAST") == 0) { queue_mode = QUEUE_PER_CORE_LEAST; }
+				else
+				{
+					fprintf(stderr, "Option -a requires rr or least.\n");
+					print_usage(argv[0]);
+					return 1;
+				}
+				break;
+
+			case 'o':
+				csv_name = optarg;
+				break;
+
+			case 'j':
+				json_name = optarg;
+				break;
+
+			case 'g':
+				gantt_name = optarg;
+				break;
+
+			case 't':
+				trace = 1;
+				break;
+
+			case 'v':
+				verbose = 1;
+				break;
+
 			case '?':
 				print_usage(argv[0]);
 				return 1;
@@ -156,9 +478,15 @@ int main(int argc, char **argv)
 		return 1;
 	}
 
+	// outside trace mode everything is printed, as it always was
+	if (!trace)
+		verbose = 1;
+
 
 	/*
-	 * Open the file, read the file, and populate the jobs data structure.
+	 * Open the file.  Outside trace mode, read every job into the table now;
+	 * in trace mode jobs are read as they arrive and leave the table when
+	 * they finish.
 	 */
 	FILE *file = fopen(file_name, "r");
 	if (file == NULL)
@@ -167,116 +495,194 @@ int main(int argc, char **argv)
 		return 2;
 	}
 
+	jobfile_reader_t *reader = jobfile_open(file);
+	jobfile_skip_header(reader);
 
-	int job_id = 0;
-	int jobs_ct = 10;
-	simulator_job_list_t* jobs = malloc(jobs_ct * sizeof(simulator_job_list_t));
+	job_table_t table;
+	table_init(&table);
 
-	char line[1024 + 1];
-	fgets(line, 1024, file);  // Ignore the first (header) line
-	while (fgets(line, 1024, file) != NULL)
-	{
-		char *arrival_time = strtok(line, ",");
-		char *run_time = strtok(NULL, ",");
-		char *priority = strtok(NULL, ",");
-
-		if (arrival_time != NULL && run_time != NULL && priority != NULL)
-		{
-			if (job_id == jobs_ct)
-			{
-				jobs_ct *= 2;
-				jobs = realloc(jobs, jobs_ct * sizeof(simulator_job_list_t));
-
-				if (!jobs)
-				{
-					fprintf(stderr, "Out of memory.\n");
-					return 2;
-				}
-			}
+	jobfile_job_t next_job;	// trace mode: the next job to arrive
+	int have_next = 0, read_result;
 
-			jobs[job_id].job_id = job_id;
-			jobs[job_id].arrival_time = atoi(arrival_time);
-			jobs[job_id].run_time = atoi(run_time);
-			jobs[job_id].priority = atoi(priority);
-			jobs[job_id].core_id = -1;
-			jobs[job_id].arrived = 0;
+	jobfile_job_t *arrivals = NULL;	// otherwise: every job, by arrival time
+	int arrivals_ct = 0, next_arrival = 0;
 
-			job_id++;
-		}
-		else
+	if (trace)
+	{
+		if ((read_result = jobfile_next(reader, &next_job)) == -1)
 		{
 			fprintf(stderr, "Illegal file format.\n");
 			return 2;
 		}
+		have_next = read_result;
 	}
+	else
+	{
+		while ((read_result = jobfile_next(reader, &next_job)) == 1)
+			table_add(&table, &next_job);
+
+		if (read_result == -1)
+		{
+			fprintf(stderr, "Illegal file format.\n");
+			return 2;
+		}
+
+		fclose(file);
 
-	fclose(file);
+		arrivals_ct = table.size;
+		arrivals = malloc((arrivals_ct + 1) * sizeof(jobfile_job_t));
+		for (i = 0; i < arrivals_ct; i++)
+		{
+			arrivals[i].job_id = table.jobs[i].job_id;
+			arrivals[i].arrival_time = table.jobs[i].arrival_time;
+			arrivals[i].run_time = table.jobs[i].run_time;
+			arrivals[i].priority = table.jobs[i].priority;
+		}
+		qsort(arrivals, arrivals_ct, sizeof(jobfile_job_t), jobfile_compare_arrivals);
+	}
 
 
 	/*
 	 * Run the simulation.
 	 */
 
-	printf("Loaded %d core(s) and %d job(s) using ", cores, job_id);
+	if (trace)
+		printf("Streaming jobs from \"%s\" on %d core(s) using ", file_name, cores);
+	else
+		printf("Loaded %d core(s) and %d job(s) using ", cores, table.size);
 	if (scheme == FCFS) { printf("First Come First Served (FCFS)"); }
 	else if (scheme == SJF) { printf("Non-preemptive Shortest Job First (SJF)"); }
 	else if (scheme == PSJF) { printf("Preemptive Shortest Job First (PSJF)"); }
 	else if (scheme == PRI) { printf("Non-preemptive Priority (PRI)"); }
 	else if (scheme == PPRI) { printf("Preemptive Priority (PPRI)"); }
 	else if (scheme == RR) { printf("Round Robin (RR) with a quantum of %d", quantum); }
+	else if (scheme == MLFQ)
+	{
+		printf("Multi-Level Feedback Queue (MLFQ) with quanta ");
+		for (i = 0; i < mlfq_levels; i++)
+			printf(i ? ",%d" : "%d", mlfq_quanta[i]);
+		if (mlfq_boost > 0)
+			printf(" and a boost every %d", mlfq_boost);
+	}
+	else if (scheme == STRIDE) { printf("Stride (STRIDE) with a quantum of %d", quantum); }
+	if (queue_mode == QUEUE_PER_CORE_RR) { printf(" on per-core queues (round-robin placement)"); }
+	else if (queue_mode == QUEUE_PER_CORE_LEAST) { printf(" on per-core queues (least-loaded placement)"); }
 	printf(" scheduling...\n\n");
 
+	scheduler_configure_mlfq(mlfq_levels, mlfq_quanta, mlfq_boost);
+	scheduler_configure_stride(quantum);
+	scheduler_configure_queues(queue_mode);
+
+	if (csv_name != NULL)
+	{
+		if ((jobs_csv = fopen(csv_name, "w")) == NULL)
+		{
+			fprintf(stderr, "Unable to open file \"%s\".\n", csv_name);
+			return 2;
+		}
+		fprintf(jobs_csv, "job,arrival,running,priority,first_run,finish,waiting,response,turnaround,slowdown\n");
+		scheduler_set_job_callback(write_job_record);
+	}
+	if (gantt_name != NULL)
+	{
+		if ((gantt = fopen(gantt_name, "w")) == NULL)
+		{
+			fprintf(stderr, "Unable to open file \"%s\".\n", gantt_name);
+			return 2;
+		}
+		gantt_open(cores, scheme_name);
+		atexit(gantt_close);
+	}
 	scheduler_start_up(cores, scheme);
 
 
-	int time = 0, i, j;
-	int active_jobs = job_id, jobs_alive = 0;
+	int time = 0, j;
+	int jobs_alive = 0, jobs_done = 0;
 
-	int *quantum_clock = malloc(cores * sizeof(int));
-	char **core_timing_diagram = malloc(cores * sizeof(char *));
+	int *slots = malloc(cores * sizeof(int));
+	int *arriving_slots = NULL, arriving_slots_size = 0;	// jobs arriving at this time
+	char **core_timing_diagram = NULL;
+	int *core_timing_diagram_len = NULL;
 	int core_timing_diagram_size = 1024;
 
-	for (i = 0; i < cores; i++)
+	engine_init(&engine, cores, NULL, (scheme == RR) ? quantum : 0);
+	engine_core_t *core = engine.core;
+	int *due = engine.due;	// cores with an event at this time
+
+	// trace mode keeps no timing diagram: it grows with the length of the run
+	if (!trace)
 	{
-		quantum_clock[i] = -1;
-		core_timing_diagram[i] = malloc(core_timing_diagram_size + 1);
-		core_timing_diagram[i][0] = '\0';
+		core_timing_diagram = malloc(cores * sizeof(char *));
+		core_timing_diagram_len = malloc(cores * sizeof(int));
+		for (i = 0; i < cores; i++)
+		{
+			core_timing_diagram[i] = malloc(core_timing_diagram_size + 1);
+			core_timing_diagram[i][0] = '\0';
+			core_timing_diagram_len[i] = 0;
+		}
 	}
 
-	while (active_jobs > 0)
+	/*
+	 * Each pass handles one time at which something happens (a job finishes,
+	 * a quantum expires or a job arrives), then jumps straight to the next
+	 * such time.  Nothing changes in between, so the time units skipped are
+	 * only printed, not simulated.
+	 */
+	while (table.size > 0 || have_next)
 	{
-		printf("=== [TIME %d] ===\n", time);
+		if (verbose)
+			printf("=== [TIME %d] ===\n", time);
+
+		int due_ct = engine_due(&engine, time);
 
 		/*
 		 * 1. Check if any jobs finished in the last time unit.
+		 *
+		 * They are handled in slot order; removing one moves the last job
+		 * into its slot, and if that job has also finished it is the next
+		 * one handled.
 		 */
-		for (i = 0; i < active_jobs; i++)
+		int finished = 0;
+		for (i = 0; i < due_ct; i++)
+			if (core[due[i]].job_id != -1 && core[due[i]].finish_at <= time)
+				slots[finished++] = table_find(&table, core[due[i]].job_id);
+		qsort(slots, finished, sizeof(int), compare_slots);
+
+		int lo = 0, hi = finished;
+		while (lo < hi)
 		{
-			if (jobs[i].run_time == 0)
-			{
-				// Notify the scheduler has finished
-				int job_id = jobs[i].job_id;
-				int core_id = jobs[i].core_id;
-				int new_job_id = scheduler_job_finished(jobs[i].core_id, jobs[i].job_id, time);
-
-				if (scheme == RR)
-					quantum_clock[jobs[i].core_id] = quantum;
+			int slot = slots[lo], last = table.size - 1;
+
+			// Notify the scheduler has finished
+			int job_id = table.jobs[slot].job_id;
+			int core_id = table.jobs[slot].core_id;
+			int new_job_id = scheduler_job_finished(core_id, job_id, time);
+
+			// Delete the finished jobs, decrease the number of active jobs
+			table_remove_at(&table, slot);
+			gantt_segment(&core[core_id], time, "finished");
+			core_run(&core[core_id], -1, time, &table);
+			jobs_alive--;
+			jobs_done++;
+
+			if (hi - 1 > lo && slots[hi - 1] == last)
+				slots[lo] = slot, hi--;
+			else
+				lo++;
 
-				// Delete the finished jobs, decrease the number of active jobs
-				if (i != active_jobs - 1)
-					memcpy(&jobs[i], &jobs[active_jobs - 1], sizeof(simulator_job_list_t));
-				active_jobs--;
-				jobs_alive--;
-				i--;
+			// Set the new job
+			if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, &table) )
+			{
+				printf("The scheduler_job_finished() selected an invalid job (job_id == %d).\n", new_job_id);
+				print_available_jobs(&table);
+				return 3;
+			}
+			else
+			{
+				if (new_job_id != -1)
+					core_run(&core[core_id], new_job_id, time, &table);
 
-				// Set the new job
-				if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, active_jobs) )
-				{
-					printf("The scheduler_job_finished() selected an invalid job (job_id == %d).\n", new_job_id);
-					print_available_jobs(jobs, active_jobs);
-					return 3;
-				}
-				else
+				if (verbose)
 				{
 					printf("Job %d, running on core %d, finished. Core %d is now running job %d.\n", job_id, core_id, core_id, new_job_id);
 					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
@@ -287,167 +693,209 @@ int main(int argc, char **argv)
 		/*
 		 * Check to see if we finished our last job.  (If we don't check here, we would run an extra time unit that will be totally idle.)
 		 */
-		if (active_jobs == 0)
+		if (table.size == 0 && !have_next)
 			break;
 
 		/*
 		 * 2. Check of any quantums expired in the last time unit.
 		 */
-		if (scheme == RR)
+		for (i = 0; i < due_ct; i++)
 		{
-			for (i = 0; i < cores; i++)
+			engine_core_t *expired = &core[due[i]];
+			if (expired->job_id != -1 && expired->expire_at <= time)
 			{
-				if (quantum_clock[i] == 0)
+				j = table_find(&table, expired->job_id);
+
+				// Notify the scheduler the quantum has expired
+				int core_id = expired->id;
+				int old_job_id = expired->job_id;
+				int new_job_id = scheduler_quantum_expired(core_id, time);
+
+				gantt_segment(expired, time, "expired");
+				core_stop(expired, time, &table);
+				table.jobs[j].core_id = -1;
+				core_run(expired, -1, time, &table);
+
+				// Set the new job
+				if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, &table) )
 				{
-					for (j = 0; j < active_jobs; j++)
+					printf("The scheduler_quantum_expired() selected an invalid job (job_id == %d).\n", new_job_id);
+					print_available_jobs(&table);
+					return 3;
+				}
+				else
+				{
+					if (new_job_id != -1)
+						core_run(expired, new_job_id, time, &table);
+
+					if (verbose)
 					{
-						if (jobs[j].core_id == i)
-						{
-							// Notify the scheduler the quantum has expired
-							int core_id = jobs[j].core_id;
-							int old_job_id = jobs[j].job_id;
-							int new_job_id = scheduler_quantum_expired(jobs[j].core_id, time);
-
-							jobs[j].core_id = -1;
-
-							quantum_clock[core_id] = quantum;
-
-							// Set the new job
-							if ( new_job_id != -1 && !set_active_job(new_job_id, core_id, jobs, active_jobs) )
-							{
-								printf("The scheduler_quantum_expired() selected an invalid job (job_id == %d).\n", new_job_id);
-								print_available_jobs(jobs, active_jobs);
-								return 3;
-							}
-							else
-							{
-								printf("Job %d, running on core %d, had its quantum expire. Core %d is now running job %d.\n", old_job_id, core_id, core_id, new_job_id);
-								printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
-							}
-
-							break;
-						}
+						printf("Job %d, running on core %d, had its quantum expire. Core %d is now running job %d.\n", old_job_id, core_id, core_id, new_job_id);
+						printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
 					}
 				}
 			}
 		}
 
-
 		/*
-		 * 3. Check for any new jobs that arrive in this time unit
+		 * 3. Check for any new jobs that arrive in this time unit, in slot order.
 		 */
-		for (i = 0; i < active_jobs; i++)
+		int arriving = 0;
+		if (trace)
 		{
-			if (jobs[i].arrival_time == time)
+			int first_slot = table.size;
+			while (have_next && next_job.arrival_time == time)
+			{
+				table_add(&table, &next_job);
+				if ((read_result = jobfile_next(reader, &next_job)) == -1)
+				{
+					fprintf(stderr, "Illegal file format.\n");
+					return 2;
+				}
+				have_next = read_result;
+			}
+			if (have_next && next_job.arrival_time <= time)
 			{
-				int new_job_core_id = scheduler_new_job(jobs[i].job_id, time, jobs[i].run_time, jobs[i].priority);
-				jobs[i].arrived = 1;
-				jobs_alive++;
+				fprintf(stderr, "Trace mode requires jobs sorted by arrival time (job %d arrives at %d, after time %d).\n",
+						next_job.job_id, next_job.arrival_time, time);
+				return 2;
+			}
 
-				if (new_job_core_id >= 0 && new_job_core_id < cores)
+			arriving = table.size - first_slot;
+			arriving_slots = reserve_slots(arriving_slots, &arriving_slots_size, arriving);
+			for (i = 0; i < arriving; i++)
+				arriving_slots[i] = first_slot + i;
+		}
+		else
+		{
+			while (next_arrival < arrivals_ct && arrivals[next_arrival].arrival_time < time)
+				next_arrival++;
+			for (i = next_arrival; i < arrivals_ct && arrivals[i].arrival_time == time; i++)
+				arriving++;
+			arriving_slots = reserve_slots(arriving_slots, &arriving_slots_size, arriving);
+			for (i = 0; i < arriving; i++)
+				arriving_slots[i] = table_find(&table, arrivals[next_arrival++].job_id);
+			qsort(arriving_slots, arriving, sizeof(int), compare_slots);
+		}
+
+		for (j = 0; j < arriving; j++)
+		{
+			simulator_job_list_t *job = &table.jobs[arriving_slots[j]];
+			int new_job_core_id = scheduler_new_job(job->job_id, time, job->run_time, job->priority);
+			job->arrived = 1;
+			jobs_alive++;
+
+			if (new_job_core_id >= 0 && new_job_core_id < cores)
+			{
+				if (verbose)
 				{
 					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is now running on core %d.\n",
-							jobs[i].job_id, jobs[i].run_time, jobs[i].priority, jobs[i].job_id, new_job_core_id);
+							job->job_id, job->run_time, job->priority, job->job_id, new_job_core_id);
 					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
+				}
 
-					// Find if anyone is currently using the core.
-					for (j = 0; j < active_jobs; j++)
-						if (jobs[j].core_id == new_job_core_id)
-							jobs[j].core_id = -1;
-
-					// Assign the core to the new job
-					jobs[i].core_id = new_job_core_id;
-
-					if (scheme == RR)
-						quantum_clock[new_job_core_id] = quantum;
+				// Find if anyone is currently using the core.
+				if (core[new_job_core_id].job_id != -1)
+				{
+					table.jobs[table_find(&table, core[new_job_core_id].job_id)].core_id = -1;
+					gantt_segment(&core[new_job_core_id], time, "preempted");
+					core_stop(&core[new_job_core_id], time, &table);
 				}
-				else if (new_job_core_id == -1)
+
+				// Assign the core to the new job
+				job->core_id = new_job_core_id;
+				core_run(&core[new_job_core_id], job->job_id, time, &table);
+			}
+			else if (new_job_core_id == -1)
+			{
+				if (verbose)
 				{
 					printf("A new job, job %d (running time=%d, priority=%d), arrived. Job %d is set to idle (-1).\n",
-							jobs[i].job_id, jobs[i].run_time, jobs[i].priority, jobs[i].job_id);
+							job->job_id, job->run_time, job->priority, job->job_id);
 					printf("  Queue: "); scheduler_show_queue(); printf("\n\n");
 				}
-				else
-				{
-					printf("The scheduler_new_job() selected an invalid core (core_id == %d).\n", new_job_core_id);
-					print_available_cores(cores);
-					return 3;
-				}
+			}
+			else
+			{
+				printf("The scheduler_new_job() selected an invalid core (core_id == %d).\n", new_job_core_id);
+				print_available_cores(cores);
+				return 3;
 			}
 		}
 
 
 		/*
-		 * 4. Run the time unit.
+		 * 4. Find the next time anything happens: the earliest core event or arrival.
 		 */
-		char time_string[cores][11];
-		int cores_working = 0;
+		int next_time = engine_next_time(&engine);
+		if (trace && have_next && next_job.arrival_time < next_time)
+			next_time = next_job.arrival_time;
+		if (!trace && next_arrival < arrivals_ct && arrivals[next_arrival].arrival_time < next_time)
+			next_time = arrivals[next_arrival].arrival_time;
+		if (next_time == NEVER || next_time <= time)
+			next_time = time + 1;
 
-		for (i = 0; i < cores; i++)
-			time_string[i][0] = '\0';
 
-		for (i = 0; i < active_jobs; i++)
+		/*
+		 * 5. Print data!  Every core keeps its job until next_time, so each
+		 * time unit up to then looks the same.
+		 */
+		char time_string[cores][JOB_SYMBOL_SIZE];
+		int tick;
+
+		for (i = 0; i < cores && verbose; i++)
 		{
-			if (jobs[i].core_id != -1)
-			{
-				cores_working++;
-				jobs[i].run_time--;
-				quantum_clock[jobs[i].core_id]--;
-
-				assert(time_string[jobs[i].core_id][0] == '\0');
-
-				if (jobs[i].job_id < 10)
-					sprintf(time_string[jobs[i].core_id], "%d", jobs[i].job_id);
-				else if (jobs[i].job_id < 10 + 26)
-					sprintf(time_string[jobs[i].core_id], "%c", jobs[i].job_id - 10 + 'a');
-				else if (jobs[i].job_id < 10 + 26 + 26)
-					sprintf(time_string[jobs[i].core_id], "%c", jobs[i].job_id - 10 - 26 + 'A');
-				else
-					snprintf(time_string[jobs[i].core_id], 10, "(%d)", jobs[i].job_id);
-			}
+			if (core[i].job_id != -1)
+				format_job(time_string[i], sizeof(time_string[i]), core[i].job_id);
+			else
+				strcpy(time_string[i], "-");	// If the core is idle, print a '-'
 		}
 
-		for (i = 0; i < cores; i++)
+		for (tick = time; tick < next_time && verbose; tick++)
 		{
-			// If the core is idle, print a '-'
-			if (time_string[i][0] == '\0')
-				strcpy(time_string[i], "-");
+			if (tick > time)
+				printf("=== [TIME %d] ===\n", tick);
 
-			// Ensure we have enough memory
-			while (strlen(core_timing_diagram[i]) + strlen(time_string[i]) >= (unsigned int)core_timing_diagram_size)
+			for (i = 0; i < cores && !trace; i++)
 			{
-				core_timing_diagram_size *= 2;
+				int len = strlen(time_string[i]);
 
-				for (j = 0; j < cores; j++)
+				// Ensure we have enough memory
+				while (core_timing_diagram_len[i] + len >= core_timing_diagram_size)
 				{
-					core_timing_diagram[j] = realloc(core_timing_diagram[j], core_timing_diagram_size + 1);
+					core_timing_diagram_size *= 2;
 
-					if (core_timing_diagram[j] == NULL)
+					for (j = 0; j < cores; j++)
 					{
-						fprintf(stderr, "Out of memory.\n");
-						return 3;
+						core_timing_diagram[j] = realloc(core_timing_diagram[j], core_timing_diagram_size + 1);
+
+						if (core_timing_diagram[j] == NULL)
+						{
+							fprintf(stderr, "Out of memory.\n");
+							return 3;
+						}
 					}
 				}
-			}
 
-			strcat( core_timing_diagram[i], time_string[i] );
-		}
+				memcpy(core_timing_diagram[i] + core_timing_diagram_len[i], time_string[i], len + 1);
+				core_timing_diagram_len[i] += len;
+			}
 
+			printf("At the end of time unit %d...\n", tick);
 
-		/*
-		 * 5. Print data!
-		 */
-		printf("At the end of time unit %d...\n", time);
+			for (i = 0; i < cores; i++)
+				printf("  Core %2d: %s\n", i, trace ? time_string[i] : core_timing_diagram[i]);
 
-		for (i = 0; i < cores; i++)
-			printf("  Core %2d: %s\n", i, core_timing_diagram[i]);
+			printf("\n");
 
-		printf("\n");
+			printf("  Queue: ");
+			scheduler_show_queue();
+			printf("\n");
+			printf("\n");
 
-		printf("  Queue: ");
-		scheduler_show_queue();
-		printf("\n");
-		printf("\n");
+			if (jobs_alive > 0 && engine.cores_busy == 0)
+				break;
+		}
 
 
 		/*
@@ -455,10 +903,10 @@ int main(int argc, char **argv)
 		 *
 		 * - If there's a job alive (needing to be ran) and all CPUs are idle, the scheduler failed to schedule properly.
 		 */
-		if (jobs_alive > 0 && cores_working == 0)
+		if (jobs_alive > 0 && engine.cores_busy == 0)
 		{
 			printf("All cores are idle and at least one job remains unscheduled.\n");
-			print_available_jobs(jobs, active_jobs);
+			print_available_jobs(&table);
 			return 3;
 		}
 
@@ -466,27 +914,75 @@ int main(int argc, char **argv)
 		/*
 		 * 7. Increase time
 		 */
-		time++;
+		time = next_time;
 	}
 
 
-	printf("FINAL TIMING DIAGRAM:\n");
-	for (i = 0; i < cores; i++)
-		printf("  Core %2d: %s\n", i, core_timing_diagram[i]);
+	if (trace)
+	{
+		printf("Simulated %d job(s) in %d time unit(s).\n", jobs_done, time);
+		fclose(file);
+	}
+	else
+	{
+		printf("FINAL TIMING DIAGRAM:\n");
+		for (i = 0; i < cores; i++)
+			printf("  Core %2d: %s\n", i, core_timing_diagram[i]);
+	}
 
 	printf("\n");
 	printf("Average Waiting Time: %.2f\n", scheduler_average_waiting_time());
 	printf("Average Turnaround Time: %.2f\n", scheduler_average_turnaround_time());
 	printf("Average Response Time: %.2f\n", scheduler_average_response_time());
+	if (queue_mode != QUEUE_GLOBAL)
+		printf("Migrations: %d\n", scheduler_migrations());
+
+	scheduler_metrics_t metrics;
+	scheduler_metrics(&metrics);
+
+	if (trace)
+	{
+		printf("\n");
+		printf("                    mean        p50        p95        p99        max\n");
+		print_distribution("Waiting", &metrics.waiting);
+		print_distribution("Response", &metrics.response);
+		print_distribution("Turnaround", &metrics.turnaround);
+		print_distribution("Slowdown", &metrics.slowdown);
+		printf("Fairness (Jain's index): %.4f\n", metrics.fairness);
+	}
+
+	if (json_name != NULL)
+	{
+		FILE *json = fopen(json_name, "w");
+		if (json == NULL)
+		{
+			fprintf(stderr, "Unable to open file \"%s\".\n", json_name);
+			return 2;
+		}
+		write_metrics_json(json, cores, scheme_name, time, &metrics);
+		fclose(json);
+	}
+
+	if (jobs_csv != NULL)
+		fclose(jobs_csv);
+	gantt_close();
 
 	scheduler_clean_up();
 
 
-	free(quantum_clock);
-	for (i=0; i < cores; i++)
-		free(core_timing_diagram[i]);
-	free(core_timing_diagram);
-	free(jobs);
+	engine_destroy(&engine);
+	free(slots);
+	free(arriving_slots);
+	if (core_timing_diagram)
+	{
+		for (i=0; i < cores; i++)
+			free(core_timing_diagram[i]);
+		free(core_timing_diagram);
+		free(core_timing_diagram_len);
+	}
+	free(arrivals);
+	jobfile_close(reader);
+	table_destroy(&table);
 
 	return 0;
 }
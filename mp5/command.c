@@ -0,0 +1,194 @@
+/** @file command.c */
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+
+#include "command.h"
+
+extern char **environ;
+
+/*
+	A command with none of these characters is only words separated by
+	blanks, and means the same run directly as through the shell.
+*/
+#define SHELL_CHARS "|&;<>()$`\\\"'*?[]#~=%!{}\n"
+
+/* Words the shell gives a meaning of its own when they come first. */
+static const char *shell_words[] = {
+	".", ":", "alias", "bg", "break", "case", "cd", "command", "continue",
+	"eval", "exec", "exit", "export", "fc", "fg", "for", "getopts", "hash",
+	"if", "jobs", "read", "readonly", "return", "set", "shift", "source",
+	"times", "trap", "type", "ulimit", "umask", "unalias", "unset", "until",
+	"wait", "while", NULL
+};
+
+static int open_capture(){
+	const char *dir = getenv("TMPDIR");
+	char path[4096];
+	int fd;
+
+	snprintf(path, sizeof(path), "%s/parmake-XXXXXX", (dir != NULL && *dir != '\0') ? dir : "/tmp");
+	if((fd = mkostemp(path, O_CLOEXEC)) == -1) return -1;
+	unlink(path);
+	return fd;
+}
+
+/**
+ * Sets up where a job writes.  Without capture, or if no temporary file
+ * can be made, its commands write straight to parmake's output.
+ *
+ * @param output A pointer to the output.
+ * @param capture Non-zero to capture the job's output.
+ * @return Void.
+ */
+void command_output_init(command_output_t *output, int capture){
+	struct stat out_st, err_st;
+
+	output->out = output->err = -1;
+	if(!capture) return;
+	if((output->out = open_capture()) == -1) return;
+	if(fstat(STDOUT_FILENO, &out_st) == 0 && fstat(STDERR_FILENO, &err_st) == 0 &&
+			out_st.st_dev == err_st.st_dev && out_st.st_ino == err_st.st_ino){
+		output->err = output->out;
+		return;
+	}
+	if((output->err = open_capture()) == -1){
+		close(output->out);
+		output->out = -1;
+	}
+}
+
+/* Copies everything in the capture file to fd and empties it. */
+static void copy_capture(int capture, int fd){
+	char buf[65536];
+	ssize_t n, written;
+
+	lseek(capture, 0, SEEK_SET);
+	while((n = read(capture, buf, sizeof(buf))) > 0){
+		for(written = 0; written < n; ){
+			ssize_t w = write(fd, buf + written, n - written);
+			if(w == -1 && errno == EINTR) continue;
+			if(w == -1) break;
+			written += w;
+		}
+	}
+	ftruncate(capture, 0);
+	lseek(capture, 0, SEEK_SET);
+}
+
+/**
+ * Writes what the job's commands have written so far to parmake's own
+ * output, in one piece, and empties the capture.
+ *
+ * @param output A pointer to the output.
+ * @return Void.
+ */
+void command_output_flush(command_output_t *output){
+	if(output->out == -1) return;
+	fflush(stdout);
+	fflush(stderr);
+	copy_capture(output->out, STDOUT_FILENO);
+	if(output->err != output->out)
+		copy_capture(output->err, STDERR_FILENO);
+}
+
+/**
+ * Closes the capture files.  Anything not flushed is lost.
+ *
+ * @param output A pointer to the output.
+ * @return Void.
+ */
+void command_output_destroy(command_output_t *output){
+	if(output->err != output->out && output->err != -1) close(output->err);
+	if(output->out != -1) close(output->out);
+	output->out = output->err = -1;
+}
+
+static int needs_shell(const char *command, const char *first){
+	int i;
+	if(strpbrk(command, SHELL_CHARS) != NULL) return 1;
+	for(i = 0; shell_words[i] != NULL; i++)
+		if(strcmp(first, shell_words[i]) == 0) return 1;
+	return 0;
+}
+
+/**
+ * Starts one command.  A command that is only a program and its arguments
+ * is started directly with posix_spawnp(); anything else goes to
+ * /bin/sh -c, as system() would do.  The command starts with no signals
+ * blocked, whatever parmake blocks.
+ *
+ * @param command The command line.
+ * @param output Where it writes, or NULL for parmake's own output.
+ * @param pid Set to the command's process, or to -1 if there is none to
+ *        wait for: the command is empty, or could not be started.
+ * @return 0 if it started or is empty, 127 if it could not be started.
+ */
+int command_start(const char *command, const command_output_t *output, pid_t *pid){
+	posix_spawn_file_actions_t actions, *actions_ptr = NULL;
+	posix_spawnattr_t attr;
+	sigset_t none;
+	char *copy = strdup(command), **argv, *word, *saveptr;
+	char *shell_argv[] = { "sh", "-c", (char *)command, NULL };
+	int argc = 0, error;
+
+	*pid = -1;
+	argv = malloc((strlen(command) / 2 + 2) * sizeof(char *));
+	for(word = strtok_r(copy, " \t", &saveptr); word != NULL; word = strtok_r(NULL, " \t", &saveptr))
+		argv[argc++] = word;
+	argv[argc] = NULL;
+	if(argc == 0){
+		free(argv);
+		free(copy);
+		return 0;
+	}
+
+	if(output != NULL && output->out != -1){
+		posix_spawn_file_actions_init(&actions);
+		posix_spawn_file_actions_adddup2(&actions, output->out, STDOUT_FILENO);
+		posix_spawn_file_actions_adddup2(&actions, output->err, STDERR_FILENO);
+		actions_ptr = &actions;
+	}
+	sigemptyset(&none);
+	posix_spawnattr_init(&attr);
+	posix_spawnattr_setsigmask(&attr, &none);
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGMASK);
+
+	if(needs_shell(command, argv[0]))
+		error = posix_spawn(pid, "/bin/sh", actions_ptr, &attr, shell_argv, environ);
+	else
+		error = posix_spawnp(pid, argv[0], actions_ptr, &attr, argv, environ);
+
+	posix_spawnattr_destroy(&attr);
+	if(actions_ptr != NULL) posix_spawn_file_actions_destroy(actions_ptr);
+	if(error != 0){
+		*pid = -1;
+		dprintf((output != NULL && output->err != -1) ? output->err : STDERR_FILENO,
+				"parmake: %s: %s\n", argv[0], strerror(error));
+	}
+	free(argv);
+	free(copy);
+	return (error != 0) ? 127 : 0;
+}
+
+/**
+ * What became of a command, from the status waitpid() gave for it.
+ *
+ * @param status The wait status.
+ * @return 0 if it succeeded; otherwise its exit status, or 128 plus the
+ *         signal that killed it.
+ */
+int command_status(int status){
+	if(WIFEXITED(status)) return WEXITSTATUS(status);
+	if(WIFSIGNALED(status)) return 128 + WTERMSIG(status);
+	return 127;
+}
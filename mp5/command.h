@@ -0,0 +1,24 @@
+/** @file command.h */
+#ifndef __COMMAND_H__
+#define __COMMAND_H__
+
+#include <sys/types.h>
+
+/**
+ * Where a job's commands write.  With capture, each stream goes to a
+ * temporary file until command_output_flush() copies it to parmake's own,
+ * so jobs running at the same time do not mix their output.
+ */
+typedef struct{
+	int out; ///<File holding standard output, -1 to write to parmake's directly
+	int err; ///<File holding standard error, the same as out when parmake's two streams are one file
+} command_output_t;
+
+void command_output_init(command_output_t *output, int capture);
+void command_output_flush(command_output_t *output);
+void command_output_destroy(command_output_t *output);
+
+int command_start(const char *command, const command_output_t *output, pid_t *pid);
+int command_status(int status);
+
+#endif
@@ -0,0 +1,201 @@
+/** @file jobserver.c */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "jobserver.h"
+
+#define TOKEN '+'
+
+/*
+	The pipe itself is left blocking, as other makes expect.  We read it
+	through a file description of our own, opened from /proc/self/fd and
+	made non-blocking, so that waiting for a token never stops us reaping
+	the jobs we already have.
+*/
+static int open_reader(const char *path){
+	return open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+}
+
+static int open_fd_reader(int fd){
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+	return open_reader(path);
+}
+
+/* Value of --jobserver-auth= (or the older --jobserver-fds=) in MAKEFLAGS, up to the next blank. */
+static char *find_auth(){
+	const char *flags = getenv("MAKEFLAGS"), *p, *found = NULL;
+	static const char *names[] = { "--jobserver-auth=", "--jobserver-fds=", NULL };
+	int i;
+
+	if(flags == NULL) return NULL;
+	// the last one wins, as in make
+	for(i = 0; names[i] != NULL; i++)
+		for(p = flags; (p = strstr(p, names[i])) != NULL; p += strlen(names[i]))
+			if(found == NULL || p > found) found = p + strlen(names[i]);
+	return (found != NULL) ? strndup(found, strcspn(found, " \t")) : NULL;
+}
+
+/* Rewrites MAKEFLAGS without its -j and jobserver flags, and with extra, if not NULL, added. */
+static void set_makeflags(const char *extra){
+	const char *flags = getenv("MAKEFLAGS"), *p;
+	size_t len = (flags != NULL ? strlen(flags) : 0) + (extra != NULL ? strlen(extra) : 0) + 2;
+	char *buf = malloc(len), *out = buf;
+
+	for(p = flags; p != NULL && *p != '\0'; ){
+		size_t word = strcspn(p, " \t");
+		if(word > 0 && strncmp(p, "--jobserver-", 12) != 0 && strncmp(p, "-j", 2) != 0){
+			if(out != buf) *out++ = ' ';
+			memcpy(out, p, word);
+			out += word;
+		}
+		p += word;
+		p += strspn(p, " \t");
+	}
+	if(extra != NULL){
+		if(out != buf) *out++ = ' ';
+		strcpy(out, extra);
+		out += strlen(extra);
+	}
+	*out = '\0';
+
+	if(out == buf)
+		unsetenv("MAKEFLAGS");
+	else
+		setenv("MAKEFLAGS", buf, 1);
+	free(buf);
+}
+
+/* Joins the jobserver auth names, either "R,W" or "fifo:PATH". */
+static int join(jobserver_t *js, const char *auth){
+	int r, w;
+
+	if(strncmp(auth, "fifo:", 5) == 0){
+		if((js->read_fd = open_reader(auth + 5)) == -1) return 0;
+		if((js->write_fd = open(auth + 5, O_WRONLY | O_CLOEXEC)) == -1){
+			close(js->read_fd);
+			js->read_fd = -1;
+			return 0;
+		}
+		return 1;
+	}
+	if(sscanf(auth, "%d,%d", &r, &w) != 2) return 0;
+	if(r < 0 || w < 0 || fcntl(r, F_GETFD) == -1 || fcntl(w, F_GETFD) == -1) return 0;
+	if((js->read_fd = open_fd_reader(r)) == -1) return 0;
+	js->write_fd = w;
+	return 1;
+}
+
+/* Creates the pipe with jobs - 1 tokens and names it in MAKEFLAGS for the commands we run. */
+static int create(jobserver_t *js, int jobs){
+	char flags[128];
+	int fds[2], i;
+
+	if(pipe(fds) == -1) return 0;
+	if((js->read_fd = open_fd_reader(fds[0])) == -1){
+		close(fds[0]);
+		close(fds[1]);
+		return 0;
+	}
+	js->write_fd = fds[1];
+	for(i = 1; i < jobs; i++){
+		char token = TOKEN;
+		if(write(fds[1], &token, 1) != 1) break;
+	}
+	// fds[0] stays open, for the commands to inherit
+	snprintf(flags, sizeof(flags), "-j%d --jobserver-auth=%d,%d", jobs, fds[0], fds[1]);
+	set_makeflags(flags);
+	return 1;
+}
+
+/**
+ * Joins the jobserver named in MAKEFLAGS, or creates one for jobs.  An
+ * explicit -j in a make run by another one gets a jobserver of its own,
+ * as in GNU make.  Without a jobserver the caller limits itself to jobs.
+ *
+ * @param js A pointer to the jobserver.
+ * @param jobs The -j given, or 0 if none was.
+ * @return Void.
+ */
+void jobserver_init(jobserver_t *js, int jobs){
+	char *auth = find_auth();
+
+	js->read_fd = js->write_fd = -1;
+	token_vector_init(&js->held);
+
+	if(auth != NULL && jobs == 0){
+		if(!join(js, auth)){
+			fprintf(stderr, "parmake: warning: jobserver unavailable: using -j1.\n");
+			set_makeflags(NULL);
+		}
+		free(auth);
+		return;
+	}
+	if(auth != NULL)
+		fprintf(stderr, "parmake: warning: -j%d forced in submake: disabling jobserver mode.\n", jobs);
+	free(auth);
+	if(jobs <= 1 || !create(js, jobs))
+		set_makeflags(NULL);
+}
+
+/**
+ * @param js A pointer to the jobserver.
+ * @return Non-zero if there is a jobserver to take tokens from.
+ */
+int jobserver_active(jobserver_t *js){
+	return js->read_fd != -1;
+}
+
+/**
+ * Takes a token, without waiting for one.  When there is none, the
+ * jobserver's file becomes readable once one might be back; poll() for
+ * POLLIN on read_fd.
+ *
+ * @param js A pointer to an active jobserver.
+ * @return 1 if a token was taken, 0 if there is none now.
+ */
+int jobserver_acquire(jobserver_t *js){
+	char token;
+	ssize_t n;
+
+	while((n = read(js->read_fd, &token, 1)) == -1 && errno == EINTR)
+		;
+	if(n != 1) return 0;
+	token_vector_push(&js->held, token);
+	return 1;
+}
+
+/**
+ * Gives back the last token taken.
+ *
+ * @param js A pointer to an active jobserver.
+ * @return Void.
+ */
+void jobserver_release(jobserver_t *js){
+	char token;
+	if(token_vector_size(&js->held) == 0) return;
+	token = token_vector_pop(&js->held);
+	while(write(js->write_fd, &token, 1) == -1 && errno == EINTR)
+		;
+}
+
+/**
+ * Gives back every token still held and closes our reader.  The pipe
+ * stays open for whatever else still uses it.
+ *
+ * @param js A pointer to the jobserver.
+ * @return Void.
+ */
+void jobserver_destroy(jobserver_t *js){
+	if(js->read_fd != -1){
+		while(token_vector_size(&js->held) > 0)
+			jobserver_release(js);
+		close(js->read_fd);
+	}
+	js->read_fd = js->write_fd = -1;
+	token_vector_destroy(&js->held);
+}
@@ -0,0 +1,30 @@
+/** @file jobserver.h */
+#ifndef __JOBSERVER_H__
+#define __JOBSERVER_H__
+
+#include "containers.h"
+
+CONTAINER_VECTOR(token_vector, char)
+
+/**
+ * GNU Make Jobserver
+ *
+ * A pipe shared by every make in a recursive build, holding one byte per
+ * job that may run beyond the one each make always may.  A make takes a
+ * byte before starting another job and writes the same byte back when it
+ * ends.  The top make creates the pipe and names it in MAKEFLAGS as
+ * --jobserver-auth=R,W; a make that finds it there shares it.
+ */
+typedef struct{
+	int read_fd; ///<Our own non-blocking way into the pipe, -1 without a jobserver
+	int write_fd; ///<Where tokens go back
+	token_vector_t held; ///<Tokens taken and not given back yet
+} jobserver_t;
+
+void jobserver_init(jobserver_t *js, int jobs);
+int jobserver_active(jobserver_t *js);
+int jobserver_acquire(jobserver_t *js);
+void jobserver_release(jobserver_t *js);
+void jobserver_destroy(jobserver_t *js);
+
+#endif
@@ -3,13 +3,23 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
-#include <pthread.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/signalfd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
 
 #include "parser.h"
+#include "command.h"
+#include "profile.h"
+#include "containers.h"
+#include "jobserver.h"
 #include "queue.h"
 #include "rule.h"
+#include "state.h"
 
 #define EXITERROR(e) _error_out_(__FUNCTION__,__LINE__,e)
 
@@ -24,19 +34,62 @@
 	#define D(x)
 #endif
 
-#define _buf_len_ 200
+#define TIMES_FILE ".parmake-times"
+#define STATE_FILE ".parmake-state"
+#define PROFILE_TOP 10
 
 typedef enum { False=0, True=1} boolean;
-int max_threads = 0;
+int max_jobs = 1; // jobs at once when there is no jobserver
+boolean keep_going = False; // -k: after a failure, build whatever does not depend on it
+boolean profile = False; // -p: print where the build's time went
 
-pthread_mutex_t mutex1 = PTHREAD_MUTEX_INITIALIZER;
-pthread_mutex_t mutex2 = PTHREAD_MUTEX_INITIALIZER;
-pthread_cond_t  cond   = PTHREAD_COND_INITIALIZER;
-queue_t* new_rules;
+/*
+	The rules form a DAG: each rule counts its dependencies that are rules
+	and not yet done, and lists the rules that depend on it.  A rule whose
+	count reaches zero goes on ready_rules.  The event loop in run_build()
+	starts the ready rule with the longest expected path to a goal first,
+	so long chains start early.  It is parmake's only thread: it keeps as
+	many rules running as child processes as it has job slots for, and
+	waits for them to exit on a signalfd.
+*/
+queue_t* new_rules; // every rule, in makefile order
+parser_t* makefile_strings; // owns every target, dependency and command
+
+rule_table_t all_targets; // every rule, by target
 
-queue_t* all_targets;
+state_db_t build_state; // what the last build saw, read-only while the build runs
 
-queue_t* ready_rules;
+#define RULE_BEFORE(a, b) ((*(a))->priority > (*(b))->priority || \
+	((*(a))->priority == (*(b))->priority && (*(a))->index < (*(b))->index))
+CONTAINER_HEAP(rule_heap, rule_t *, RULE_BEFORE)
+
+rule_heap_t ready_rules; // pending rules whose dependencies are done
+int rules_left; // rules not yet done or failed
+boolean build_failed = False; // a rule failed; without keep_going, start no more
+
+/*
+	A rule whose commands are running, one at a time.  Its first job slot
+	is parmake's own; every other one in use holds a jobserver token.
+*/
+typedef struct{
+	rule_t* rule;
+	int next; // command to start when the running one succeeds
+	pid_t pid; // the running command
+	int slot; // lowest not taken by another running job
+	double start;
+	command_output_t output; // kept with the job when it is idle, to be reused
+} job_t;
+
+CONTAINER_VECTOR(job_vector, job_t *)
+
+job_vector_t jobs; // running
+job_vector_t idle_jobs; // finished, to be reused
+jobserver_t jobserver;
+boolean capture_output = False; // jobs may run at the same time
+int child_events = -1; // signalfd for SIGCHLD
+double build_start; // when run_build() started, what rule times are relative to
+double build_time; // how long it took
+int slots_used = 0; // highest job slot taken, plus one
 
 void _error_out_(const char* func,  int line, const char* error)
 {
@@ -46,77 +99,51 @@ void _error_out_(const char* func,  int line, const char* error)
 
 void new_targets(char* targets)
 {
+	// a target named on more than one line is one rule
+	if(rule_table_find(&all_targets,targets) != NULL) return;
 
 	rule_t* newrule = (rule_t*)malloc(sizeof(rule_t));
 	rule_init(newrule);
 
-	newrule->target = (char*)malloc(sizeof(char)*_buf_len_);
-	strcpy(newrule->target,targets);
+	newrule->target = targets;
+	newrule->index = queue_size(new_rules);
 
 	// insert into rules queue.
 	queue_enqueue(new_rules,newrule);
 
 	// insert into all_targets
-	queue_enqueue(all_targets,newrule->target);
+	rule_table_insert(&all_targets,newrule);
 }
 
 void new_dependency(char *target, char *dependency )
 {
-	int i;
-	rule_t * ptr = NULL;
-	char * depbuf = (char*)malloc(sizeof(char)*_buf_len_);
-	strcpy(depbuf,dependency);
-	for(i=0;i<queue_size(new_rules);i++){
-		ptr = (rule_t*)queue_at(new_rules,i);
-		if(strcmp(ptr->target,target)==0){
-			// insert dependencies into the target.
-			queue_enqueue(ptr->deps,depbuf);
-			return;
-		}
-	}
-	EXITERROR("no target found!!!!");
-	return;
+	rule_t * ptr = rule_table_find(&all_targets,target);
+	if(ptr == NULL) EXITERROR("no target found!!!!");
+
+	queue_enqueue(ptr->deps,dependency);
 }
 
-void new_command(char *target, char *command)
+void new_order_dependency(char *target, char *dependency)
 {
-	char* command_buf = (char*)malloc(_buf_len_);
-	strcpy(command_buf,command);
-	rule_t * ptr = NULL;
-	int i;
-	for(i=0;i<queue_size(new_rules);i++){
-		ptr = (rule_t*)queue_at(new_rules,i);
-		if(strcmp(ptr->target,target)==0){
-			// insert dependencies into the target.
-			queue_enqueue(ptr->commands,command_buf);
-			return;
-		}
-	}
+	rule_t * ptr = rule_table_find(&all_targets,target);
+	if(ptr == NULL) EXITERROR("no target found!!!!");
 
-	EXITERROR("no target found!!!!");
-	return;
+	queue_enqueue(ptr->order_deps,dependency);
 }
 
-void free_rule(rule_t* p_rule)
+void new_command(char *target, char *command)
 {
-	char* ptr=NULL;
-	while( (ptr = (char*)queue_dequeue(p_rule->deps)) != NULL){
-		free(ptr);
-	}
-	while( (ptr = (char*)queue_dequeue(p_rule->commands)) != NULL){
-		free(ptr);
-	}
-
-	if(p_rule->target != NULL) free(p_rule->target);
+	rule_t * ptr = rule_table_find(&all_targets,target);
+	if(ptr == NULL) EXITERROR("no target found!!!!");
 
-	rule_destroy(p_rule);
-	free(p_rule);
+	queue_enqueue(ptr->commands,command);
 }
 
-void free_queue(queue_t * ptr)
+// its strings belong to makefile_strings
+void free_rule(rule_t* p_rule)
 {
-	queue_destroy(ptr);
-	free(ptr);
+	rule_destroy(p_rule);
+	free(p_rule);
 }
 
 void free_rule_queue(queue_t * p_queue)
@@ -131,200 +158,469 @@ void free_rule_queue(queue_t * p_queue)
 
 boolean is_rule(char* item)
 {
-	int i;
-	for(i=0;i<queue_size(all_targets);i++)
+	return rule_table_find(&all_targets,item) != NULL;
+}
+
+/*
+	TIMES_FILE holds one line per target, "<seconds> <target>", with how
+	long its commands took the last time they ran.  Lines for targets not
+	in this build are kept in other_times and written back unchanged.
+*/
+queue_t other_times;
+
+void load_times()
+{
+	FILE* f = fopen(TIMES_FILE,"r");
+	char* line = NULL;
+	size_t bytes = 0;
+	double seconds;
+	int offset;
+	rule_t* rule_ptr;
+
+	queue_init(&other_times);
+	if(f == NULL) return;
+	while(getline(&line,&bytes,f) != -1)
 	{
-		if(strcmp(item, queue_at(all_targets,i))==0 )
-			return True;
+		line[strcspn(line,"\n")] = '\0';
+		if(sscanf(line,"%lf %n",&seconds,&offset) != 1 || line[offset] == '\0') continue;
+		if((rule_ptr = rule_table_find(&all_targets,line + offset)) != NULL)
+			rule_ptr->duration = seconds;
+		else
+			queue_enqueue(&other_times,strdup(line));
 	}
-	return False;
+	free(line);
+	fclose(f);
 }
 
-boolean rule_is_ready(char* item)
+void save_times()
 {
-	int i;
-	boolean value = False;
-	pthread_mutex_lock(&mutex2);
-	for (i = 0; i < queue_size(ready_rules); ++i)
+	int i,measured = 0;
+	rule_t* rule_ptr;
+	char* line;
+	FILE* f = NULL;
+	for(i=0;i<queue_size(new_rules);i++)
+		measured |= ((rule_t*)queue_at(new_rules,i))->measured;
+	// nothing new to record
+	if(measured) f = fopen(TIMES_FILE ".tmp","w");
+	if(f == NULL){
+		while((line = queue_dequeue(&other_times)) != NULL) free(line);
+		queue_destroy(&other_times);
+		return;
+	}
+	for(i=0;i<queue_size(new_rules);i++)
 	{
-		if( strcmp(item,((rule_t*)queue_at(ready_rules,i)) -> target)==0 )
-		{
-				value = True;
-				break;
-		}
+		rule_ptr = queue_at(new_rules,i);
+		if(rule_ptr->duration >= 0)
+			fprintf(f,"%.6f %s\n",rule_ptr->duration,rule_ptr->target);
 	}
-	pthread_mutex_unlock(&mutex2);
-	return value;
-
+	while((line = queue_dequeue(&other_times)) != NULL)
+	{
+		fprintf(f,"%s\n",line);
+		free(line);
+	}
+	queue_destroy(&other_times);
+	if(fclose(f) == 0) rename(TIMES_FILE ".tmp",TIMES_FILE);
 }
 
-boolean deps_are_ready(queue_t *deps)
+/*
+	Makes rule_ptr a dependent of every rule among deps.
+*/
+void link_dependencies(rule_t* rule_ptr, queue_t* deps)
 {
-	if(queue_size(deps) == 0) return True;
-
 	int i;
-	char errorbuf[100];
-	char* item = NULL;
-	int size = queue_size(deps);
-	for(i=0;i<size;i++)
+	rule_t* dep_ptr;
+	for(i=0;i<queue_size(deps);i++)
 	{
-		item = queue_at(deps,i);
-		if(is_rule(item)){
-			if(rule_is_ready(item)==False)
-				return False;
-		}
-		else{
-			if(access(item,R_OK)==-1){
-				sprintf(errorbuf,"File %s does not exist.",item);
-				EXITERROR(errorbuf);
-			}
-		}
+		dep_ptr = rule_table_find(&all_targets,queue_at(deps,i));
+		if(dep_ptr == NULL) continue;
+		queue_enqueue(dep_ptr->dependents,rule_ptr);
+		rule_ptr->remaining++;
 	}
-	return True;
-
 }
 
-rule_t* fetch_rules_torun()
+/*
+	Links every rule to the rules it depends on, gives each its priority,
+	and queues the rules with no dependencies as ready.  Dependencies that
+	are not rules are files, checked when the rule runs.
+
+	A rule's priority is the expected time of the longest path from it
+	through its dependents to a goal.  Rules with no recorded time count
+	as the mean of the recorded ones, or 1 if there are none, which makes
+	the priority the rule's depth below its goal.
+*/
+void build_graph()
 {
-	int i;
-	int size = queue_size(new_rules);
-	rule_t * rule_ptr=NULL;
-	int selected_pos = -1;
-	if(size==0) return NULL;
-	for(i=0;i<size;i++){
-		// no dependencies
+	int i,j,known = 0;
+	double guess = 0, longest;
+	rule_t *rule_ptr, *dep_ptr;
+	queue_t order;
+	for(i=0;i<queue_size(new_rules);i++)
+	{
 		rule_ptr = queue_at(new_rules,i);
-		if(queue_size(rule_ptr->deps) == 0){
-			selected_pos = i;
-			break; 
+		link_dependencies(rule_ptr,rule_ptr->deps);
+		link_dependencies(rule_ptr,rule_ptr->order_deps);
+		if(rule_ptr->duration >= 0){
+			guess += rule_ptr->duration;
+			known++;
 		}
-		else if(deps_are_ready(rule_ptr->deps)){
-			selected_pos = i;
-			break;
+	}
+	guess = known ? guess / known : 1;
+
+	// topological order, dependencies first; remaining is restored on the way
+	queue_init(&order);
+	for(i=0;i<queue_size(new_rules);i++)
+	{
+		rule_ptr = queue_at(new_rules,i);
+		if(rule_ptr->remaining == 0)
+			queue_enqueue(&order,rule_ptr);
+	}
+	for(i=0;i<queue_size(&order);i++)
+	{
+		rule_ptr = queue_at(&order,i);
+		for(j=0;j<queue_size(rule_ptr->dependents);j++)
+		{
+			dep_ptr = queue_at(rule_ptr->dependents,j);
+			if(--dep_ptr->remaining == 0)
+				queue_enqueue(&order,dep_ptr);
 		}
 	}
-	if(selected_pos == -1) {
-		return NULL;
+	for(i=0;i<queue_size(new_rules);i++)
+	{
+		rule_ptr = queue_at(new_rules,i);
+		for(j=0;j<queue_size(rule_ptr->dependents);j++)
+			((rule_t*)queue_at(rule_ptr->dependents,j))->remaining++;
 	}
-	else{
-		D(printf("fetched: %s\n",((rule_t*)queue_at(new_rules,selected_pos))->target ));
-		return queue_remove_at(new_rules,selected_pos);
+
+	// longest paths, dependents first; rules on a cycle keep only their own time
+	for(i=queue_size(&order)-1;i>=0;i--)
+	{
+		rule_ptr = queue_at(&order,i);
+		longest = 0;
+		for(j=0;j<queue_size(rule_ptr->dependents);j++)
+		{
+			dep_ptr = queue_at(rule_ptr->dependents,j);
+			if(dep_ptr->priority > longest) longest = dep_ptr->priority;
+		}
+		rule_ptr->priority = (rule_ptr->duration >= 0 ? rule_ptr->duration : guess) + longest;
 	}
+	queue_destroy(&order);
+
+	rule_heap_init(&ready_rules);
+	for(i=0;i<queue_size(new_rules);i++)
+	{
+		rule_ptr = queue_at(new_rules,i);
+		if(rule_ptr->remaining == 0)
+			rule_heap_push(&ready_rules,rule_ptr);
+	}
+	rules_left = queue_size(new_rules);
 }
 
-void run_the_rule(rule_t* rule_ptr)
+/*
+	Whether rules may still start: none failed, or keep_going.
+*/
+boolean may_start()
 {
-	int i,ret;
-	char* command;
-	D(char errorbuf[100]);
-	queue_t * commands = rule_ptr -> commands;
-	D(printf("to run: %s\n",rule_ptr->target));
-	for(i=0;i<queue_size(commands);i++)
+	return !build_failed || keep_going;
+}
+
+/*
+	Marks the rule done and queues the rules it was the last dependency of.
+*/
+void rule_finished(rule_t* rule_ptr)
+{
+	int i;
+	rule_t* dependent;
+	rule_ptr->state = RULE_DONE;
+	rules_left--;
+	for(i=0;i<queue_size(rule_ptr->dependents);i++)
 	{
-		command = queue_at(commands,i);
-		D(printf("%s\n",command));
-		ret = system(command);
-		if(ret != 0){
-			D(sprintf(errorbuf,"Error running command: %s",command));
-			D(PRINTERROR(errorbuf));
-			exit(1);
-		}
+		dependent = queue_at(rule_ptr->dependents,i);
+		if(--dependent->remaining == 0)
+			rule_heap_push(&ready_rules,dependent);
 	}
 }
 
 /*
-	If the rule has dependents and all dependents are not rules but files on the disk
-		return True
-	Else return false.
+	Marks the rule failed, and with it every rule that depends on it,
+	directly or not; none of them will run.
 */
-boolean all_deps_are_files(rule_t* rule_ptr)
+void rule_failed(rule_t* rule_ptr)
 {
-	if(queue_size(rule_ptr->deps) == 0) return False;
+	int i,j;
+	rule_t *failed_ptr, *dependent;
+	queue_t failed;
+	rule_ptr->state = RULE_FAILED;
+	build_failed = True;
+	queue_init(&failed);
+	queue_enqueue(&failed,rule_ptr);
+	for(i=0;i<queue_size(&failed);i++)
+	{
+		failed_ptr = queue_at(&failed,i);
+		for(j=0;j<queue_size(failed_ptr->dependents);j++)
+		{
+			dependent = queue_at(failed_ptr->dependents,j);
+			if(dependent->state != RULE_PENDING) continue;
+			dependent->state = RULE_FAILED;
+			queue_enqueue(&failed,dependent);
+		}
+	}
+	rules_left -= queue_size(&failed);
+	queue_destroy(&failed);
+}
 
+/*
+	Whether every name in deps that is not a rule is a readable file.
+*/
+boolean files_exist(queue_t* deps)
+{
 	int i;
-	for(i=0;i<queue_size(rule_ptr->deps);i++)
+	char errorbuf[100];
+	char* item = NULL;
+	for(i=0;i<queue_size(deps);i++)
 	{
-		if(is_rule(queue_at(rule_ptr->deps,i)))
+		item = queue_at(deps,i);
+		if(!is_rule(item) && access(item,R_OK)==-1){
+			snprintf(errorbuf,sizeof(errorbuf),"File %s does not exist.",item);
+			PRINTERROR(errorbuf);
 			return False;
+		}
 	}
-
 	return True;
 }
 
-/* if modification time of file 1 is later than file 2, return 1
-	else return -1
+/*
+	Whether every dependency that is not a rule, order-only or not, is a
+	readable file.
 */
-double modicomp(char* file1, char* file2)
+boolean check_file_deps(rule_t* rule_ptr)
 {
-	struct stat s1, s2;
+	return files_exist(rule_ptr->deps) && files_exist(rule_ptr->order_deps);
+}
 
-	if (stat(file1, &s1) == -1) {
-		printf("stat error for file %s",file1);
-        EXITERROR(NULL);
-    }
-    if (stat(file2, &s2) == -1) {
-        printf("stat error for file %s",file2);
-        EXITERROR(NULL);
-    }
+double seconds()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
 
+/*
+	Whether the rule must run: its target does not exist, or the build-state
+	database says an input changed.  Stamps the rule's dependencies either
+	way, so the database can record them.
+*/
+boolean rule_is_stale(rule_t* rule_ptr)
+{
+	struct stat st;
+	boolean exists = stat(rule_ptr->target,&st) == 0;
+	boolean current = state_is_current(&build_state,rule_ptr,exists ? &st : NULL);
+	return !exists || !current;
+}
 
-    return difftime(s1.st_mtime,s2.st_mtime);
 
+/*
+	Records what the rule was built from and marks it done or failed.
+*/
+void rule_over(rule_t* rule_ptr, boolean ok)
+{
+	rule_ptr->finished = seconds() - build_start;
+	if(ok){
+		// up to date now; record what it was built from, unless a dependency is not a file
+		rule_ptr->recorded = rule_ptr->stamps != NULL;
+		rule_finished(rule_ptr);
+	}else{
+		if(rule_ptr->stamps != NULL){
+			// the target may be half made; record commands that match nothing, so it runs next time
+			rule_ptr->command_hash = ~rule_ptr->command_hash;
+			rule_ptr->recorded = True;
+		}
+		rule_failed(rule_ptr);
+	}
 }
 
-
-void* rule_server(void* ptr)
+/*
+	Moves the job on once its running command has exited with ret, or, for
+	a new job, starts it: starts its next command, or ends it if that was
+	the last one or ret says the command failed.
+*/
+void job_step(job_t* job, int ret)
 {
-	rule_t* rule_ptr = NULL;
-	int remain_size = 0;
 	int i;
+	queue_t* commands = job->rule->commands;
+	job->pid = -1;
+	while(ret == 0 && job->pid == -1 && job->next < queue_size(commands))
+	{
+		D(printf("%s\n",(char*)queue_at(commands,job->next)));
+		ret = command_start(queue_at(commands,job->next++),&job->output,&job->pid);
+	}
+	if(job->pid != -1) return;
+
+	if(ret != 0){
+		job->rule->exit_status = ret;
+		dprintf(job->output.err != -1 ? job->output.err : STDERR_FILENO,
+			"parmake: *** [%s] Error %d\n",job->rule->target,ret);
+	}else{
+		job->rule->duration = seconds() - job->start;
+		job->rule->measured = 1;
+	}
+	command_output_flush(&job->output);
+
+	for(i=0;*job_vector_at(&jobs,i) != job;i++)
+		;
+	*job_vector_at(&jobs,i) = *job_vector_at(&jobs,job_vector_size(&jobs)-1);
+	job_vector_pop(&jobs);
+	job_vector_push(&idle_jobs,job);
+	// the last job running uses parmake's own slot
+	if(job_vector_size(&jobs) > 0 && jobserver_active(&jobserver))
+		jobserver_release(&jobserver);
+	rule_over(job->rule,ret == 0);
+}
 
-	do{
-		pthread_mutex_lock(&mutex1);
-		remain_size = queue_size(new_rules);
-		while((rule_ptr = fetch_rules_torun()) == NULL){
-			remain_size = queue_size(new_rules);
-			if( remain_size > 0)
-				pthread_cond_wait(&cond,&mutex1);
-			else{
-				break;
-			}
-		}
-		pthread_mutex_unlock(&mutex1);
-		if(remain_size == 0) break;
-		
-		
-		// deal with rule_ptr
-		if(all_deps_are_files(rule_ptr))
-		{
-			if(access(rule_ptr->target,F_OK) ==-1 )
-				run_the_rule(rule_ptr);
-			else{
-				for(i=0;i<queue_size(rule_ptr->deps);i++)
-					if( modicomp(queue_at(rule_ptr->deps,i),rule_ptr->target) >= 0){
-						run_the_rule(rule_ptr);
-						break;
-					}
+/*
+	The lowest job slot no running job has.
+*/
+int free_slot()
+{
+	int slot,i;
+	for(slot=0;;slot++)
+	{
+		for(i=0;i<job_vector_size(&jobs);i++)
+			if((*job_vector_at(&jobs,i))->slot == slot) break;
+		if(i == job_vector_size(&jobs)) return slot;
+	}
+}
+
+void start_job(rule_t* rule_ptr)
+{
+	job_t* job;
+	D(printf("to run: %s\n",rule_ptr->target));
+	if(job_vector_size(&idle_jobs) > 0){
+		job = job_vector_pop(&idle_jobs);
+	}else{
+		job = malloc(sizeof(job_t));
+		command_output_init(&job->output,capture_output);
+	}
+	job->rule = rule_ptr;
+	job->next = 0;
+	job->slot = free_slot();
+	job->start = seconds();
+	if(job->slot >= slots_used) slots_used = job->slot + 1;
+	rule_ptr->slot = job->slot;
+	rule_ptr->started = job->start - build_start;
+	job_vector_push(&jobs,job);
+	job_step(job,0);
+}
+
+/*
+	Starts ready rules while there is a job slot for each.  A rule that is
+	up to date, or cannot run, is over at once and gives its slot back.
+*/
+void start_jobs()
+{
+	rule_t* rule_ptr;
+	boolean token;
+	while(rule_heap_size(&ready_rules) > 0 && may_start())
+	{
+		token = False;
+		if(job_vector_size(&jobs) > 0){
+			if(jobserver_active(&jobserver)){
+				if(!jobserver_acquire(&jobserver)) return;
+				token = True;
+			}else if(job_vector_size(&jobs) >= max_jobs){
+				return;
 			}
 		}
-		else{
-			run_the_rule(rule_ptr);
-		}
-
-		
 
+		rule_ptr = rule_heap_pop(&ready_rules);
+		D(printf("fetched: %s\n",rule_ptr->target));
+		rule_ptr->state = RULE_RUNNING;
+		rule_ptr->started = seconds() - build_start;
+		if(!check_file_deps(rule_ptr)){
+			rule_over(rule_ptr,False);
+		}else if(!rule_is_stale(rule_ptr)){
+			rule_over(rule_ptr,True);
+		}else{
+			start_job(rule_ptr);
+			continue;
+		}
+		if(token) jobserver_release(&jobserver);
+	}
+}
 
-		// need to do more judge.
-		pthread_mutex_lock(&mutex2);
-		queue_enqueue(ready_rules,rule_ptr);
-		pthread_cond_broadcast(&cond);
-		pthread_mutex_unlock(&mutex2);
+/*
+	Waits until a command exits, or, if want_token, until the jobserver
+	may have a token, and moves on the job of every command that exited.
+*/
+void wait_for_jobs(boolean want_token)
+{
+	struct pollfd fds[2];
+	struct signalfd_siginfo info;
+	int i,status,nfds = 1;
+	pid_t pid;
+	job_t* job;
+
+	fds[0].fd = child_events;
+	fds[0].events = POLLIN;
+	if(want_token){
+		fds[1].fd = jobserver.read_fd;
+		fds[1].events = POLLIN;
+		nfds = 2;
+	}
+	if(poll(fds,nfds,-1) == -1 && errno != EINTR) EXITERROR("poll failed.");
+	while(read(child_events,&info,sizeof(info)) > 0)
+		;
 
-			
-	}while(remain_size > 0);
+	while((pid = waitpid(-1,&status,WNOHANG)) > 0)
+	{
+		for(i=0;i<job_vector_size(&jobs);i++)
+		{
+			job = *job_vector_at(&jobs,i);
+			if(job->pid == pid){
+				job_step(job,command_status(status));
+				break;
+			}
+		}
+	}
+}
 
-	return NULL;
+/*
+	Runs the build, until every rule is over, or until the running jobs
+	are once a rule failed and keep_going is not set.  SIGCHLD stays
+	blocked and is read from child_events instead.
+*/
+void run_build()
+{
+	sigset_t mask;
+	job_t* job;
+
+	sigemptyset(&mask);
+	sigaddset(&mask,SIGCHLD);
+	sigprocmask(SIG_BLOCK,&mask,NULL);
+	if((child_events = signalfd(-1,&mask,SFD_NONBLOCK|SFD_CLOEXEC)) == -1)
+		EXITERROR("signalfd failed.");
+	capture_output = max_jobs > 1 || jobserver_active(&jobserver);
+	build_start = seconds();
+	job_vector_init(&jobs);
+	job_vector_init(&idle_jobs);
+
+	while(1)
+	{
+		start_jobs();
+		if(job_vector_size(&jobs) == 0) break;
+		wait_for_jobs(rule_heap_size(&ready_rules) > 0 && may_start() && jobserver_active(&jobserver));
+	}
+	if(rules_left > 0 && may_start()) EXITERROR("circular dependency, no rule can run.");
+	build_time = seconds() - build_start;
 
+	while(job_vector_size(&idle_jobs) > 0)
+	{
+		job = job_vector_pop(&idle_jobs);
+		command_output_destroy(&job->output);
+		free(job);
+	}
+	job_vector_destroy(&idle_jobs);
+	job_vector_destroy(&jobs);
+	close(child_events);
 }
 
 /**
@@ -334,40 +630,39 @@ int main(int argc, char **argv)
 {
 	//char errorbuf[200];
 
-	int opt,i,next;
-	int threads = 1;
+	int opt;
+	int jobs_flag = 0;
 	char* makefile = NULL;
+	char* trace_file = NULL;
+	int slots;
 	char filebuf[100];
-	int n_targets = 0;
 	char** targets = NULL;
 
-	while ((opt = getopt(argc, argv, "j:f:")) != -1) {
+	while ((opt = getopt(argc, argv, "j:f:kpt:")) != -1) {
         switch (opt) {
         case 'j':
-            threads = atoi(optarg);
+            jobs_flag = atoi(optarg);
             break;
         case 'f':
             makefile = optarg;
             break;
+        case 'k':
+            keep_going = True;
+            break;
+        case 'p':
+            profile = True;
+            break;
+        case 't':
+            trace_file = optarg;
+            break;
         default: /* '?' */
-            fprintf(stderr, "Usage: %s [-j threads] [-f makefile] [targets]\n",
+            fprintf(stderr, "Usage: %s [-j jobs] [-f makefile] [-k] [-p] [-t trace.json] [targets]\n",
                     argv[0]);
             return 0;
         }
     }
-    // read targets.
-    if(optind < argc)
-    {
-    	n_targets = argc - optind;
-    	next = optind;
-    	targets = (char**)malloc(sizeof(char*)*n_targets+sizeof(char*));
-    	for(i=0;i<n_targets;i++){
-    		targets[i] = malloc(50);
-    		strcpy(targets[i],argv[next]);
-    		next ++;
-    	}
-    	targets[n_targets] = NULL;
-    }
+    // read targets; argv ends with NULL.
+    if(optind < argc) targets = argv + optind;
 
     // check access of make file
     if(makefile != NULL){
@@ -390,37 +685,33 @@ int main(int argc, char **argv)
     }
     // initialize the global values.
     new_rules   = (queue_t*)malloc(sizeof(queue_t));
-    ready_rules = (queue_t*)malloc(sizeof(queue_t));
-    all_targets = (queue_t*)malloc(sizeof(queue_t));
     queue_init(new_rules);
-    queue_init(ready_rules);
-    queue_init(all_targets);
-    max_threads = threads;
-    pthread_t* thread_list = (pthread_t*)malloc(sizeof(pthread_t)*max_threads);
-    //pthread_mutex_init(&mutex1, NULL);
+    rule_table_init(&all_targets);
+    max_jobs = jobs_flag > 0 ? jobs_flag : 1;
 
     // parse the makefile.
-    parser_parse_makefile(makefile,targets,&new_targets,&new_dependency,&new_command);
+    makefile_strings = parser_parse_makefile(makefile,targets,&new_targets,&new_dependency,&new_order_dependency,&new_command);
+    load_times();
+    state_load(&build_state,STATE_FILE);
+    build_graph();
+    jobserver_init(&jobserver,jobs_flag);
 
-    for(i=0;i<max_threads;i++)
-    {
-    	pthread_create(&thread_list[i],NULL,rule_server,NULL);
-    }
-    
-    for(i=0;i<max_threads;i++)
-    {
-    	pthread_join(thread_list[i],NULL);
-    }
+    run_build();
+    // what -j allows; joining another make's jobserver, as many as we got
+    slots = (jobs_flag == 0 && jobserver_active(&jobserver)) ? slots_used : max_jobs;
+    jobserver_destroy(&jobserver);
 
-    if(n_targets != 0){
-    	for(i=0;targets[i]!=NULL;i++) free(targets[i]);
-    	free(targets);
-    }
+    if(profile) profile_report(stderr,new_rules,&all_targets,build_time,slots,PROFILE_TOP);
+    if(trace_file != NULL && profile_trace(trace_file,new_rules,slots_used) == -1)
+    	perror(trace_file);
+
+    save_times();
+    state_save(&build_state,STATE_FILE,&all_targets,new_rules);
+    state_close(&build_state);
 
-    //pthread_mutex_destroy(&mutex1, NULL);
     free_rule_queue(new_rules);
-    free_rule_queue(ready_rules);
-    free_queue(all_targets);
-    free(thread_list);
-	return 0; 
+    rule_heap_destroy(&ready_rules);
+    rule_table_destroy(&all_targets);
+    parser_destroy(makefile_strings);
+	return build_failed ? 1 : 0;
 }
@@ -1,300 +1,809 @@
 /** @file parser.c*/
 #define _GNU_SOURCE
-#include <assert.h>
-#include <ctype.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
+#include "containers.h"
 #include "parser.h"
-#include "queue.h"
-#include "rule.h"
 
 /** Boolean datatype*/
 typedef enum { False=0, True=1} boolean;
 
+#define ARENA_CHUNK 65536
+#define MAX_EXPANSION_DEPTH 64
+
+/** How a variable expands. */
+typedef enum {
+	VAR_UNDEFINED = 0, ///<Not a variable; the environment may still have it
+	VAR_RECURSIVE,     ///<Set with =, ?= or +=; its value expands each time it is used
+	VAR_SIMPLE         ///<Set with := or ::=; its value was expanded when set
+} flavor_t;
+
+/**
+ * An interned string: a target, a dependency or a variable's name.
+ */
+typedef struct{
+	const char *name; ///<In the arena
+	size_t len;
+	unsigned long long hash;
+	int last_def; ///<Last target entry for it, -1 if no rule makes it
+	boolean reached; ///<A goal depends on it
+	int mark; ///<Last time $^ listed it
+	flavor_t flavor;
+	char *value; ///<The variable's value, malloc()ed
+	size_t value_len;
+	size_t value_cap;
+} symbol_t;
+
+/**
+ * One target of a rule line.
+ */
+typedef struct{
+	int symbol;
+	int group; ///<Its rule line
+	int prev_def; ///<Previous entry for the same symbol, -1 if none
+	boolean reached;
+} target_t;
+
+/**
+ * A rule line, with its targets, dependencies and commands.
+ */
+typedef struct{
+	int first_target, targets;
+	int first_dep, deps;
+	int normal_deps; ///<Dependencies before a |, the ones $< and $^ name
+	int first_command, commands;
+	int line;
+} group_t;
+
+/**
+ * A slot of the symbol index.  Keeps part of the hash, so most names that
+ * do not match are told apart without reading their symbol.
+ */
+typedef struct{
+	unsigned int hash;
+	int symbol; ///<-1 where empty
+} slot_t;
+
+CONTAINER_VECTOR(symbol_vector, symbol_t)
+CONTAINER_VECTOR(target_vector, target_t)
+CONTAINER_VECTOR(group_vector, group_t)
+CONTAINER_VECTOR(int_vector, int)
+CONTAINER_VECTOR(string_vector, const char *)
+CONTAINER_VECTOR(text, char)
+
+/*
+	Every string that outlives the parse is copied once into the arena:
+	symbols are interned, so each distinct name is stored and hashed once,
+	and commands are stored as written and only copied again if they have
+	variables to expand.  The makefile itself is mmap()ed and read in one
+	pass; only lines continued with a backslash are copied to be joined.
+*/
+struct _parser_t{
+	string_vector_t chunks; ///<Arena chunks, malloc()ed
+	char *arena; ///<Free space in the last chunk
+	size_t arena_left;
+
+	symbol_vector_t symbols;
+	slot_t *slots; ///<Open-addressed index of symbols
+	int capacity; ///<Slots, a power of two
+
+	target_vector_t targets;
+	group_vector_t groups;
+	int_vector_t deps; ///<Symbols, each group's contiguous
+	string_vector_t commands; ///<As written, each group's contiguous
+	int_vector_t goals; ///<Targets of the first rule line
+	int marks; ///<Times $^ was expanded
+
+	const char *file;
+	int line;
+};
+
 
 /**
- * Creates dynamically sized array of tokens from string.
+ * Reports an error in the makefile and exits.
  *
- * @param line String containing tokens.
- * @return Malloc()'ed array of tokens, NULL terminated.
+ * @param p The parser.
+ * @param error What is wrong.
+ * @return Does not return.
  */
-static char **parse_line(char *line)
-{
-	char **tokens = malloc( (strlen(line)+1) * sizeof(char*));
-	int tokIdx = 0;
-	tokens[tokIdx] = strtok(line, " ");
-	while(tokens[tokIdx] != NULL){
-		tokIdx++;
-		tokens[tokIdx] = strtok(NULL, " ");
+static void parse_error(parser_t *p, const char *error){
+	fprintf(stderr, "%s:%d: *** %s.  Stop.\n", p->file, p->line, error);
+	exit(1);
+}
+
+
+/**
+ * Copies a string into the arena.
+ *
+ * @param p The parser.
+ * @param s The string, not necessarily NUL-terminated.
+ * @param len Its length.
+ * @return The copy, NUL-terminated, valid until parser_destroy().
+ */
+static char *arena_strndup(parser_t *p, const char *s, size_t len){
+	char *copy;
+	if(len + 1 > p->arena_left){
+		size_t bytes = (len + 1 > ARENA_CHUNK) ? len + 1 : ARENA_CHUNK;
+		p->arena = malloc(bytes);
+		p->arena_left = bytes;
+		string_vector_push(&p->chunks, p->arena);
+	}
+	copy = p->arena;
+	memcpy(copy, s, len);
+	copy[len] = '\0';
+	p->arena += len + 1;
+	p->arena_left -= len + 1;
+	return copy;
+}
+
+
+/* isspace() for the C locale, without a call per character. */
+static inline boolean is_space(char c){
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+static void text_append(text_t *t, const char *s, size_t len){
+	text_reserve(t, t->size + len + 1);
+	memcpy(t->data + t->size, s, len);
+	t->size += len;
+}
+
+static void grow_slots(parser_t *p){
+	int i, j, mask;
+	free(p->slots);
+	p->capacity = p->capacity ? p->capacity * 2 : 1024;
+	p->slots = malloc(p->capacity * sizeof(slot_t));
+	memset(p->slots, -1, p->capacity * sizeof(slot_t));
+	mask = p->capacity - 1;
+	for(i = 0; i < symbol_vector_size(&p->symbols); i++){
+		unsigned long long h = symbol_vector_at(&p->symbols, i)->hash;
+		for(j = h & mask; p->slots[j].symbol != -1; j = (j + 1) & mask)
+			;
+		p->slots[j].hash = h >> 32;
+		p->slots[j].symbol = i;
 	}
-	return tokens;
 }
 
 
 /**
- * Connects queue_iterate interface to free.
+ * Finds a symbol by name, and interns the name if it is new.
  *
- * @param arg Address to be freed.
- * @param trash Do NOT use.
- * @return Void.
+ * @param p The parser.
+ * @param s The name, not necessarily NUL-terminated.
+ * @param len Its length.
+ * @param insert Whether to intern a name not seen before.
+ * @return The symbol's index, or -1 if it is new and insert is False.
  */
-static void free_adapter(void *arg, void *trash){
-	free(arg);
+static int find_symbol(parser_t *p, const char *s, size_t len, boolean insert){
+	unsigned long long h = container_hash(CONTAINER_HASH_INIT, s, len);
+	symbol_t sym;
+	int i, mask;
+
+	if(insert && 2 * (symbol_vector_size(&p->symbols) + 1) > p->capacity)
+		grow_slots(p);
+	if(p->capacity == 0) return -1;
+	mask = p->capacity - 1;
+	for(i = h & mask; p->slots[i].symbol != -1; i = (i + 1) & mask){
+		symbol_t *cur;
+		if(p->slots[i].hash != (unsigned int)(h >> 32)) continue;
+		cur = symbol_vector_at(&p->symbols, p->slots[i].symbol);
+		if(cur->len == len && memcmp(cur->name, s, len) == 0)
+			return p->slots[i].symbol;
+	}
+	if(!insert) return -1;
+
+	memset(&sym, 0, sizeof(sym));
+	sym.name = arena_strndup(p, s, len);
+	sym.len = len;
+	sym.hash = h;
+	sym.last_def = -1;
+	sym.flavor = VAR_UNDEFINED;
+	p->slots[i].hash = h >> 32;
+	p->slots[i].symbol = symbol_vector_size(&p->symbols);
+	symbol_vector_push(&p->symbols, sym);
+	return p->slots[i].symbol;
+}
+
+static const char *symbol_name(parser_t *p, int symbol){
+	return symbol_vector_at(&p->symbols, symbol)->name;
 }
 
 
+static void expand(parser_t *p, const char *s, const char *end, text_t *out, const target_t *automatic, int depth);
+
 /**
- * Connects queue_iterate interface to free with rule_destroy call.
+ * Appends a variable's value.  Automatic variables $@, $< and $^ are only
+ * set in commands; a name that is not a variable is looked up in the
+ * environment, and otherwise expands to nothing.
  *
- * @param arg Address to be freed.
- * @param trash do NOT use.
+ * @param p The parser.
+ * @param name The variable's name, not necessarily NUL-terminated.
+ * @param len Its length.
+ * @param out Where the value goes.
+ * @param automatic The target whose command is being expanded, or NULL.
+ * @param depth How many variables are being expanded already.
  * @return Void.
  */
-static void rule_free_adapter(void *arg, void *trash){
-	rule_t *rule = arg;
-	queue_iterate(rule->deps, free_adapter, 0);
-	queue_iterate(rule->commands, free_adapter, 0);
-	
-	free(rule->target);
-
-	rule_destroy(arg);
-	free(arg);
+static void expand_variable(parser_t *p, const char *name, size_t len, text_t *out, const target_t *automatic, int depth){
+	char *env_name;
+	const char *env;
+	int sym, i;
+
+	if(automatic != NULL && len == 1 && strchr("@<^", *name) != NULL){
+		group_t *group = group_vector_at(&p->groups, automatic->group);
+		int *deps = int_vector_at(&p->deps, group->first_dep);
+		if(*name == '@'){
+			text_append(out, symbol_name(p, automatic->symbol), symbol_vector_at(&p->symbols, automatic->symbol)->len);
+		}else if(*name == '<'){
+			if(group->normal_deps > 0)
+				text_append(out, symbol_name(p, deps[0]), symbol_vector_at(&p->symbols, deps[0])->len);
+		}else{
+			// each dependency once, in order
+			boolean first = True;
+			p->marks++;
+			for(i = 0; i < group->normal_deps; i++){
+				symbol_t *dep = symbol_vector_at(&p->symbols, deps[i]);
+				if(dep->mark == p->marks) continue;
+				dep->mark = p->marks;
+				if(!first) text_append(out, " ", 1);
+				first = False;
+				text_append(out, dep->name, dep->len);
+			}
+		}
+		return;
+	}
+
+	if((sym = find_symbol(p, name, len, False)) != -1 &&
+			symbol_vector_at(&p->symbols, sym)->flavor != VAR_UNDEFINED){
+		symbol_t *var = symbol_vector_at(&p->symbols, sym);
+		if(var->flavor == VAR_SIMPLE){
+			text_append(out, var->value, var->value_len);
+			return;
+		}
+		if(depth >= MAX_EXPANSION_DEPTH){
+			char errorbuf[200];
+			snprintf(errorbuf, sizeof(errorbuf), "Recursive variable '%s' references itself (eventually)", var->name);
+			parse_error(p, errorbuf);
+		}
+		// the value is not changed while it is expanded, so it can be read in place
+		expand(p, var->value, var->value + var->value_len, out, automatic, depth + 1);
+		return;
+	}
+
+	env_name = strndup(name, len);
+	if((env = getenv(env_name)) != NULL)
+		text_append(out, env, strlen(env));
+	free(env_name);
 }
 
 
 /**
- * Compares validRules' dependency list against curRule's target.
- * Simulates connectivity of DAG
+ * Expands the variable references in a string: $(name), ${name}, $x for
+ * a one-character name, and $$ for a dollar sign.  Names may themselves
+ * contain references.
  *
- * @param curRule Rule with target to check.
- * @param validRules Queue of already accepted rules.
- * @return Boolean based on whether match was made.
+ * @param p The parser.
+ * @param s The string.
+ * @param end Its end.
+ * @param out Where the expansion is appended.
+ * @param automatic The target whose command is being expanded, or NULL.
+ * @param depth How many variables are being expanded already.
+ * @return Void.
  */
-static boolean findMatch(rule_t *curRule, queue_t *validRules){
-	int valIdx;
-	for(valIdx=0; valIdx < queue_size(validRules); valIdx++){
-		rule_t *curValRule = queue_at(validRules, valIdx);
-		int depIdx; 
-		for(depIdx=0; depIdx < queue_size(curValRule->deps); depIdx++){
-			char *dep = queue_at(curValRule->deps, depIdx);
-			if(strcmp(curRule->target, dep) == 0){
-				return True;
+static void expand(parser_t *p, const char *s, const char *end, text_t *out, const target_t *automatic, int depth){
+	while(s < end){
+		const char *dollar = memchr(s, '$', end - s);
+		if(dollar == NULL){
+			text_append(out, s, end - s);
+			return;
+		}
+		text_append(out, s, dollar - s);
+		s = dollar + 1;
+		if(s == end) return;
+
+		if(*s == '$'){
+			text_append(out, "$", 1);
+			s++;
+		}else if(*s == '(' || *s == '{'){
+			char open = *s, close = (*s == '(') ? ')' : '}';
+			const char *q;
+			int nest = 1;
+			text_t name;
+			for(q = s + 1; q < end; q++){
+				if(*q == open) nest++;
+				else if(*q == close && --nest == 0) break;
 			}
+			if(q == end) parse_error(p, "unterminated variable reference");
+			text_init(&name);
+			expand(p, s + 1, q, &name, automatic, depth);
+			expand_variable(p, name.data, name.size, out, automatic, depth);
+			text_destroy(&name);
+			s = q + 1;
+		}else{
+			expand_variable(p, s, 1, out, automatic, depth);
+			s++;
 		}
 	}
-	return False;
 }
 
 
 /**
- * Removes all rules which are not descendants of simulated DAG rooted at targets.
+ * Interns each blank-separated word of a string.
+ *
+ * @param p The parser.
+ * @param s The string.
+ * @param end Its end.
+ * @param words Where the words' symbols are appended.
+ * @return Void.
+ */
+static void add_words(parser_t *p, const char *s, const char *end, int_vector_t *words){
+	while(s < end){
+		const char *word;
+		while(s < end && is_space(*s)) s++;
+		for(word = s; s < end && !is_space(*s); s++)
+			;
+		if(s > word) int_vector_push(words, find_symbol(p, word, s - word, True));
+	}
+}
+
+
+static void trim(const char **s, const char **end){
+	while(*s < *end && is_space(**s)) (*s)++;
+	while(*end > *s && is_space((*end)[-1])) (*end)--;
+}
+
+
+/**
+ * Replaces a variable's value, or appends to it after a space.
+ *
+ * @param var The variable.
+ * @param value The new text.
+ * @param len Its length.
+ * @param append Whether to append.
+ * @return Void.
+ */
+static void set_value(symbol_t *var, const char *value, size_t len, boolean append){
+	size_t at = append ? var->value_len : 0;
+	if(append && at > 0) len++;
+	if(at + len + 1 > var->value_cap){
+		var->value_cap = 2 * (at + len + 1);
+		var->value = realloc(var->value, var->value_cap);
+	}
+	if(append && at > 0){
+		var->value[at++] = ' ';
+		len--;
+	}
+	memcpy(var->value + at, value, len);
+	var->value_len = at + len;
+	var->value[var->value_len] = '\0';
+}
+
+
+/**
+ * Sets a variable.
  *
- * @param rules Queue of rules which is read and modified.
- * @param targets List of targets which act as roots.
+ * @param p The parser.
+ * @param name The name as written, before expansion.
+ * @param name_end Its end.
+ * @param op The assignment: '=', ':' for := and ::=, '?' or '+'.
+ * @param value The value as written.
+ * @param value_end Its end.
  * @return Void.
  */
-static void filterOnTargets(queue_t **rules, char **targets){
-	queue_t *validRules = malloc(sizeof(queue_t));
-	queue_init(validRules);
-	int idx;
-	
-	//initialize validRules with targets
-	for(idx=0; idx < queue_size(*rules);idx++){
-		rule_t *curRule = queue_at(*rules, idx);
-		int tarIdx;
-		for(tarIdx=0; targets[tarIdx] != NULL; tarIdx++){
-			if(strcmp(curRule->target, targets[tarIdx]) == 0){
-				queue_enqueue(validRules, curRule);
-				queue_remove_at(*rules, idx);
-				idx--;
-				break;
+static void assign(parser_t *p, const char *name, const char *name_end, char op, const char *value, const char *value_end){
+	text_t buf;
+	const char *n, *n_end, *env;
+	symbol_t *var;
+	int sym;
+
+	text_init(&buf);
+	expand(p, name, name_end, &buf, NULL, 0);
+	n = buf.data;
+	n_end = n + buf.size;
+	trim(&n, &n_end);
+	if(n == n_end) parse_error(p, "empty variable name");
+	sym = find_symbol(p, n, n_end - n, True);
+	text_clear(&buf);
+	while(value < value_end && is_space(*value)) value++;
+
+	var = symbol_vector_at(&p->symbols, sym);
+	env = (var->flavor == VAR_UNDEFINED) ? getenv(var->name) : NULL;
+	if(op == '?' && (var->flavor != VAR_UNDEFINED || env != NULL)){
+		text_destroy(&buf);
+		return;
+	}
+	if(op == '+' && env != NULL){
+		// appending to the environment's value makes it the makefile's
+		var->flavor = VAR_RECURSIVE;
+		set_value(var, env, strlen(env), False);
+	}
+
+	if(op == ':' || (op == '+' && var->flavor == VAR_SIMPLE))
+		expand(p, value, value_end, &buf, NULL, 0);
+	else
+		text_append(&buf, value, value_end - value);
+
+	if(op == '+' && var->flavor != VAR_UNDEFINED){
+		set_value(var, buf.data, buf.size, True);
+	}else{
+		var->flavor = (op == ':') ? VAR_SIMPLE : VAR_RECURSIVE;
+		set_value(var, buf.data, buf.size, False);
+	}
+	text_destroy(&buf);
+}
+
+
+/**
+ * Adds a rule line: "targets : dependencies", optionally followed by
+ * "; command".  Targets that are special, like .PHONY, are ignored.
+ *
+ * @param p The parser.
+ * @param s The line, its comment removed.
+ * @param colon The colon after the targets.
+ * @param deps Where the dependencies start.
+ * @param end The line's end.
+ * @return The rule line's index, to add the commands that follow to; -2
+ *         if it has no targets that are not special.
+ */
+static int parse_rule(parser_t *p, const char *s, const char *colon, const char *deps, const char *end){
+	const char *semicolon = NULL, *q;
+	int_vector_t words;
+	text_t buf;
+	group_t group;
+	int i, depth = 0;
+	boolean order_only = False;
+
+	for(q = deps; q < end && semicolon == NULL; q++){
+		if(*q == '$' && q + 1 < end && (q[1] == '(' || q[1] == '{')){
+			depth++;
+			q++;
+		}else if((*q == ')' || *q == '}') && depth > 0){
+			depth--;
+		}else if(*q == ';' && depth == 0){
+			semicolon = q;
+		}
+	}
+
+	text_init(&buf);
+	int_vector_init(&words);
+	expand(p, s, colon, &buf, NULL, 0);
+	add_words(p, buf.data, buf.data + buf.size, &words);
+
+	memset(&group, 0, sizeof(group));
+	group.first_target = target_vector_size(&p->targets);
+	group.first_dep = int_vector_size(&p->deps);
+	group.first_command = string_vector_size(&p->commands);
+	group.line = p->line;
+	for(i = 0; i < int_vector_size(&words); i++){
+		int sym = *int_vector_at(&words, i);
+		const char *name = symbol_name(p, sym);
+		target_t target;
+		if(name[0] == '.' && strchr(name, '/') == NULL) continue;
+		target.symbol = sym;
+		target.group = group_vector_size(&p->groups);
+		target.prev_def = symbol_vector_at(&p->symbols, sym)->last_def;
+		target.reached = False;
+		symbol_vector_at(&p->symbols, sym)->last_def = target_vector_size(&p->targets);
+		target_vector_push(&p->targets, target);
+		group.targets++;
+		// the first rule line's targets are the goals if none are given
+		if(group_vector_size(&p->groups) == 0) int_vector_push(&p->goals, sym);
+	}
+	int_vector_destroy(&words);
+	if(group.targets == 0){
+		text_destroy(&buf);
+		return -2;
+	}
+
+	text_clear(&buf);
+	expand(p, deps, semicolon != NULL ? semicolon : end, &buf, NULL, 0);
+	int_vector_init(&words);
+	add_words(p, buf.data, buf.data + buf.size, &words);
+	for(i = 0; i < int_vector_size(&words); i++){
+		int sym = *int_vector_at(&words, i);
+		// order-only dependencies are built first, but $^ and the build-state database leave them out
+		if(strcmp(symbol_name(p, sym), "|") == 0){
+			order_only = True;
+			continue;
+		}
+		int_vector_push(&p->deps, sym);
+		group.deps++;
+		if(!order_only) group.normal_deps++;
+	}
+	int_vector_destroy(&words);
+	text_destroy(&buf);
+
+	if(semicolon != NULL){
+		for(q = semicolon + 1; q < end && is_space(*q); q++)
+			;
+		if(q < end){
+			string_vector_push(&p->commands, arena_strndup(p, q, end - q));
+			group.commands++;
+		}
+	}
+	group_vector_push(&p->groups, group);
+	return group_vector_size(&p->groups) - 1;
+}
+
+
+/**
+ * Parses a line that is not a command: a variable assignment or a rule.
+ * Other lines are ignored.
+ *
+ * @param p The parser.
+ * @param s The line, its comment removed.
+ * @param end Its end.
+ * @return The rule line commands that follow belong to, -2 for one whose
+ *         commands are ignored, or -1 if there is none.
+ */
+static int parse_statement(parser_t *p, const char *s, const char *end){
+	const char *q;
+	int depth = 0;
+
+	for(q = s; q < end; q++){
+		if(*q == '$' && q + 1 < end && (q[1] == '(' || q[1] == '{')){
+			depth++;
+			q++;
+		}else if((*q == ')' || *q == '}') && depth > 0){
+			depth--;
+		}else if(depth > 0){
+			continue;
+		}else if(*q == '='){
+			if(q > s && (q[-1] == '?' || q[-1] == '+'))
+				assign(p, s, q - 1, q[-1], q + 1, end);
+			else
+				assign(p, s, q, '=', q + 1, end);
+			return -1;
+		}else if(*q == ':'){
+			if(q + 1 < end && q[1] == '='){
+				assign(p, s, q, ':', q + 2, end);
+				return -1;
+			}
+			if(q + 2 < end && q[1] == ':' && q[2] == '='){
+				assign(p, s, q, ':', q + 3, end);
+				return -1;
 			}
+			return parse_rule(p, s, q, (q + 1 < end && q[1] == ':') ? q + 2 : q + 1, end);
 		}
 	}
+	return -1;
+}
+
 
-	//repeated linear search for new valid targets
-	int prevSize = 0;
-	while(prevSize != queue_size(validRules)){
-		prevSize = queue_size(validRules);
-
-		for(idx=0; idx < queue_size(*rules); idx++){
-			rule_t *curRule = queue_at(*rules, idx);
-			if(findMatch(curRule, validRules)){
-				queue_enqueue(validRules, curRule);
-				queue_remove_at(*rules, idx);
-				idx--;
+/**
+ * Marks every rule a goal depends on, directly or not, in one traversal
+ * of the dependency graph.
+ *
+ * @param p The parser.
+ * @param goals The goals, or NULL for those of the first rule line.
+ * @return Void.
+ */
+static void mark_reached(parser_t *p, char **goals){
+	int_vector_t stack;
+	int i, sym, t;
+
+	int_vector_init(&stack);
+	if(goals != NULL && goals[0] != NULL){
+		for(i = 0; goals[i] != NULL; i++)
+			if((sym = find_symbol(p, goals[i], strlen(goals[i]), False)) != -1)
+				int_vector_push(&stack, sym);
+	}else{
+		for(i = 0; i < int_vector_size(&p->goals); i++)
+			int_vector_push(&stack, *int_vector_at(&p->goals, i));
+	}
+	for(i = 0; i < int_vector_size(&stack); i++)
+		symbol_vector_at(&p->symbols, *int_vector_at(&stack, i))->reached = True;
+
+	while(int_vector_size(&stack) > 0){
+		sym = int_vector_pop(&stack);
+		for(t = symbol_vector_at(&p->symbols, sym)->last_def; t != -1; t = target_vector_at(&p->targets, t)->prev_def){
+			target_t *target = target_vector_at(&p->targets, t);
+			group_t *group = group_vector_at(&p->groups, target->group);
+			target->reached = True;
+			for(i = 0; i < group->deps; i++){
+				symbol_t *dep = symbol_vector_at(&p->symbols, *int_vector_at(&p->deps, group->first_dep + i));
+				if(dep->reached) continue;
+				dep->reached = True;
+				int_vector_push(&stack, *int_vector_at(&p->deps, group->first_dep + i));
 			}
 		}
 	}
-	
-	//cleanup old rules
-	queue_iterate(*rules, rule_free_adapter, 0);
-	queue_destroy(*rules);
-	free(*rules);
-
-	//assign new queue
-	*rules = validRules;
+	int_vector_destroy(&stack);
 }
 
 
 /**
- * Calls appropriate callback functions for a given rule.
+ * Calls the callbacks for every rule that was reached, in makefile order,
+ * expanding the variables in its commands.
  *
- * @param rules Queue of rules.
+ * @param p The parser.
  * @param notify_target Callback function for targets.
  * @param notify_dep Callback function for dependencies.
+ * @param notify_order_dep Callback function for order-only dependencies.
  * @param notify_cmd Callback function for commands.
  * @return Void.
  */
-static void notifyRules
+static void notify_rules
 (
-	queue_t *rules,
+	parser_t *p,
 	void (*notify_target)(char *),
 	void (*notify_dep)(char *,char *),
+	void (*notify_order_dep)(char *,char *),
 	void (*notify_cmd)(char *, char *)
 )
 {
-	int ruleIdx, i;
-	
-	for(ruleIdx=0; ruleIdx < queue_size(rules); ruleIdx++){
-
-		rule_t *curRule = queue_at(rules, ruleIdx);
-		notify_target(curRule->target);
-
-		for(i=0; i < queue_size(curRule->deps); i++){
-			char *dep = queue_at(curRule->deps, i);
-			notify_dep(curRule->target, dep);
-		}
-		
-		for(i=0; i < queue_size(curRule->commands); i++){
-			char *cmd = queue_at(curRule->commands, i);
-			notify_cmd(curRule->target, cmd);
+	text_t buf;
+	int g, t, i;
+
+	text_init(&buf);
+	for(g = 0; g < group_vector_size(&p->groups); g++){
+		group_t *group = group_vector_at(&p->groups, g);
+		p->line = group->line;
+		for(t = group->first_target; t < group->first_target + group->targets; t++){
+			target_t *target = target_vector_at(&p->targets, t);
+			char *name = (char *)symbol_name(p, target->symbol);
+			if(!target->reached) continue;
+
+			notify_target(name);
+			for(i = 0; i < group->deps; i++){
+				char *dep = (char *)symbol_name(p, *int_vector_at(&p->deps, group->first_dep + i));
+				if(i < group->normal_deps)
+					notify_dep(name, dep);
+				else
+					notify_order_dep(name, dep);
+			}
+			for(i = 0; i < group->commands; i++){
+				const char *cmd = *string_vector_at(&p->commands, group->first_command + i);
+				if(strchr(cmd, '$') == NULL){
+					notify_cmd(name, (char *)cmd);
+					continue;
+				}
+				text_clear(&buf);
+				expand(p, cmd, cmd + strlen(cmd), &buf, target, 0);
+				notify_cmd(name, arena_strndup(p, buf.data, buf.size));
+			}
 		}
 	}
+	text_destroy(&buf);
 }
 
 
 /**
- * Parses makeFileName based on GNU 'make' utility.
+ * Parses makeFileName based on GNU 'make' utility: rules, commands,
+ * variables set with =, :=, ::=, ?= and +=, and lines continued with a
+ * backslash.
  *
  * @param makeFileName Path to valid makefile.
  * @param run_targets Null-terminated list of targets as listed on command-line.
  * @param parsed_new_target Function pointer to callback function for new target.
  * @param parsed_new_dependency Function pointer to callback function for new dependency.
+ * @param parsed_new_order_dependency Function pointer to callback function for a new dependency after a |.
  * @param parsed_new_command Function pointer to callback function for new command.
- * @return Void.
+ * @return The parsed makefile, which owns the strings passed to the callbacks.
  */
-void parser_parse_makefile
+parser_t *parser_parse_makefile
 (
 	const char *makeFileName,
 	char **run_targets,
 	void (*parsed_new_target)(char *target),
 	void (*parsed_new_dependency)(char *target, char *dependency),
+	void (*parsed_new_order_dependency)(char *target, char *dependency),
 	void (*parsed_new_command)(char *target, char *command)
 )
 {
-	boolean run_targetsMalloced = False;
-	FILE *f = fopen(makeFileName, "r");
-	assert(f != NULL);
-
-	queue_t *rules = malloc(sizeof(queue_t));
-	queue_init(rules);
-	queue_t curRules;
-	queue_init(&curRules);
-
-	char *lineBuf = NULL;
-	size_t bytes;
-	while(getline(&lineBuf, &bytes, f) != -1){
-		if(lineBuf[strlen(lineBuf)-1] == '\n') lineBuf[strlen(lineBuf)-1] = '\0';
-
-		if(isalnum(lineBuf[0])){
-			char *depLine = strstr(lineBuf, ":");
-			assert(depLine != NULL);
-			depLine[0] = '\0';
-			depLine = depLine + 1;
-			
-			//insert prev Rule to queue
-			int ruleIdx;
-			for(ruleIdx=0; ruleIdx < queue_size(&curRules); ruleIdx++){
-				queue_enqueue(rules, queue_at(&curRules,ruleIdx));
-			}
-			queue_destroy(&curRules);
-			queue_init(&curRules);
-
-			char **targets = parse_line(lineBuf);
-			int tarIdx;
-			for(tarIdx=0; targets[tarIdx] != NULL; tarIdx++){
-				rule_t *newRule = malloc(sizeof(rule_t));
-				rule_init(newRule);
-
-				char *target = strdup(targets[tarIdx]);
-				newRule->target = target;
-
-				queue_enqueue(&curRules, newRule);
-			}
-
-			if(run_targets == NULL || run_targets[0] == NULL){
-				run_targetsMalloced = True;
-				run_targets = calloc(sizeof(char *), tarIdx + 1);
-				int rtIdx;
-				for(rtIdx=0; rtIdx < tarIdx; rtIdx++)
-					run_targets[rtIdx] = strdup(targets[rtIdx]);
-			}
-			free(targets);
-
-			char **deps = parse_line(depLine);
-			int depIdx;
-			for(depIdx=0; deps[depIdx] != NULL; depIdx++){
-				int ruleIdx;
-				for(ruleIdx=0; ruleIdx < queue_size(&curRules); ruleIdx++){
-					rule_t *curRule = queue_at(&curRules, ruleIdx);
-					char *dep = strdup(deps[depIdx]);
-					queue_enqueue(curRule->deps, dep);
+	parser_t *p = calloc(1, sizeof(parser_t));
+	const char *map = NULL, *pos, *end;
+	size_t size = 0;
+	struct stat st;
+	text_t joined;
+	int fd, current = -1;
+
+	p->file = makeFileName;
+	if((fd = open(makeFileName, O_RDONLY)) == -1 || fstat(fd, &st) == -1){
+		perror(makeFileName);
+		exit(1);
+	}
+	if(st.st_size > 0){
+		size = st.st_size;
+		if((map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0)) == MAP_FAILED){
+			perror(makeFileName);
+			exit(1);
+		}
+		madvise((void *)map, size, MADV_SEQUENTIAL);
+	}
+	close(fd);
+
+	text_init(&joined);
+	for(pos = map, end = map + size; pos < end; ){
+		const char *s = pos, *e, *next;
+		boolean command = (*pos == '\t' && current != -1);
+
+		p->line++;
+		e = memchr(pos, '\n', end - pos);
+		if(e == NULL) e = end;
+		next = (e < end) ? e + 1 : end;
+		if(command) s++;
+
+		// a backslash at the end joins the next line: to a command as
+		// written, less the next line's tab; to anything else with a space
+		if(e > s && e[-1] == '\\' && next < end){
+			text_clear(&joined);
+			while(e > s && e[-1] == '\\' && next < end){
+				if(command){
+					text_append(&joined, s, e - s);
+					text_append(&joined, "\n", 1);
+				}else{
+					const char *t = e - 1;
+					while(t > s && is_space(t[-1])) t--;
+					text_append(&joined, s, t - s);
+					text_append(&joined, " ", 1);
 				}
+				s = next;
+				p->line++;
+				e = memchr(s, '\n', end - s);
+				if(e == NULL) e = end;
+				next = (e < end) ? e + 1 : end;
+				if(command && s < e && *s == '\t') s++;
+				while(!command && s < e && is_space(*s)) s++;
 			}
-			free(deps);
+			text_append(&joined, s, e - s);
+			s = joined.data;
+			e = s + joined.size;
 		}
-		else if(lineBuf[0] == '\t')
-		{
-			assert(queue_size(&curRules) != 0); //command without target
-			int idx;
-			for(idx=0; idx < queue_size(&curRules); idx++){
-				rule_t *curRule = queue_at(&curRules, idx);
-				char *command = strdup(lineBuf + 1);
-				queue_enqueue(curRule->commands, command);
+		pos = next;
+		if(e > s && e[-1] == '\r') e--;
+
+		if(command){
+			while(s < e && is_space(*s)) s++;
+			if(s < e && current >= 0){
+				string_vector_push(&p->commands, arena_strndup(p, s, e - s));
+				group_vector_at(&p->groups, current)->commands++;
 			}
-
-		}else
-		{
-			;//ignore line
+			continue;
 		}
-	}
-	int ruleIdx;
-	for(ruleIdx=0; ruleIdx < queue_size(&curRules); ruleIdx++){
-		queue_enqueue(rules, queue_at(&curRules, ruleIdx));
-	}
-	queue_destroy(&curRules); //No longer need curRules
-
-	filterOnTargets(&rules, run_targets);
 
-	//send callbacks
-	notifyRules(rules, parsed_new_target, parsed_new_dependency, parsed_new_command);	
-
-	//cleanup
-	queue_iterate(rules, rule_free_adapter, 0);
-	queue_destroy(rules);
-
-	if(run_targetsMalloced){
-		int tarIdx;
-		for(tarIdx=0; run_targets[tarIdx] != NULL; tarIdx++)
-			free(run_targets[tarIdx]);
-		free(run_targets);
+		const char *hash = memchr(s, '#', e - s);
+		if(hash != NULL) e = hash;
+		while(s < e && is_space(*s)) s++;
+		// blank lines and comments do not end a rule's commands
+		if(s == e) continue;
+		current = parse_statement(p, s, e);
 	}
+	text_destroy(&joined);
+	if(map != NULL) munmap((void *)map, size);
+
+	mark_reached(p, run_targets);
+	notify_rules(p, parsed_new_target, parsed_new_dependency, parsed_new_order_dependency, parsed_new_command);
+	return p;
+}
 
-	free(lineBuf);
-	free(rules);
 
-	fclose(f);
+/**
+ * Frees the parsed makefile, and with it every string passed to the
+ * callbacks.
+ *
+ * @param p The parser.
+ * @return Void.
+ */
+void parser_destroy(parser_t *p){
+	int i;
+	for(i = 0; i < symbol_vector_size(&p->symbols); i++)
+		free(symbol_vector_at(&p->symbols, i)->value);
+	for(i = 0; i < string_vector_size(&p->chunks); i++)
+		free((char *)*string_vector_at(&p->chunks, i));
+	string_vector_destroy(&p->chunks);
+	symbol_vector_destroy(&p->symbols);
+	free(p->slots);
+	target_vector_destroy(&p->targets);
+	group_vector_destroy(&p->groups);
+	int_vector_destroy(&p->deps);
+	string_vector_destroy(&p->commands);
+	int_vector_destroy(&p->goals);
+	free(p);
 }
@@ -2,13 +2,22 @@
 #ifndef __PARSER_H
 #define __PARSER_H
 
-void parser_parse_makefile
+/**
+ * A parsed makefile.  Owns every string handed to the callbacks, which
+ * stay valid until parser_destroy().
+ */
+typedef struct _parser_t parser_t;
+
+parser_t *parser_parse_makefile
 (
 	const char *makeFileName,
 	char **targets,
 	void (*parsed_new_target) (char *target),
 	void (*parsed_new_dependency) (char *target, char *dependency),
+	void (*parsed_new_order_dependency) (char *target, char *dependency),
 	void (*parsed_new_command) (char *target, char *command)
 );
 
+void parser_destroy(parser_t *parser);
+
 #endif
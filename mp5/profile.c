@@ -0,0 +1,135 @@
+/** @file profile.c */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "profile.h"
+#include "queue.h"
+#include "rule.h"
+
+static double took(const rule_t *rule){
+	return rule->finished - rule->started;
+}
+
+static int slower_first(const void *a, const void *b){
+	double x = took(*(rule_t * const *)a), y = took(*(rule_t * const *)b);
+	return (x < y) - (x > y);
+}
+
+/* The rule among deps that was over last, if it was over after last; otherwise last. */
+static rule_t *last_of(queue_t *deps, rule_table_t *table, rule_t *last){
+	rule_t *dep;
+	int i;
+	for(i = 0; i < queue_size(deps); i++){
+		dep = rule_table_find(table, queue_at(deps, i));
+		if(dep == NULL || dep->started < 0) continue;
+		if(last == NULL || dep->finished > last->finished) last = dep;
+	}
+	return last;
+}
+
+/* The rule among rule's dependencies, order-only ones included, that was over last, or NULL if none was taken up. */
+static rule_t *last_dependency(rule_t *rule, rule_table_t *table){
+	return last_of(rule->order_deps, table, last_of(rule->deps, table, NULL));
+}
+
+/**
+ * Prints how busy the job slots were, the slowest rules, and the
+ * critical path: the chain that ends at the rule over last, going back
+ * each time to the dependency that was over last, which is what the rule
+ * waited for.
+ *
+ * @param out Where to print.
+ * @param rules Every rule in the build.
+ * @param table The same rules, by target.
+ * @param wall Seconds the build took.
+ * @param slots Jobs it could run at once.
+ * @param top How many of the slowest rules to list.
+ * @return Void.
+ */
+void profile_report(FILE *out, queue_t *rules, rule_table_t *table, double wall, int slots, int top){
+	rule_t **ran = malloc((queue_size(rules) + 1) * sizeof(rule_t *)), *rule, *last = NULL;
+	queue_t path;
+	double busy = 0;
+	int i, n = 0;
+
+	for(i = 0; i < queue_size(rules); i++){
+		rule = queue_at(rules, i);
+		if(rule->started < 0) continue;
+		if(last == NULL || rule->finished > last->finished) last = rule;
+		if(rule->slot == -1) continue;
+		ran[n++] = rule;
+		busy += took(rule);
+	}
+	qsort(ran, n, sizeof(rule_t *), slower_first);
+
+	if(slots < 1) slots = 1;
+	fprintf(out, "parmake: %d of %d rules ran in %.3fs; %.2f of %d job slots busy on average (%.0f%%)\n",
+			n, queue_size(rules), wall, wall > 0 ? busy / wall : 0, slots,
+			wall > 0 ? 100 * busy / wall / slots : 0);
+
+	if(n > 0) fprintf(out, "slowest rules:\n");
+	for(i = 0; i < n && i < top; i++){
+		fprintf(out, "  %9.3fs  %s (slot %d", took(ran[i]), ran[i]->target, ran[i]->slot);
+		if(ran[i]->exit_status != 0) fprintf(out, ", exit %d", ran[i]->exit_status);
+		fprintf(out, ")\n");
+	}
+
+	if(last != NULL){
+		queue_init(&path);
+		for(rule = last; rule != NULL; rule = last_dependency(rule, table))
+			queue_enqueue(&path, rule);
+		fprintf(out, "critical path, over by %.3fs:\n", last->finished);
+		for(i = queue_size(&path) - 1; i >= 0; i--){
+			rule = queue_at(&path, i);
+			fprintf(out, "  %9.3fs +%8.3fs  %s%s\n", rule->started, took(rule), rule->target,
+					rule->slot == -1 ? " (up to date)" : "");
+		}
+		queue_destroy(&path);
+	}
+	free(ran);
+}
+
+static void write_json_string(FILE *f, const char *s){
+	fputc('"', f);
+	for(; *s != '\0'; s++){
+		if(*s == '"' || *s == '\\')
+			fprintf(f, "\\%c", *s);
+		else if((unsigned char)*s < 0x20)
+			fprintf(f, "\\u%04x", *s);
+		else
+			fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+/**
+ * Writes the rules whose commands ran as a Chrome trace-event file, for
+ * chrome://tracing or Perfetto: one row per job slot, one slice per
+ * rule, with its exit status.
+ *
+ * @param path File to write.
+ * @param rules Every rule in the build.
+ * @param slots Job slots used.
+ * @return 0, or -1 with errno set if the file could not be written.
+ */
+int profile_trace(const char *path, queue_t *rules, int slots){
+	FILE *f = fopen(path, "w");
+	rule_t *rule;
+	int i;
+
+	if(f == NULL) return -1;
+	fprintf(f, "{\"traceEvents\": [\n");
+	fprintf(f, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 0, \"args\": {\"name\": \"parmake\"}}");
+	for(i = 0; i < slots; i++)
+		fprintf(f, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 0, \"tid\": %d, \"args\": {\"name\": \"Job slot %d\"}}", i, i);
+	for(i = 0; i < queue_size(rules); i++){
+		rule = queue_at(rules, i);
+		if(rule->slot == -1) continue;
+		fprintf(f, ",\n{\"name\": ");
+		write_json_string(f, rule->target);
+		fprintf(f, ", \"cat\": \"rule\", \"ph\": \"X\", \"pid\": 0, \"tid\": %d, \"ts\": %.0f, \"dur\": %.0f, "
+				"\"args\": {\"exit\": %d}}", rule->slot, rule->started * 1e6, took(rule) * 1e6, rule->exit_status);
+	}
+	fprintf(f, "\n]}\n");
+	return fclose(f) == 0 ? 0 : -1;
+}
@@ -0,0 +1,19 @@
+/** @file profile.h */
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include <stdio.h>
+
+#include "queue.h"
+#include "rule.h"
+
+/**
+ * Build Profile
+ *
+ * Reports on a finished build from what each rule recorded: when it was
+ * taken up and over, the job slot its commands ran in and how they exited.
+ */
+void profile_report(FILE *out, queue_t *rules, rule_table_t *table, double wall, int slots, int top);
+int profile_trace(const char *path, queue_t *rules, int slots);
+
+#endif
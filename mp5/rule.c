@@ -1,10 +1,14 @@
 /** @file rule.c */
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
+#include "containers.h"
 #include "queue.h"
 #include "rule.h"
 
+#define RULE_TABLE_MIN_CAPACITY 64
+
 /**
  * Initializes Rule data structure.
  *
@@ -14,12 +18,32 @@
 void rule_init(rule_t *rule){
 	assert( rule != NULL);
 	rule->target = NULL;
+	rule->state = RULE_PENDING;
 
 	rule->deps = malloc(sizeof(queue_t));
 	queue_init(rule->deps);
+
+	rule->order_deps = malloc(sizeof(queue_t));
+	queue_init(rule->order_deps);
 	
 	rule->commands = malloc(sizeof(queue_t));
 	queue_init(rule->commands);
+
+	rule->index = 0;
+	rule->duration = -1;
+	rule->measured = 0;
+	rule->priority = 0;
+	rule->command_hash = 0;
+	rule->stamps = NULL;
+	rule->recorded = 0;
+	rule->started = -1;
+	rule->finished = -1;
+	rule->slot = -1;
+	rule->exit_status = 0;
+
+	rule->remaining = 0;
+	rule->dependents = malloc(sizeof(queue_t));
+	queue_init(rule->dependents);
 }
 
 /**
@@ -32,6 +56,85 @@ void rule_destroy(rule_t *rule){
 	queue_destroy(rule->deps);
 	free(rule->deps);
 
+	queue_destroy(rule->order_deps);
+	free(rule->order_deps);
+
 	queue_destroy(rule->commands);
 	free(rule->commands);
+
+	queue_destroy(rule->dependents);
+	free(rule->dependents);
+
+	free(rule->stamps);
+}
+
+
+/* The slot holding target, or the empty slot where it would go. */
+static int find_slot(rule_table_t *table, const char *target){
+	int mask = table->capacity - 1;
+	int i = container_hash_string(target) & mask;
+	while(table->slots[i] != NULL && strcmp(table->slots[i]->target, target) != 0)
+		i = (i + 1) & mask;
+	return i;
+}
+
+/**
+ * Initializes an empty rule table.
+ *
+ * @param table A pointer to the rule table.
+ * @return Void.
+ */
+void rule_table_init(rule_table_t *table){
+	table->size = 0;
+	table->capacity = RULE_TABLE_MIN_CAPACITY;
+	table->slots = calloc(table->capacity, sizeof(rule_t *));
+}
+
+/**
+ * Destroys a rule table.  The rules themselves are not freed.
+ *
+ * @param table A pointer to the rule table.
+ * @return Void.
+ */
+void rule_table_destroy(rule_table_t *table){
+	free(table->slots);
+	table->slots = NULL;
+	table->size = table->capacity = 0;
+}
+
+/**
+ * Looks a rule up by target name in O(1).
+ *
+ * @param table A pointer to the rule table.
+ * @param target Name of the target.
+ * @return The rule for target, or NULL if there is none.
+ */
+rule_t *rule_table_find(rule_table_t *table, const char *target){
+	return table->slots[find_slot(table, target)];
+}
+
+/**
+ * Adds a rule to the table, replacing any rule with the same target.
+ *
+ * @param table A pointer to the rule table.
+ * @param rule The rule; its target must not change while it is in the table.
+ * @return Void.
+ */
+void rule_table_insert(rule_table_t *table, rule_t *rule){
+	int i;
+	if(2 * (table->size + 1) > table->capacity){
+		rule_t **old = table->slots;
+		int old_capacity = table->capacity;
+		table->capacity *= 2;
+		table->slots = calloc(table->capacity, sizeof(rule_t *));
+		for(i = 0; i < old_capacity; i++)
+			if(old[i] != NULL)
+				table->slots[find_slot(table, old[i]->target)] = old[i];
+		free(old);
+	}
+
+	i = find_slot(table, rule->target);
+	if(table->slots[i] == NULL)
+		table->size++;
+	table->slots[i] = rule;
 }
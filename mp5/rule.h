@@ -3,16 +3,65 @@
 #define __RULE_H__
 
 #include "queue.h"
+
+/**
+ * Where a rule is in the build.
+ */
+typedef enum {
+	RULE_PENDING = 0, ///<Waiting for its dependencies
+	RULE_RUNNING,     ///<Taken off the ready heap; checked, or its job is running
+	RULE_DONE,        ///<Up to date; rules depending on it may run
+	RULE_FAILED       ///<One of its commands failed
+} rule_state_t;
+
+/**
+ * What a file looked like, for the build-state database.
+ */
+typedef struct{
+	long long mtime; ///<Modification time in nanoseconds, a quick check
+	long long size; ///<Size in bytes, a quick check
+	unsigned long long hash; ///<Hash of the contents
+} file_stamp_t;
+
 /**
  * Rule Data Structure
  */
 typedef struct{
 	char *target; ///<Name of target
 	queue_t *deps; ///<List of dependencies
+	queue_t *order_deps; ///<Dependencies after a |: built first, but a change to them does not make the rule stale
 	queue_t *commands; ///<List of commands
+	rule_state_t state; ///<Where the rule is in the build
+	int remaining; ///<Dependencies that are rules and not yet done
+	queue_t *dependents; ///<Rules with this one as a dependency, once per mention
+	int index; ///<Position in the makefile, to break ties between priorities
+	double duration; ///<Seconds its commands took last time; negative if unknown
+	int measured; ///<duration was measured in this build
+	double priority; ///<Expected seconds on the longest path from this rule to a goal
+	unsigned long long command_hash; ///<Hash of its commands
+	file_stamp_t *stamps; ///<Its dependencies as they are now, one per dependency; NULL until known
+	int recorded; ///<Its commands and stamps go in the build-state database
+	double started; ///<Seconds into the build it was taken up; negative if it never was
+	double finished; ///<Seconds into the build it was over
+	int slot; ///<Job slot its commands ran in, -1 if they did not run
+	int exit_status; ///<Exit status of its command that failed, 0 if none did
 } rule_t;
 
 void rule_init(rule_t *rule);
 void rule_destroy(rule_t *rule);
 
+/**
+ * Rules indexed by target name, in an open-addressed hash table.
+ */
+typedef struct{
+	rule_t **slots; ///<NULL where empty
+	int size; ///<Rules in the table
+	int capacity; ///<Slots, a power of two
+} rule_table_t;
+
+void rule_table_init(rule_table_t *table);
+void rule_table_destroy(rule_table_t *table);
+rule_t *rule_table_find(rule_table_t *table, const char *target);
+void rule_table_insert(rule_table_t *table, rule_t *rule);
+
 #endif
@@ -0,0 +1,307 @@
+/** @file state.c */
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "containers.h"
+#include "queue.h"
+#include "rule.h"
+#include "state.h"
+
+/*
+	File layout, native byte order, every record 8-byte aligned:
+
+	  header   "PMKSTAT1", uint32 records, uint32 unused
+	  record   uint32 bytes (whole record, a multiple of 8), uint32 deps,
+	           uint64 command hash,
+	           deps x { int64 mtime, int64 size, uint64 hash },
+	           target '\0', deps x { name '\0' }, zero padding
+
+	A file that does not follow it is ignored, as if there were none.
+*/
+
+#define STATE_MAGIC "PMKSTAT1"
+
+typedef struct{
+	uint32_t bytes;
+	uint32_t deps;
+	uint64_t command_hash;
+} record_header_t;
+
+typedef struct{
+	int64_t mtime;
+	int64_t size;
+	uint64_t hash;
+} record_stamp_t;
+
+static const record_stamp_t *record_stamps(const void *record){
+	return (const record_stamp_t *)((const char *)record + sizeof(record_header_t));
+}
+
+static const char *record_target(const void *record){
+	const record_header_t *header = record;
+	return (const char *)(record_stamps(record) + header->deps);
+}
+
+/* Slot for target in the index: its record, or the empty slot where it would go. */
+static int find_slot(state_db_t *db, const char *target){
+	int mask = db->capacity - 1;
+	int i = container_hash_string(target) & mask;
+	while(db->slots[i] != NULL && strcmp(record_target(db->slots[i]), target) != 0)
+		i = (i + 1) & mask;
+	return i;
+}
+
+/* Checks that the record at offset fits in the map; returns its size, or 0 if it is malformed. */
+static size_t check_record(state_db_t *db, size_t offset){
+	const record_header_t *header = (const record_header_t *)((const char *)db->map + offset);
+	size_t left = db->map_size - offset, names;
+	const char *p, *end;
+	uint32_t i;
+
+	if(left < sizeof(record_header_t) || header->bytes % 8 != 0 || header->bytes > left)
+		return 0;
+	names = sizeof(record_header_t) + (size_t)header->deps * sizeof(record_stamp_t);
+	if(header->deps > header->bytes / sizeof(record_stamp_t) || names >= header->bytes)
+		return 0;
+	p = (const char *)header + names;
+	end = (const char *)header + header->bytes;
+	for(i = 0; i <= header->deps; i++){
+		if((p = memchr(p, '\0', end - p)) == NULL) return 0;
+		p++;
+	}
+	return header->bytes;
+}
+
+static void drop_map(state_db_t *db){
+	if(db->map != NULL) munmap(db->map, db->map_size);
+	free(db->slots);
+	db->map = NULL;
+	db->map_size = 0;
+	db->slots = NULL;
+	db->capacity = 0;
+}
+
+/**
+ * Maps the database at path and indexes it.  A missing or malformed file
+ * gives an empty database.
+ *
+ * @param db A pointer to the database.
+ * @param path File the last build saved.
+ * @return Void.
+ */
+void state_load(state_db_t *db, const char *path){
+	struct stat st;
+	size_t offset, bytes;
+	uint32_t records, i;
+	int fd;
+
+	db->map = NULL;
+	db->map_size = 0;
+	db->slots = NULL;
+	db->capacity = 0;
+
+	if((fd = open(path, O_RDONLY)) == -1) return;
+	if(fstat(fd, &st) == 0 && st.st_size >= 16){
+		db->map_size = st.st_size;
+		db->map = mmap(NULL, db->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if(db->map == MAP_FAILED) db->map = NULL;
+	}
+	close(fd);
+	if(db->map == NULL || memcmp(db->map, STATE_MAGIC, 8) != 0){
+		drop_map(db);
+		return;
+	}
+
+	memcpy(&records, (const char *)db->map + 8, sizeof(records));
+	for(db->capacity = 64; db->capacity < 2 * (int)records + 2; db->capacity *= 2)
+		;
+	db->slots = calloc(db->capacity, sizeof(void *));
+	for(i = 0, offset = 16; i < records; i++, offset += bytes){
+		if((bytes = check_record(db, offset)) == 0){
+			drop_map(db);
+			return;
+		}
+		const void *record = (const char *)db->map + offset;
+		db->slots[find_slot(db, record_target(record))] = record;
+	}
+}
+
+/* Hash of a file's contents; for anything but a readable regular file, of its mtime and size. */
+static unsigned long long hash_file(const char *path, const struct stat *st){
+	unsigned long long h = CONTAINER_HASH_INIT;
+	char buf[65536];
+	ssize_t n;
+	int fd;
+
+	if(!S_ISREG(st->st_mode) || (fd = open(path, O_RDONLY)) == -1){
+		h = container_hash(h, &st->st_mtim, sizeof(st->st_mtim));
+		return container_hash(h, &st->st_size, sizeof(st->st_size));
+	}
+	while((n = read(fd, buf, sizeof(buf))) > 0)
+		h = container_hash(h, buf, n);
+	close(fd);
+	return h;
+}
+
+static long long mtime_ns(const struct stat *st){
+	return st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+/**
+ * Stamps the rule's dependencies and decides whether its target is up to
+ * date.  With a record from the last build, it is up to date if the
+ * commands and the list of dependencies are the same and no dependency's
+ * contents changed; a dependency whose mtime and size are unchanged is not
+ * read again.  Without one, it is up to date if no dependency is newer
+ * than the target.  A dependency that is not a file, such as a rule that
+ * makes no file, always makes the target out of date.
+ *
+ * Called from the event loop when the rule is taken off the ready heap,
+ * before any job is started for it; reads the database without changing it.
+ *
+ * @param db A pointer to the database.
+ * @param rule The rule, whose dependencies are all done.
+ * @param target stat() of the rule's target, or NULL if it does not exist.
+ * @return 1 if the target is up to date, 0 if the rule must run.
+ */
+int state_is_current(state_db_t *db, rule_t *rule, const struct stat *target){
+	const void *record = (db->slots != NULL) ? db->slots[find_slot(db, rule->target)] : NULL;
+	const record_header_t *header = record;
+	const record_stamp_t *old = NULL;
+	const char *old_name = NULL;
+	int deps = queue_size(rule->deps), i, current;
+	unsigned long long h = CONTAINER_HASH_INIT;
+	struct stat st;
+
+	for(i = 0; i < queue_size(rule->commands); i++){
+		const char *command = queue_at(rule->commands, i);
+		h = container_hash(h, command, strlen(command) + 1);
+	}
+	rule->command_hash = h;
+
+	current = (target != NULL);
+	if(record != NULL){
+		old = record_stamps(record);
+		old_name = record_target(record);
+		current = current && header->command_hash == h && header->deps == (uint32_t)deps;
+	}
+
+	free(rule->stamps);
+	rule->stamps = malloc((deps > 0 ? deps : 1) * sizeof(file_stamp_t));
+	for(i = 0; i < deps; i++){
+		const char *dep = queue_at(rule->deps, i);
+		file_stamp_t *stamp = &rule->stamps[i];
+		int same_name = 0;
+
+		if(stat(dep, &st) == -1){
+			free(rule->stamps);
+			rule->stamps = NULL;
+			return 0;
+		}
+		stamp->mtime = mtime_ns(&st);
+		stamp->size = st.st_size;
+
+		if(record != NULL && (uint32_t)i < header->deps){
+			old_name += strlen(old_name) + 1;
+			same_name = strcmp(old_name, dep) == 0;
+		}
+		if(same_name && old[i].mtime == stamp->mtime && old[i].size == stamp->size)
+			stamp->hash = old[i].hash;
+		else
+			stamp->hash = hash_file(dep, &st);
+
+		if(record != NULL)
+			current = current && same_name && old[i].hash == stamp->hash;
+		else if(target != NULL)
+			current = current && stamp->mtime <= mtime_ns(target);
+	}
+	return current;
+}
+
+static void write_padding(FILE *f, size_t bytes){
+	static const char zeros[8];
+	if(bytes % 8 != 0) fwrite(zeros, 1, 8 - bytes % 8, f);
+}
+
+/**
+ * Writes the next database to path, through a temporary file and
+ * rename().  It holds a record for every rule in order that is recorded,
+ * and keeps the old records of every other target, except rules that
+ * failed.
+ *
+ * @param db A pointer to the database from the last build.
+ * @param path File to write.
+ * @param rules Every rule in the build, by target.
+ * @param order Every rule in the build.
+ * @return Void.
+ */
+void state_save(state_db_t *db, const char *path, rule_table_t *rules, queue_t *order){
+	char tmp[4096];
+	uint32_t records = 0, unused = 0;
+	int i, j;
+	FILE *f;
+
+	snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+	if((f = fopen(tmp, "w")) == NULL) return;
+	fwrite(STATE_MAGIC, 1, 8, f);
+	fwrite(&records, sizeof(records), 1, f);
+	fwrite(&unused, sizeof(unused), 1, f);
+
+	for(i = 0; i < queue_size(order); i++){
+		rule_t *rule = queue_at(order, i);
+		record_header_t header;
+		size_t names = strlen(rule->target) + 1;
+		if(!rule->recorded) continue;
+
+		for(j = 0; j < queue_size(rule->deps); j++)
+			names += strlen(queue_at(rule->deps, j)) + 1;
+		header.deps = queue_size(rule->deps);
+		header.command_hash = rule->command_hash;
+		header.bytes = sizeof(header) + header.deps * sizeof(record_stamp_t) + names;
+		header.bytes += (8 - header.bytes % 8) % 8;
+		fwrite(&header, sizeof(header), 1, f);
+		for(j = 0; j < (int)header.deps; j++){
+			record_stamp_t stamp = { rule->stamps[j].mtime, rule->stamps[j].size, rule->stamps[j].hash };
+			fwrite(&stamp, sizeof(stamp), 1, f);
+		}
+		fwrite(rule->target, 1, strlen(rule->target) + 1, f);
+		for(j = 0; j < queue_size(rule->deps); j++)
+			fwrite(queue_at(rule->deps, j), 1, strlen(queue_at(rule->deps, j)) + 1, f);
+		write_padding(f, names);
+		records++;
+	}
+
+	for(i = 0; i < db->capacity; i++){
+		const void *record = db->slots[i];
+		rule_t *rule;
+		if(record == NULL) continue;
+		// a rule that wrote nothing keeps its old record, unless it failed and may have left its target half made
+		rule = rule_table_find(rules, record_target(record));
+		if(rule != NULL && (rule->recorded || rule->state == RULE_FAILED)) continue;
+		fwrite(record, 1, ((const record_header_t *)record)->bytes, f);
+		records++;
+	}
+
+	fseek(f, 8, SEEK_SET);
+	fwrite(&records, sizeof(records), 1, f);
+	if(fclose(f) == 0)
+		rename(tmp, path);
+	else
+		unlink(tmp);
+}
+
+/**
+ * Unmaps the database.
+ *
+ * @param db A pointer to the database.
+ * @return Void.
+ */
+void state_close(state_db_t *db){
+	drop_map(db);
+}
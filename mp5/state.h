@@ -0,0 +1,31 @@
+/** @file state.h */
+#ifndef __STATE_H__
+#define __STATE_H__
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include "queue.h"
+#include "rule.h"
+
+/**
+ * Build-State Database
+ *
+ * Remembers, for every target built, the hash of its commands and what
+ * each of its dependencies looked like.  The file from the last build is
+ * mmap()ed read-only and indexed by target; state_save() writes the next
+ * one.
+ */
+typedef struct{
+	void *map; ///<The file from the last build, or NULL
+	size_t map_size; ///<Bytes mapped
+	const void **slots; ///<Open-addressed index of its records by target, NULL where empty
+	int capacity; ///<Slots, a power of two
+} state_db_t;
+
+void state_load(state_db_t *db, const char *path);
+int state_is_current(state_db_t *db, rule_t *rule, const struct stat *target);
+void state_save(state_db_t *db, const char *path, rule_table_t *rules, queue_t *order);
+void state_close(state_db_t *db);
+
+#endif